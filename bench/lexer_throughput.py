@@ -0,0 +1,164 @@
+#!/usr/bin/env python3
+# Measure the throughput of the lexer, in MB/s, on large generated inputs.
+#
+# The inputs are generated into a directory (by default bench/inputs), unless
+# they are already there. Each input is lexed by `mxrlang -time-lex` with each
+# implementation of the scanners, and the best of the runs is reported.
+#
+# Usage: lexer_throughput.py <path to mxrlang> [--runs N] [--dir DIR]
+#                            [--scanners scalar,sse2,avx2]
+
+import argparse
+import os
+import random
+import re
+import subprocess
+import sys
+
+TYPES = ["INT", "INT8", "INT16", "INT32", "UINT", "BOOL"]
+SHORT_NAMES = ["i", "j", "n", "len", "sum", "acc", "tmp", "idx", "val", "res",
+               "count", "total", "arr", "ptr", "left", "right", "mid", "flag"]
+
+
+def expression(rng, names, depth=0):
+    if depth > 2 or rng.random() < 0.3:
+        if rng.random() < 0.4:
+            return str(rng.randint(0, 100000))
+        return rng.choice(names)
+    op = rng.choice(["+", "-", "*", "/", "<", "<=", "==", "!=", "&&"])
+    left = expression(rng, names, depth + 1)
+    right = expression(rng, names, depth + 1)
+    if rng.random() < 0.2:
+        return "(%s %s %s)" % (left, op, right)
+    return "%s %s %s" % (left, op, right)
+
+
+def typical_function(rng, num):
+    # Code as written by hand: short names, two space indentation, one
+    # statement per line.
+    names = rng.sample(SHORT_NAMES, 6)
+    lines = ["FUN fun_%d : INT(%s : INT, %s : INT*)" % (num, names[0],
+                                                       names[1])]
+    for name in names[2:]:
+        lines.append("  VAR %s : %s := %s;" % (name, rng.choice(TYPES),
+                                              expression(rng, names)))
+    lines.append("  VAR buf : INT[%d];" % rng.randint(1, 4096))
+    lines.append("  WHILE %s < %d DO" % (names[2], rng.randint(1, 1000)))
+    for _ in range(rng.randint(2, 6)):
+        lines.append("    buf[%s] := %s;" % (names[2], expression(rng, names)))
+        lines.append("    %s := %s + 1;" % (names[2], names[2]))
+    lines.append("  ELIHW")
+    lines.append("  IF %s THEN" % expression(rng, names))
+    lines.append("    PRINT %s;" % expression(rng, names))
+    lines.append("  ELSE")
+    lines.append("    %s := %s(%s, &buf[0]);" % (names[3], "fun_%d" % num,
+                                                names[4]))
+    lines.append("  FI")
+    lines.append("  RETURN %s;" % expression(rng, names))
+    lines.append("NUF")
+    return "\n".join(lines) + "\n\n"
+
+
+def long_name(rng, length=60):
+    head = rng.choice("abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ_")
+    body = "".join(rng.choice("abcdefghijklmnopqrstuvwxyz_0123456789")
+                   for _ in range(length - 1))
+    return head + body
+
+
+def long_names_function(rng, num):
+    # Generated code with 60 character identifiers.
+    names = [long_name(rng) for _ in range(8)]
+    lines = ["FUN %s : INT(%s : INT)" % (names[0], names[1])]
+    for name in names[2:]:
+        lines.append("  VAR %s : INT := %s + %s;" % (name, rng.choice(names),
+                                                    rng.choice(names)))
+    lines.append("  RETURN %s;" % " * ".join(rng.sample(names, 4)))
+    lines.append("NUF")
+    return "\n".join(lines) + "\n\n"
+
+
+def whitespace_function(rng, num):
+    # Code laid out in wide columns, with tabs, blank lines and deep
+    # indentation.
+    def pad():
+        return rng.choice([" ", "\t"]) * rng.randint(8, 40)
+
+    names = rng.sample(SHORT_NAMES, 5)
+    lines = ["FUN%sf_%d%s:%sINT()" % (pad(), num, pad(), pad())]
+    for name in names:
+        lines.append("%sVAR%s%s%s:%sINT%s:=%s%d;" % (
+            pad(), pad(), name, pad(), pad(), pad(), pad(),
+            rng.randint(0, 1000)))
+        lines.extend([pad()] * rng.randint(1, 3))
+    lines.append("%sRETURN%s%s;" % (pad(), pad(), names[0]))
+    lines.append("NUF")
+    return "\n".join(lines) + "\n\n"
+
+
+INPUTS = [
+    ("typical code", "typical.mxr", typical_function, 13_000_000),
+    ("60-char identifiers", "long_names.mxr", long_names_function,
+     47_000_000),
+    ("whitespace-heavy layout", "whitespace.mxr", whitespace_function,
+     31_000_000),
+]
+
+
+def generate(path, function, size):
+    rng = random.Random(42)
+    written = 0
+    num = 0
+    with open(path, "w") as out:
+        while written < size:
+            text = function(rng, num)
+            out.write(text)
+            written += len(text)
+            num += 1
+
+
+def lex(mxrlang, scanners, path):
+    result = subprocess.run(
+        [mxrlang, "-time-lex", "-lex-scanners=" + scanners, path],
+        stdout=subprocess.PIPE, stderr=subprocess.PIPE, text=True)
+    if result.returncode != 0:
+        return None
+    match = re.search(r"\(([0-9.]+) MB/s\)", result.stdout)
+    return float(match.group(1)) if match else None
+
+
+def main():
+    parser = argparse.ArgumentParser(
+        description="Measure the throughput of the lexer, in MB/s.")
+    parser.add_argument("mxrlang", help="path to the mxrlang executable")
+    parser.add_argument("--runs", type=int, default=9,
+                        help="number of runs per input and scanners")
+    parser.add_argument("--dir", default=os.path.join(
+        os.path.dirname(os.path.abspath(__file__)), "inputs"),
+        help="directory of the generated inputs")
+    parser.add_argument("--scanners", default="scalar,sse2,avx2",
+                        help="comma separated list of the scanners to use")
+    args = parser.parse_args()
+
+    os.makedirs(args.dir, exist_ok=True)
+    scanners = args.scanners.split(",")
+    print("%-36s" % ("MB/s, best of %d runs" % args.runs) +
+          "".join("%10s" % name for name in scanners))
+    for name, fileName, function, size in INPUTS:
+        path = os.path.join(args.dir, fileName)
+        if not os.path.exists(path):
+            generate(path, function, size)
+
+        row = "%-36s" % ("%s, %.1fMB" % (name, os.path.getsize(path) / 1e6))
+        for impl in scanners:
+            results = [lex(args.mxrlang, impl, path) for _ in range(args.runs)]
+            if None in results:
+                row += "%10s" % "n/a"
+            else:
+                row += "%10.1f" % max(results)
+        print(row)
+        sys.stdout.flush()
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,117 @@
+#!/usr/bin/env python3
+# Measure the time taken by the semantic check of a large generated module,
+# with -sema-threads=1 (SemaCheck::run) and with more threads
+# (SemaCheck::runParallel).
+#
+# The wall time of the semantic check is taken from the -time-passes report.
+# Each module ends with a semantic error, so that the compilation stops after
+# the check. The variants with more errors than the limit at the start or at
+# the end of the module measure the fallback of runParallel, which checks
+# again serially the ranges from the first one which exceeds the limit.
+#
+# Usage: sema_threads.py <path to mxrlang> [--functions N] [--runs N]
+#                        [--threads 1,0,2,4] [--dir DIR]
+
+import argparse
+import os
+import re
+import subprocess
+
+ERRORS = 6
+
+
+def function(num):
+    # A function which calls the previous one, with locals, a loop over an
+    # array and a condition.
+    callee = "f%d(n - 1)" % (num - 1) if num > 0 else "n"
+    return """FUN f%d : INT(n : INT)
+  VAR arr : INT[16];
+  VAR i : INT := 0;
+  VAR sum : INT := 0;
+  WHILE i < 16 DO
+    arr[i] := i * %d + n;
+    sum := sum + arr[i] / 2;
+    i := i + 1;
+  ELIHW
+  IF sum > %d THEN
+    sum := sum - %s;
+  ELSE
+    sum := sum + INT(INT8(n));
+  FI
+  RETURN sum;
+NUF
+
+""" % (num, num % 97, num % 1000, callee)
+
+
+def bad_function(num):
+    return """FUN bad%d : INT()
+  RETURN undefined%d;
+NUF
+
+""" % (num, num)
+
+
+def generate(path, numFunctions, head="", tail=""):
+    with open(path, "w") as out:
+        out.write(head)
+        for num in range(numFunctions):
+            out.write(function(num))
+        out.write(tail)
+
+
+def best_time(mxrlang, threads, path, runs):
+    best = None
+    for _ in range(runs):
+        result = subprocess.run(
+            [mxrlang, "-time-passes", "-sema-threads=" + threads, path],
+            stdout=subprocess.DEVNULL, stderr=subprocess.PIPE, text=True)
+        match = re.search(r"([0-9.]+) \([ 0-9.]+%\)\s+Semantic check",
+                          result.stderr)
+        elapsed = float(match.group(1))
+        best = elapsed if best is None else min(best, elapsed)
+    return best
+
+
+def main():
+    parser = argparse.ArgumentParser(
+        description="Measure the time taken by the semantic check.")
+    parser.add_argument("mxrlang", help="path to the mxrlang executable")
+    parser.add_argument("--functions", type=int, default=20000,
+                        help="number of functions in the module")
+    parser.add_argument("--runs", type=int, default=5,
+                        help="number of runs of each compilation")
+    parser.add_argument("--threads", default="1,0,2,4",
+                        help="comma separated list of -sema-threads values")
+    parser.add_argument("--dir", default=os.path.join(
+        os.path.dirname(os.path.abspath(__file__)), "inputs"),
+        help="directory of the generated inputs")
+    args = parser.parse_args()
+
+    os.makedirs(args.dir, exist_ok=True)
+    errors = "".join(bad_function(num) for num in range(ERRORS))
+    inputs = {
+        "clean": ("", bad_function(0)),
+        "errors first": (errors, ""),
+        "errors last": ("", errors),
+    }
+    paths = {}
+    for name, (head, tail) in inputs.items():
+        paths[name] = os.path.join(args.dir,
+                                   "sema_%s.mxr" % name.replace(" ", "_"))
+        generate(paths[name], args.functions, head, tail)
+
+    print("Semantic check of %d functions (s), best of %d runs" %
+          (args.functions, args.runs))
+    print("%-22s" % "" +
+          "".join("%10s" % ("threads=" + t)
+                  for t in args.threads.split(",")))
+    for name, path in paths.items():
+        row = "%-22s" % name
+        for threads in args.threads.split(","):
+            row += "%10.3f" % best_time(args.mxrlang, threads, path, args.runs)
+        print(row)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,93 @@
+#ifndef ASTCLONER_H
+#define ASTCLONER_H
+
+#include "llvm/ADT/DenseMap.h"
+
+#include "ASTContext.h"
+#include "ASTVisitor.h"
+
+namespace mxrlang {
+
+// Copies a checked module into another context, so that the passes which
+// change the module (e.g. the constant folder) can run without touching the
+// original, which is kept for the next revision of the module. The copy
+// keeps the types and the flags set by the semantic check, and its variable
+// accesses and calls are bound to the copied declarations. Expression visit
+// methods return the copy of the visited expression.
+class ASTCloner : public ASTVisitor<ASTCloner, Expr *> {
+  friend class ASTVisitor<ASTCloner, Expr *>;
+  using ASTVisitor<ASTCloner, Expr *>::visit;
+
+  // Context which owns the copy.
+  ASTContext &ctx;
+
+  // Copies of the declarations copied so far.
+  llvm::DenseMap<Decl *, Decl *> clones;
+
+  // Copy of the last visited statement or declaration.
+  Node *cloned = nullptr;
+
+  // Expression visitor methods
+  Expr *visit(ArrayAccessExpr *expr);
+  Expr *visit(ArrayInitExpr *expr);
+  Expr *visit(AssignExpr *expr);
+  Expr *visit(BinaryArithExpr *expr);
+  Expr *visit(BinaryLogicalExpr *expr);
+  Expr *visit(BoolLiteralExpr *expr);
+  Expr *visit(CallExpr *expr);
+  Expr *visit(CastExpr *expr);
+  Expr *visit(IntLiteralExpr *expr);
+  Expr *visit(LoadExpr *expr);
+  Expr *visit(PointerOpExpr *expr);
+  Expr *visit(UnaryExpr *expr);
+  Expr *visit(VarExpr *expr);
+
+  // Statement visitor methods
+  void visit(ExprStmt *stmt);
+  void visit(IfStmt *stmt);
+  void visit(PrintStmt *stmt);
+  void visit(ReturnStmt *stmt);
+  void visit(ScanStmt *stmt);
+  void visit(WhileStmt *stmt);
+
+  // Declaration visitor methods
+  void visit(FunDecl *decl);
+  void visit(ModuleDecl *decl);
+  void visit(VarDecl *decl);
+
+  // Copy a list of statements and declarations.
+  Nodes cloneAll(Nodes &nodes);
+
+  // Give the copy of an expression the type of the original.
+  Expr *finish(Expr *clone, Expr *expr) {
+    clone->setType(expr->getType());
+    return clone;
+  }
+
+  // Get the copy of a declaration which was already copied.
+  template <typename T> T *getClone(T *decl) {
+    if (!decl)
+      return nullptr;
+    assert(clones.count(decl) && "Declaration is not copied yet.");
+    return llvm::cast<T>(clones[decl]);
+  }
+
+  // Copy a variable declaration, without its initializer.
+  VarDecl *cloneDecl(VarDecl *decl);
+
+  // Copy a function declaration and its arguments, without its body.
+  FunDecl *cloneDecl(FunDecl *decl);
+
+public:
+  explicit ASTCloner(ASTContext &ctx) : ctx(ctx) {}
+
+  // Runner.
+  ModuleDecl *run(ModuleDecl *moduleDecl) {
+    evaluate(moduleDecl);
+    return llvm::cast<ModuleDecl>(llvm::cast<Decl>(cloned));
+  }
+};
+
+} // namespace mxrlang
+
+#endif // ASTCLONER_H
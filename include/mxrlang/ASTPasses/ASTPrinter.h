@@ -1,37 +1,41 @@
 #ifndef ASTPRINTER_H
 #define ASTPRINTER_H
 
-#include "Tree.h"
+#include "ASTVisitor.h"
 
 namespace mxrlang {
 
-class ASTPrinter : public Visitor {
+class ASTPrinter : public ASTVisitor<ASTPrinter> {
+  friend class ASTVisitor<ASTPrinter>;
+  using ASTVisitor<ASTPrinter>::visit;
+
   // Expression visitor methods
-  void visit(ArrayAccessExpr *expr) override;
-  void visit(ArrayInitExpr *expr) override;
-  void visit(AssignExpr *expr) override;
-  void visit(BinaryArithExpr *expr) override;
-  void visit(BinaryLogicalExpr *expr) override;
-  void visit(BoolLiteralExpr *expr) override;
-  void visit(CallExpr *expr) override;
-  void visit(IntLiteralExpr *expr) override;
-  void visit(LoadExpr *expr) override;
-  void visit(PointerOpExpr *expr) override;
-  void visit(UnaryExpr *expr) override;
-  void visit(VarExpr *expr) override;
+  void visit(ArrayAccessExpr *expr);
+  void visit(ArrayInitExpr *expr);
+  void visit(AssignExpr *expr);
+  void visit(BinaryArithExpr *expr);
+  void visit(BinaryLogicalExpr *expr);
+  void visit(BoolLiteralExpr *expr);
+  void visit(CallExpr *expr);
+  void visit(CastExpr *expr);
+  void visit(IntLiteralExpr *expr);
+  void visit(LoadExpr *expr);
+  void visit(PointerOpExpr *expr);
+  void visit(UnaryExpr *expr);
+  void visit(VarExpr *expr);
 
   // Statement visitor methods
-  void visit(ExprStmt *stmt) override;
-  void visit(IfStmt *stmt) override;
-  void visit(PrintStmt *stmt) override;
-  void visit(ReturnStmt *stmt) override;
-  void visit(ScanStmt *stmt) override;
-  void visit(WhileStmt *stmt) override;
+  void visit(ExprStmt *stmt);
+  void visit(IfStmt *stmt);
+  void visit(PrintStmt *stmt);
+  void visit(ReturnStmt *stmt);
+  void visit(ScanStmt *stmt);
+  void visit(WhileStmt *stmt);
 
   // Declaration visitor methods
-  void visit(FunDecl *decl) override;
-  void visit(ModuleDecl *decl) override;
-  void visit(VarDecl *decl) override;
+  void visit(FunDecl *decl);
+  void visit(ModuleDecl *decl);
+  void visit(VarDecl *decl);
 
   // Controls the level of indentation during the print.
   // E.g. when entering IF stmt, push back a "\t", and pop it when
@@ -41,9 +45,8 @@ class ASTPrinter : public Visitor {
   void increaseIndent() { indent.append("\t"); }
   void decreaseIndent() { indent.resize(indent.size() - 1); }
 
-  // Helper function which prints a binary operator.
-  template <typename BinExpr>
-  void printBinary(const llvm::StringRef &op, const BinExpr binExpr);
+  // Helper function which prints a chain of operator expressions.
+  void printOperators(Expr *expr);
 
   // Helper function which prints a variable declaration or a function
   // declaration argument.
@@ -52,10 +55,10 @@ class ASTPrinter : public Visitor {
   // Wrapper arout llvm::outs().
   llvm::raw_fd_ostream &out() const { return llvm::outs(); }
 
-  // Helper function for evaluating an expression or a statement.
-  template <typename T> void evaluate(const T expr) { expr->accept(this); }
-
 public:
+  // Operators are printed before their operands.
+  static constexpr bool EvaluateOperandsFirst = false;
+
   // Runner.
   void run(ModuleDecl *moduleDecl) {
     llvm::outs() << "----------- AST dump --------------\n";
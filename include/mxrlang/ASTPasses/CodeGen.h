@@ -1,29 +1,35 @@
 #ifndef CODEGEN_H
 #define CODEGEN_H
 
+#include "llvm/ADT/DenseMap.h"
 #include "llvm/IR/IRBuilder.h"
 #include "llvm/IR/Instructions.h"
+#include "llvm/IR/Intrinsics.h"
 #include "llvm/Target/TargetMachine.h"
 #include <memory>
+#include <vector>
 
+#include "ASTVisitor.h"
 #include "Diag.h"
-#include "ScopeMgr.h"
 #include "Type.h"
 
 namespace mxrlang {
 
-class CodeGen : public Visitor {
-  friend class ScopeMgr<CodeGen, llvm::Value>;
-  using ValueScopeMgr = ScopeMgr<CodeGen, llvm::Value>;
+class CodeGen : public ASTVisitor<CodeGen, llvm::Value *> {
+  friend class ASTVisitor<CodeGen, llvm::Value *>;
 
-  // Environment holding various Value pointers (allocas, functions, etc).
-  Environment<llvm::Value> *env = nullptr;
+  // Values of the declarations (allocas, globals, functions), indexed by the
+  // index of the declaration.
+  std::vector<llvm::Value *> values;
 
   // Built-in print/scan functions declarations and format string.
   llvm::Function *printFun;
   llvm::Function *scanFun;
   llvm::Constant *printFormatStr;
   llvm::Constant *scanFormatStr;
+  // Format strings of the unsigned integers, created on first use.
+  llvm::Constant *printUnsignedFormatStr = nullptr;
+  llvm::Constant *scanUnsignedFormatStr = nullptr;
 
   // LLVM internals.
   llvm::LLVMContext ctx;
@@ -31,9 +37,25 @@ class CodeGen : public Visitor {
   std::unique_ptr<llvm::Module> module;
   llvm::IRBuilder<> builder;
 
+  // LLVM types of the mxrlang types converted so far.
+  llvm::DenseMap<const Type *, llvm::Type *> llvmTypes;
+
+  // Whether BOOL arrays which are never accessed through a pointer are
+  // stored as bit vectors, one bit per element.
+  bool packBoolArrays;
+
+  // Whether the accesses to arrays check that the element is within the
+  // bounds of the array, and trap if it is not. Accesses proven to be in
+  // bounds are not checked.
+  bool boundsCheck;
+
   // Function which we are currently generating.
   llvm::Function *currFun = nullptr;
 
+  // BB of the current function which traps on an access out of bounds,
+  // created on first use.
+  llvm::BasicBlock *trapBB = nullptr;
+
   // BB in which we are currently inserting.
   llvm::BasicBlock *currBB = nullptr;
 
@@ -43,37 +65,88 @@ class CodeGen : public Visitor {
   // Diagnostics manager.
   Diag &diag;
 
-  // Intermediate result of the code gen.
-  llvm::Value *interResult;
-
   // Expression visitor methods
-  void visit(ArrayAccessExpr *expr) override;
-  void visit(ArrayInitExpr *expr) override;
-  void visit(AssignExpr *expr) override;
-  void visit(BinaryArithExpr *expr) override;
-  void visit(BinaryLogicalExpr *expr) override;
-  void visit(BoolLiteralExpr *expr) override;
-  void visit(CallExpr *expr) override;
-  void visit(IntLiteralExpr *expr) override;
-  void visit(LoadExpr *expr) override;
-  void visit(PointerOpExpr *expr) override;
-  void visit(UnaryExpr *expr) override;
-  void visit(VarExpr *expr) override;
+  llvm::Value *visit(ArrayAccessExpr *expr);
+  llvm::Value *visit(ArrayInitExpr *expr);
+  llvm::Value *visit(AssignExpr *expr);
+  llvm::Value *visit(BinaryArithExpr *expr);
+  llvm::Value *visit(BinaryLogicalExpr *expr);
+  llvm::Value *visit(BoolLiteralExpr *expr);
+  llvm::Value *visit(CallExpr *expr);
+  llvm::Value *visit(CastExpr *expr);
+  llvm::Value *visit(IntLiteralExpr *expr);
+  llvm::Value *visit(LoadExpr *expr);
+  llvm::Value *visit(PointerOpExpr *expr);
+  llvm::Value *visit(UnaryExpr *expr);
+  llvm::Value *visit(VarExpr *expr);
 
   // Statement visitor methods
-  void visit(ExprStmt *stmt) override;
-  void visit(IfStmt *stmt) override;
-  void visit(PrintStmt *stmt) override;
-  void visit(ReturnStmt *stmt) override;
-  void visit(ScanStmt *stmt) override;
-  void visit(WhileStmt *stmt) override;
+  void visit(ExprStmt *stmt);
+  void visit(IfStmt *stmt);
+  void visit(PrintStmt *stmt);
+  void visit(ReturnStmt *stmt);
+  void visit(ScanStmt *stmt);
+  void visit(WhileStmt *stmt);
+
+  // Declaration visitor methods
+  void visit(FunDecl *decl);
+  void visit(ModuleDecl *decl);
+  void visit(VarDecl *decl);
+
+  // Convert the mxrlang type to LLVM type.
+  llvm::Type *getLLVMType(const Type *type);
+
+  // Record and get the value of a declaration.
+  void setValue(Decl *decl, llvm::Value *value) {
+    if (decl->getIndex() >= values.size())
+      values.resize(decl->getIndex() + 1);
+    values[decl->getIndex()] = value;
+  }
+  llvm::Value *getValue(Decl *decl) const { return values[decl->getIndex()]; }
+
+  // Extend an integer value to 64 bits, according to the sign of its type.
+  llvm::Value *extendToInt64(llvm::Value *val, const Type *type);
+
+  // Check whether the variable is a BOOL array stored as a bit vector.
+  bool isPackedArray(VarDecl *decl);
+
+  // Type of the bit vector storing a BOOL array.
+  llvm::Type *getPackedArrayType(const Type *type);
+
+  // Get the bit vector which the expression accesses an element of, or null
+  // if the expression is not such an access.
+  llvm::Value *getPackedArray(Expr *expr);
+
+  // Get the element accessed in the array, as a 64-bit index. The element is
+  // checked to be within the bounds of the array, if needed.
+  llvm::Value *getElementIndex(ArrayAccessExpr *expr);
+
+  // Get the address of the byte holding the element of a bit vector, and the
+  // position of the element's bit in that byte. The element is a 64-bit
+  // index.
+  llvm::Value *getPackedElement(const Type *arrayType, llvm::Value *array,
+                                llvm::Value *element, llvm::Value *&bit);
+
+  // Store the BOOL value into the element of a bit vector.
+  llvm::Value *storePackedElement(const Type *arrayType, llvm::Value *array,
+                                  llvm::Value *element, llvm::Value *source);
+
+  // Element of a local array initializer which is not a literal, and is
+  // stored after the array is initialized in bulk.
+  struct ArrayInitStore {
+    std::vector<uint64_t> indices;
+    Expr *expr;
+  };
 
-  void visit(FunDecl *decl) override;
-  void visit(ModuleDecl *decl) override;
-  void visit(VarDecl *decl) override;
+  // Get the constant array of the literals in the initializer, with zeros in
+  // place of the other elements, which are collected.
+  llvm::Constant *getArrayInitConstant(ArrayInitExpr *init, const Type *type,
+                                       std::vector<uint64_t> &indices,
+                                       std::vector<ArrayInitStore> &stores);
 
-  // Helper function for evaluating an expression or a statement.
-  template <typename T> void evaluate(const T expr) { expr->accept(this); }
+  // Initialize a local array from its initialization list.
+  void initLocalArray(VarDecl *decl, ArrayInitExpr *init,
+                      llvm::AllocaInst *alloca);
 
   // Set the current BB and builder.
   void setCurrBB(llvm::BasicBlock *BB) {
@@ -88,8 +161,10 @@ class CodeGen : public Visitor {
   void createPrintScanFunctions();
 
 public:
-  CodeGen(llvm::TargetMachine *TM, std::string fileName, Diag &diag)
-      : TM(TM), builder(ctx), fileName(fileName), diag(diag) {
+  CodeGen(llvm::TargetMachine *TM, std::string fileName, Diag &diag,
+          bool packBoolArrays = false, bool boundsCheck = false)
+      : TM(TM), builder(ctx), packBoolArrays(packBoolArrays),
+        boundsCheck(boundsCheck), fileName(fileName), diag(diag) {
     module = std::make_unique<llvm::Module>(fileName, ctx);
     module->setTargetTriple(TM->getTargetTriple().getTriple());
     module->setDataLayout(TM->createDataLayout());
@@ -0,0 +1,130 @@
+#ifndef CONSTEVALUATOR_H
+#define CONSTEVALUATOR_H
+
+#include "llvm/ADT/APInt.h"
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/Optional.h"
+#include "llvm/ADT/STLExtras.h"
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "ASTVisitor.h"
+
+namespace mxrlang {
+
+// Number of steps which the compile-time evaluations of a module may take in
+// total. A step is an interpreted statement or loop iteration, or an element
+// of an array variable. The budget is shared by all evaluations of the module,
+// so that many runaway evaluations can't stall the compilation any longer than
+// one can.
+struct StepBudget {
+  // A step takes about 25 ns in an optimized build of the compiler, and about
+  // 1 us in an unoptimized one. The default keeps the evaluation of a module
+  // under 30 ms, and around a second in an unoptimized build. It is also the
+  // default limit of the constant evaluation of Clang.
+  static constexpr uint64_t DefaultMax = 1 << 20;
+
+  uint64_t max;
+  uint64_t left;
+
+  explicit StepBudget(uint64_t max = DefaultMax) : max(max), left(max) {}
+};
+
+// Interprets checked expressions of integer and BOOL type at compile time.
+// Expressions may call functions, whose bodies are interpreted too, as long
+// as they only work with their arguments and local variables: accessing
+// globals or pointers, passing arrays, and input and output all make an
+// expression non-constant. Values are kept in the width of their types (one
+// bit for BOOL). Arithmetic which overflows its type or divides by zero, and
+// array accesses out of bounds, fail the evaluation.
+class ConstEvaluator
+    : public ASTVisitor<ConstEvaluator, llvm::Optional<llvm::APInt>> {
+  friend class ASTVisitor<ConstEvaluator, llvm::Optional<llvm::APInt>>;
+  using ASTVisitor<ConstEvaluator, llvm::Optional<llvm::APInt>>::visit;
+
+  using Value = llvm::Optional<llvm::APInt>;
+
+  // Limit which keeps runaway recursions from exhausting the stack.
+  static constexpr unsigned MaxCallDepth = 256;
+
+  // Steps left to the evaluations of the module.
+  StepBudget &budget;
+
+  // Local variables of a function being interpreted. Arrays are stored
+  // flattened, one value per element, and unset values are uninitialized.
+  using Frame = llvm::DenseMap<const VarDecl *, std::vector<Value>>;
+  std::vector<Frame> frames;
+
+  // Tells whether the body of a function is checked, and can be interpreted.
+  // Owned, as the callers pass temporary lambdas.
+  std::function<bool(FunDecl *)> isChecked;
+
+  // Value returned by the function being interpreted. Set once its return
+  // statement is reached.
+  Value retValue;
+  bool returning = false;
+
+  // Why the evaluation failed. Empty while it succeeds.
+  std::string failure;
+
+  // Expression visitor methods
+  Value visit(ArrayAccessExpr *expr);
+  Value visit(ArrayInitExpr *expr);
+  Value visit(AssignExpr *expr);
+  Value visit(BinaryArithExpr *expr);
+  Value visit(BinaryLogicalExpr *expr);
+  Value visit(BoolLiteralExpr *expr);
+  Value visit(CallExpr *expr);
+  Value visit(CastExpr *expr);
+  Value visit(IntLiteralExpr *expr);
+  Value visit(LoadExpr *expr);
+  Value visit(PointerOpExpr *expr);
+  Value visit(UnaryExpr *expr);
+  Value visit(VarExpr *expr);
+
+  // Statement visitor methods
+  void visit(ExprStmt *stmt);
+  void visit(IfStmt *stmt);
+  void visit(PrintStmt *stmt);
+  void visit(ReturnStmt *stmt);
+  void visit(ScanStmt *stmt);
+  void visit(WhileStmt *stmt);
+
+  // Declaration visitor methods
+  void visit(VarDecl *decl);
+
+  // Interpret a list of statements, until the function returns or the
+  // evaluation fails.
+  void run(Nodes &nodes);
+
+  // Take steps out of the budget. Fails once it is exhausted.
+  bool step(uint64_t num = 1);
+
+  // Record why the evaluation failed, unless that is already known.
+  llvm::NoneType fail(const std::string &reason);
+
+  // Get the values stored in the variable or the array element which the
+  // expression refers to. Returns false if the evaluation failed.
+  bool getStorage(Expr *expr, llvm::MutableArrayRef<Value> &storage);
+
+  // Store the values of the initialization list into the flattened storage
+  // of the array. Returns false if the evaluation failed.
+  bool initArray(ArrayInitExpr *init, llvm::MutableArrayRef<Value> storage);
+
+public:
+  ConstEvaluator(StepBudget &budget,
+                 std::function<bool(FunDecl *)> isChecked)
+      : budget(budget), isChecked(std::move(isChecked)) {}
+
+  // Evaluate the expression. Returns None if it is not constant, and
+  // getFailure() then tells why.
+  Value evaluateConst(Expr *expr);
+
+  const std::string &getFailure() const { return failure; }
+};
+
+} // namespace mxrlang
+
+#endif // CONSTEVALUATOR_H
@@ -0,0 +1,74 @@
+#ifndef CONSTANTFOLDER_H
+#define CONSTANTFOLDER_H
+
+#include "llvm/ADT/APInt.h"
+
+#include "ASTContext.h"
+#include "ASTVisitor.h"
+#include "Diag.h"
+
+namespace mxrlang {
+
+// Evaluates the constant subtrees of a checked module into literals, and
+// drops the bodies of IF and WHILE statements which can never execute.
+// Arithmetic on constants which overflows its type or divides by zero is
+// reported. Expression visit methods return the expression which takes the
+// place of the visited one.
+class ConstantFolder : public ASTVisitor<ConstantFolder, Expr *> {
+  friend class ASTVisitor<ConstantFolder, Expr *>;
+  using ASTVisitor<ConstantFolder, Expr *>::visit;
+
+  Diag &diag;
+
+  // Context which owns the created literals.
+  ASTContext &ctx;
+
+  // Expression visitor methods
+  Expr *visit(ArrayAccessExpr *expr);
+  Expr *visit(ArrayInitExpr *expr);
+  Expr *visit(AssignExpr *expr);
+  Expr *visit(BinaryArithExpr *expr);
+  Expr *visit(BinaryLogicalExpr *expr);
+  Expr *visit(BoolLiteralExpr *expr) { return expr; }
+  Expr *visit(CallExpr *expr);
+  Expr *visit(CastExpr *expr);
+  Expr *visit(IntLiteralExpr *expr) { return expr; }
+  Expr *visit(LoadExpr *expr);
+  Expr *visit(PointerOpExpr *expr);
+  Expr *visit(UnaryExpr *expr);
+  Expr *visit(VarExpr *expr) { return expr; }
+
+  // Statement visitor methods
+  void visit(ExprStmt *stmt);
+  void visit(IfStmt *stmt);
+  void visit(PrintStmt *stmt);
+  void visit(ReturnStmt *stmt);
+  void visit(ScanStmt *stmt);
+  void visit(WhileStmt *stmt);
+
+  // Declaration visitor methods
+  void visit(FunDecl *decl);
+  void visit(ModuleDecl *decl);
+  void visit(VarDecl *decl);
+
+  void foldAll(Nodes &nodes) {
+    for (auto *node : nodes)
+      evaluate(node);
+  }
+
+  // Get the value of an integer literal, in the width of its type.
+  static llvm::APInt getValue(IntLiteralExpr *literal);
+
+  // Create a folded literal of the given integer type.
+  Expr *createLiteral(const llvm::APInt &value, Type *type, SourceLoc loc);
+
+public:
+  ConstantFolder(Diag &diag, ASTContext &ctx) : diag(diag), ctx(ctx) {}
+
+  // Runner.
+  void run(ModuleDecl *moduleDecl) { evaluate(moduleDecl); }
+};
+
+} // namespace mxrlang
+
+#endif // CONSTANTFOLDER_H
@@ -0,0 +1,83 @@
+#ifndef EFFECTANALYSIS_H
+#define EFFECTANALYSIS_H
+
+#include <vector>
+
+#include "ASTVisitor.h"
+
+namespace mxrlang {
+
+// Infers the effects of the functions of a checked module, over the call
+// graph: whether a function reads or writes the memory visible to its
+// callers, whether it always returns, and whether it may call itself. Local
+// variables of a function are not visible to its callers. Accesses to globals
+// and through pointers, and printing and scanning, are effects. Loops, input
+// and recursion may keep a function from returning, and so do the array
+// accesses which may trap when the bounds are checked.
+class EffectAnalysis : public ASTVisitor<EffectAnalysis> {
+  friend class ASTVisitor<EffectAnalysis>;
+  using ASTVisitor<EffectAnalysis>::visit;
+
+  // Whether the array accesses which are not proven to be in bounds trap if
+  // they are out of bounds.
+  bool boundsCheck;
+
+  // Effects of the code of the function being analyzed, without the effects
+  // of the functions it calls.
+  FunDecl::MemoryEffect effect;
+  bool mayNotReturn;
+
+  // Functions called by the function being analyzed.
+  std::vector<FunDecl *> callees;
+
+  // Expression visitor methods
+  void visit(ArrayAccessExpr *expr);
+  void visit(ArrayInitExpr *expr);
+  void visit(AssignExpr *expr);
+  void visit(BinaryArithExpr *expr);
+  void visit(BinaryLogicalExpr *expr);
+  void visit(CallExpr *expr);
+  void visit(CastExpr *expr);
+  void visit(LoadExpr *expr);
+  void visit(PointerOpExpr *expr);
+  void visit(UnaryExpr *expr);
+
+  // Statement visitor methods
+  void visit(ExprStmt *stmt);
+  void visit(IfStmt *stmt);
+  void visit(PrintStmt *stmt);
+  void visit(ReturnStmt *stmt);
+  void visit(ScanStmt *stmt);
+  void visit(WhileStmt *stmt);
+
+  // Declaration visitor methods
+  void visit(VarDecl *decl);
+
+  void analyzeAll(Nodes &nodes) {
+    for (auto *node : nodes)
+      evaluate(node);
+  }
+
+  // Record an effect of the function being analyzed.
+  void addEffect(FunDecl::MemoryEffect effect) {
+    if (effect > this->effect)
+      this->effect = effect;
+  }
+
+  // Record an access to the memory at the address.
+  void access(Expr *addr, FunDecl::MemoryEffect effect);
+
+  // Analyze the code of the function, and collect the functions it calls.
+  void analyzeFunction(FunDecl *decl);
+
+public:
+  explicit EffectAnalysis(bool boundsCheck = false)
+      : boundsCheck(boundsCheck) {}
+
+  // Runner.
+  void run(ModuleDecl *moduleDecl);
+};
+
+} // namespace mxrlang
+
+#endif // EFFECTANALYSIS_H
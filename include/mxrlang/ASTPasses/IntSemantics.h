@@ -0,0 +1,67 @@
+#ifndef INTSEMANTICS_H
+#define INTSEMANTICS_H
+
+#include "llvm/ADT/APInt.h"
+#include "llvm/IR/ConstantRange.h"
+#include "llvm/IR/InstrTypes.h"
+
+#include "Tree.h"
+
+namespace mxrlang {
+
+// Semantics of the operations on the values of the integer types. The passes
+// which compute the values of expressions (ConstantFolder, ConstEvaluator),
+// their ranges (RangeAnalysis) and their code (CodeGen) all take the
+// operations from here, so that they agree with each other.
+class IntSemantics {
+public:
+  // Why an operation on constants has no value.
+  enum class Error { None, Overflow, DivByZero };
+
+  // Get the instruction which computes the arithmetic operation on the
+  // operands of the integer type.
+  static llvm::Instruction::BinaryOps
+  getOpcode(BinaryArithExpr::BinaryArithExprKind kind, const Type *type);
+
+  // Get the predicate of the comparison of the operands of the type.
+  // Relational operators compare the unsigned integers without the sign.
+  // Returns BAD_ICMP_PREDICATE for AND and OR, which are not comparisons.
+  static llvm::CmpInst::Predicate
+  getPredicate(BinaryLogicalExpr::BinaryLogicalExprKind kind,
+               const Type *type);
+
+  // Get the instruction which converts a value of one integer type to the
+  // other. Conversions truncate or extend the value, according to the sign
+  // of the source type.
+  static llvm::Instruction::CastOps getCastOpcode(const Type *from,
+                                                  const Type *to);
+
+  // Compute the arithmetic operation on constants of the integer type. Fails
+  // if the result overflows the type, or on a division by zero.
+  static Error compute(BinaryArithExpr::BinaryArithExprKind kind,
+                       const Type *type, const llvm::APInt &lhs,
+                       const llvm::APInt &rhs, llvm::APInt &result);
+
+  // Compare the constants of the type.
+  static bool compare(BinaryLogicalExpr::BinaryLogicalExprKind kind,
+                      const Type *type, const llvm::APInt &lhs,
+                      const llvm::APInt &rhs);
+
+  // Negate a constant of the integer type. Fails if the result overflows the
+  // type. A literal written in the source is the magnitude of the negated
+  // value, which may only fit into the type once negated (e.g. the INT8
+  // literal in -128), so negating it does not overflow.
+  static Error negate(const Type *type, const llvm::APInt &value,
+                      bool isMagnitude, llvm::APInt &result);
+
+  // Convert a constant, or the range of the values, of one integer type to
+  // the other.
+  static llvm::APInt convert(const llvm::APInt &value, const Type *from,
+                             const Type *to);
+  static llvm::ConstantRange convert(const llvm::ConstantRange &range,
+                                     const Type *from, const Type *to);
+};
+
+} // namespace mxrlang
+
+#endif // INTSEMANTICS_H
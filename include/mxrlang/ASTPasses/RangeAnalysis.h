@@ -0,0 +1,115 @@
+#ifndef RANGEANALYSIS_H
+#define RANGEANALYSIS_H
+
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/Optional.h"
+#include "llvm/IR/ConstantRange.h"
+
+#include "ASTVisitor.h"
+
+namespace mxrlang {
+
+// Computes the ranges of the values of the integer local variables in the
+// functions of a checked module, and marks the accesses to arrays whose
+// index is proven to be in bounds. The ranges are refined by the conditions
+// of IF and WHILE statements, and the ranges of the variables changed in a
+// loop are widened until they are stable, so that induction variables
+// compared against the array sizes are proven in bounds. Expression visit
+// methods return the range of the value of the expression, or None if
+// nothing is known about it.
+class RangeAnalysis
+    : public ASTVisitor<RangeAnalysis, llvm::Optional<llvm::ConstantRange>> {
+  friend class ASTVisitor<RangeAnalysis, llvm::Optional<llvm::ConstantRange>>;
+  using ASTVisitor<RangeAnalysis, llvm::Optional<llvm::ConstantRange>>::visit;
+
+  using Range = llvm::Optional<llvm::ConstantRange>;
+
+  // Number of times a loop body is analyzed before the changing ranges are
+  // widened.
+  static constexpr unsigned WideningDelay = 2;
+
+  // Ranges of the variables at the current point of the function. Only the
+  // local integer variables which are never accessed through a pointer are
+  // tracked, and the variables missing from the map may hold any value.
+  struct State {
+    llvm::DenseMap<const VarDecl *, llvm::ConstantRange> ranges;
+    // Whether the point can be reached at all.
+    bool reachable = true;
+
+    bool operator==(const State &other) const {
+      return reachable == other.reachable && ranges == other.ranges;
+    }
+  };
+  State state;
+
+  // Whether the array accesses are being marked. Loop bodies are analyzed
+  // until the ranges are stable, and only then marked.
+  bool marking = true;
+
+  // Expression visitor methods
+  Range visit(ArrayAccessExpr *expr);
+  Range visit(ArrayInitExpr *expr);
+  Range visit(AssignExpr *expr);
+  Range visit(BinaryArithExpr *expr);
+  Range visit(BinaryLogicalExpr *expr);
+  Range visit(BoolLiteralExpr *expr) { return llvm::None; }
+  Range visit(CallExpr *expr);
+  Range visit(CastExpr *expr);
+  Range visit(IntLiteralExpr *expr);
+  Range visit(LoadExpr *expr);
+  Range visit(PointerOpExpr *expr);
+  Range visit(UnaryExpr *expr);
+  Range visit(VarExpr *expr) { return llvm::None; }
+
+  // Statement visitor methods
+  void visit(ExprStmt *stmt);
+  void visit(IfStmt *stmt);
+  void visit(PrintStmt *stmt);
+  void visit(ReturnStmt *stmt);
+  void visit(ScanStmt *stmt);
+  void visit(WhileStmt *stmt);
+
+  // Declaration visitor methods
+  void visit(FunDecl *decl);
+  void visit(ModuleDecl *decl);
+  void visit(VarDecl *decl);
+
+  void analyzeAll(Nodes &nodes) {
+    for (auto *node : nodes)
+      evaluate(node);
+  }
+
+  // Check whether the ranges of the variable are tracked.
+  static bool isTracked(const VarDecl *decl);
+
+  // Get the tracked variable which the expression loads, or null.
+  static const VarDecl *getLoadedVar(Expr *expr);
+
+  // Get the range of the value of an integer or BOOL expression.
+  llvm::ConstantRange getRange(Expr *expr);
+
+  // Get the range of the value of the expression in the current state,
+  // without changing the state or marking the accesses.
+  llvm::ConstantRange peekRange(Expr *expr);
+
+  // Record the range of a tracked variable.
+  void setRange(const VarDecl *decl, const llvm::ConstantRange &range);
+
+  // Narrow the ranges of the variables, given the value of the condition.
+  void refine(Expr *cond, bool value);
+
+  // Merge the state of another path into the current state.
+  void join(const State &other);
+
+  // Widen the ranges of the current state which grew since the previous
+  // state, to the limits of their types.
+  void widen(const State &prev);
+
+public:
+  // Runner.
+  void run(ModuleDecl *moduleDecl) { evaluate(moduleDecl); }
+};
+
+} // namespace mxrlang
+
+#endif // RANGEANALYSIS_H
@@ -1,8 +1,6 @@
 #ifndef SCOPEMGR_H
 #define SCOPEMGR_H
 
-#include <memory>
-
 #include "Environment.h"
 
 namespace mxrlang {
@@ -12,16 +10,11 @@ namespace mxrlang {
 template <typename PassTy, typename T> class ScopeMgr {
   // AST pass which needs environment management.
   PassTy &pass;
-  // Environment being managed.
-  std::shared_ptr<Environment<T>> env;
 
 public:
-  ScopeMgr(PassTy &pass) : pass(pass) {
-    env = std::make_shared<Environment<T>>(pass.env);
-    pass.env = env.get();
-  }
+  ScopeMgr(PassTy &pass) : pass(pass) { pass.env.pushScope(); }
 
-  ~ScopeMgr() { pass.env = pass.env->getParent(); }
+  ~ScopeMgr() { pass.env.popScope(); }
 };
 
 } // namespace mxrlang
@@ -1,6 +1,15 @@
 #ifndef SEMACHECK_H
 #define SEMACHECK_H
 
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/DenseMap.h"
+#include <atomic>
+#include <utility>
+#include <vector>
+
+#include "ASTContext.h"
+#include "ASTVisitor.h"
+#include "ConstEvaluator.h"
 #include "Diag.h"
 #include "ScopeMgr.h"
 
@@ -8,70 +17,173 @@
 
 namespace mxrlang {
 
-class SemaCheck : public Visitor {
+class SemaCheck : public ASTVisitor<SemaCheck> {
+  friend class ASTVisitor<SemaCheck>;
+  using ASTVisitor<SemaCheck>::visit;
   friend class ScopeMgr<SemaCheck, Decl>;
   using SemaCheckScopeMgr = ScopeMgr<SemaCheck, Decl>;
 
-  // Custom semantic check exception class.
-  class SemaError : public std::exception {};
-
-  Environment<Decl> *env = nullptr;
+  Environment<Decl> env;
 
   Diag &diag;
 
+  // Context which owns the nodes and types created during the check.
+  ASTContext &ctx;
+
+  // In parallel mode, the check which spawned this one to check a range of
+  // the module on a worker thread. Its environment holds the module scope,
+  // and it hands out the declaration indices.
+  SemaCheck *parent = nullptr;
+
+  // Steps left to the compile-time evaluations of array sizes and global
+  // initializers in the module. A worker starts with the steps left to its
+  // parent, and its parent takes out those which the worker used.
+  StepBudget steps;
+
+  // Globals which a worker found to be escaping. The workers don't write to
+  // the shared declarations, so the parent marks these once it accepts the
+  // results of the worker.
+  std::vector<VarDecl *> escapingGlobals;
+
   // Flags whether we've seen a return statement in a function.
   bool seenReturn = false;
 
   // Currently checked function.
   FunDecl *currFun = nullptr;
 
+  // Top-level declarations which are checked while the module is declared,
+  // because array sizes are computed from them: globals whose array sizes are
+  // computed, and the functions which these (and the sizes of local arrays)
+  // call. Only the check which declares the module writes to this.
+  enum class UpFrontState { Checking, Checked, Failed };
+  llvm::DenseMap<Decl *, UpFrontState> upFront;
+
+  // Number of declarations in the module checked so far.
+  std::atomic<uint32_t> numDecls{0};
+
+  // Integer literals too large for INT, and whether each one is negated.
+  // Whether a literal fits is only known once its context gave it a type.
+  llvm::SmallVector<std::pair<IntLiteralExpr *, bool>, 4> largeLiterals;
+
+  // Set once we exceed the maximum number of reported errors. The traversal
+  // then stops at the next statement or declaration.
+  bool aborted = false;
+
   // Expression visitor methods
-  void visit(ArrayAccessExpr *expr) override;
-  void visit(ArrayInitExpr *expr) override;
-  void visit(AssignExpr *expr) override;
-  void visit(BinaryArithExpr *expr) override;
-  void visit(BinaryLogicalExpr *expr) override;
-  void visit(CallExpr *expr) override;
-  void visit(LoadExpr *expr) override;
-  void visit(PointerOpExpr *expr) override;
-  void visit(UnaryExpr *expr) override;
-  void visit(VarExpr *expr) override;
+  void visit(ArrayAccessExpr *expr);
+  void visit(ArrayInitExpr *expr);
+  void visit(AssignExpr *expr);
+  void visit(BinaryArithExpr *expr);
+  void visit(BinaryLogicalExpr *expr);
+  void visit(CallExpr *expr);
+  void visit(CastExpr *expr);
+  void visit(IntLiteralExpr *expr);
+  void visit(LoadExpr *expr);
+  void visit(PointerOpExpr *expr);
+  void visit(UnaryExpr *expr);
+  void visit(VarExpr *expr);
 
   // Statement visitor methods
-  void visit(ExprStmt *stmt) override;
-  void visit(IfStmt *stmt) override;
-  void visit(PrintStmt *stmt) override;
-  void visit(ReturnStmt *stmt) override;
-  void visit(ScanStmt *stmt) override;
-  void visit(WhileStmt *stmt) override;
-
-  void visit(FunDecl *decl) override;
-  void visit(ModuleDecl *decl) override;
-  void visit(VarDecl *decl) override;
-
-  // Report an error and throw an exception if we exceed a certain number
+  void visit(ExprStmt *stmt);
+  void visit(IfStmt *stmt);
+  void visit(PrintStmt *stmt);
+  void visit(ReturnStmt *stmt);
+  void visit(ScanStmt *stmt);
+  void visit(WhileStmt *stmt);
+
+  void visit(FunDecl *decl);
+  void visit(ModuleDecl *decl);
+  void visit(VarDecl *decl);
+
+  // Clear the type of an expression before checking it. A module may be
+  // checked again after it is incrementally reparsed, and an expression which
+  // fails the check must not keep the type from the previous check.
+  static void resetType(Expr *expr) { expr->setType(Type::getNoneType()); }
+
+  // Report an error and abort the check if we exceed a certain number
   // of reported errors.
-  void error(llvm::SMLoc loc, DiagID diagID);
+  template <typename... Args>
+  void error(SourceLoc loc, DiagID diagID, Args &&...diagArgs) {
+    // Errors found while unwinding an aborted check are not reported.
+    if (aborted)
+      return;
+
+    diag.report(loc, diagID, std::forward<Args>(diagArgs)...);
+    if (diag.getNumErrs() > MAX_SEMANTIC_ERRS)
+      aborted = true;
+  }
+
+  // The check which declares the module.
+  SemaCheck &getRoot() { return parent ? *parent : *this; }
+
+  // Give the declaration the next free index within the module.
+  void assignIndex(Decl *decl) { decl->setIndex(getRoot().numDecls++); }
+
+  // Number the top-level declarations of the module, and forward declare
+  // them in the current scope. Array sizes of globals are computed here.
+  void declareModule(ModuleDecl *decl);
+
+  // Check the functions with the given names up front, along with the
+  // functions which they call.
+  void checkUpFront(llvm::ArrayRef<IdentifierInfo *> names);
+
+  // Check whether a function was checked up front without errors, so that it
+  // can be evaluated at compile time.
+  bool isCheckedUpFront(FunDecl *decl) {
+    auto found = getRoot().upFront.find(decl);
+    return found != getRoot().upFront.end() &&
+           found->second == UpFrontState::Checked;
+  }
+
+  // Compute the array sizes of the variable, and set its type.
+  void resolveArrayType(VarDecl *decl);
+
+  // Evaluate the initializers of the globals into literals, once the whole
+  // module is checked.
+  void evaluateGlobals(ModuleDecl *decl);
+
+  // Evaluate a checked initializer of a global into literals. Returns null
+  // after reporting an error.
+  Expr *evaluateInit(Expr *init);
+
+  // Tell the user that the check was aborted.
+  void reportAbort();
 
   // Check whether an expression is a valid assignment destination.
   // This is a recursive function, so we can access the expression through
   // ArrayAccess of PointerOp(Deref).
   bool isValidAssignDest(Expr *expr, bool arrayAccessOrDeref);
 
-  // Lower the array initialization list into a list of assignments to
-  // individual array elements.
-  void lowerArrayInit(Type *ty, ArrayInitExpr *init,
-                      std::vector<uint64_t> indices, Exprs &exprs,
-                      VarDecl *array);
+  // Give an integer literal (possibly negated) the integer type which its
+  // context expects, if the literal fits into it. Literals in initialization
+  // lists are converted to the element type.
+  void convertLiteral(Expr *expr, Type *type);
+
+  // Report the large integer literals which don't fit into their types.
+  void checkLargeLiterals();
 
-  // Helper function for evaluating an expression or a statement.
-  template <typename T> void evaluate(const T expr) { expr->accept(this); }
+  // Mark the variable accessed by the expression as escaping, i.e. accessed
+  // through a pointer.
+  void markEscaping(Expr *expr);
+
+  // Create a check of a range of the module, run on a worker thread.
+  SemaCheck(SemaCheck &parent, Diag &diag, ASTContext &ctx)
+      : env(&parent.env), diag(diag), ctx(ctx), parent(&parent),
+        steps(parent.steps) {}
 
 public:
-  SemaCheck(Diag &diag) : diag(diag) {}
+  SemaCheck(Diag &diag, ASTContext &ctx,
+            uint64_t maxEvalSteps = StepBudget::DefaultMax)
+      : diag(diag), ctx(ctx), steps(maxEvalSteps) {}
 
   // Runner.
   void run(ModuleDecl *moduleDecl) { evaluate(moduleDecl); }
+
+  // Check the module on multiple threads. Once the top-level declarations
+  // are forward declared, the module is split into ranges of them, which are
+  // checked concurrently, each into its own context and diagnostics engine.
+  // The diagnostics end up the same as with run().
+  void runParallel(ModuleDecl *moduleDecl, unsigned numThreads);
 };
 
 } // namespace mxrlang
@@ -0,0 +1,125 @@
+#ifndef ASTCONTEXT_H
+#define ASTCONTEXT_H
+
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/Allocator.h"
+#include "llvm/Support/TypeName.h"
+#include "llvm/Support/raw_ostream.h"
+#include <cstdint>
+#include <memory>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "IdentifierTable.h"
+#include "SourceLoc.h"
+#include "TypeContext.h"
+
+namespace mxrlang {
+
+// Owner of all AST nodes, identifiers and types of a module. Objects are placed
+// in a bump pointer arena, and are all freed at once when the context is
+// destroyed.
+class ASTContext {
+  llvm::BumpPtrAllocator allocator;
+
+  // Interned identifiers of the module, shared with the lexer and with the
+  // child contexts.
+  std::shared_ptr<IdentifierTable> identifiers;
+
+  // Uniqued types of the module, shared with the child contexts.
+  std::shared_ptr<TypeContext> types;
+
+  // Source code of the module.
+  llvm::StringRef buffer;
+
+  // Objects which own memory outside of the arena (e.g. node lists), paired
+  // with the function which destroys them.
+  std::vector<std::pair<void (*)(void *), void *>> destructors;
+
+  // Contexts which live as long as this one, and whose objects are a part of
+  // the same module.
+  std::vector<std::unique_ptr<ASTContext>> children;
+
+  // Number of objects created in this context.
+  uint64_t numAllocs = 0;
+  // Number of objects created in this context, per object class.
+  std::vector<uint64_t> numAllocsPerClass;
+
+  template <typename T> static void destroy(void *obj) {
+    static_cast<T *>(obj)->~T();
+  }
+
+  // Register an object class for the statistics, and return its index.
+  static uint32_t registerClass(llvm::StringRef name, size_t size);
+
+  template <typename T> static uint32_t getClassIndex() {
+    static const uint32_t index =
+        registerClass(llvm::getTypeName<T>(), sizeof(T));
+    return index;
+  }
+
+public:
+  explicit ASTContext(llvm::StringRef buffer,
+                      std::shared_ptr<IdentifierTable> identifiers = nullptr,
+                      std::shared_ptr<TypeContext> types = nullptr)
+      : identifiers(identifiers ? std::move(identifiers)
+                                : std::make_shared<IdentifierTable>()),
+        types(types ? std::move(types) : std::make_shared<TypeContext>()),
+        buffer(buffer) {}
+  ASTContext(const ASTContext &) = delete;
+  ASTContext &operator=(const ASTContext &) = delete;
+
+  ~ASTContext() {
+    for (auto it = destructors.rbegin(); it != destructors.rend(); ++it)
+      it->first(it->second);
+  }
+
+  // Create an AST node or a type in the arena.
+  template <typename T, typename... Args> T *create(Args &&...args) {
+    void *mem = allocator.Allocate(sizeof(T), alignof(T));
+    T *obj = new (mem) T(std::forward<Args>(args)...);
+    if (!std::is_trivially_destructible<T>::value)
+      destructors.emplace_back(&destroy<T>, obj);
+
+    ++numAllocs;
+    auto index = getClassIndex<T>();
+    if (index >= numAllocsPerClass.size())
+      numAllocsPerClass.resize(index + 1);
+    ++numAllocsPerClass[index];
+
+    return obj;
+  }
+
+  // Create a context for the objects of the same module which are created on
+  // another thread. It is destroyed together with this one.
+  ASTContext &createChild() {
+    children.push_back(
+        std::make_unique<ASTContext>(buffer, identifiers, types));
+    return *children.back();
+  }
+
+  IdentifierTable &getIdentifierTable() { return *identifiers; }
+  TypeContext &getTypeContext() { return *types; }
+
+  // Convert a location in the source code into its compact form.
+  SourceLoc getSourceLoc(llvm::SMLoc loc) const {
+    return SourceLoc::get(loc, buffer.begin());
+  }
+
+  llvm::StringRef getBuffer() const { return buffer; }
+
+  // Replace the source code of the module with its edited revision.
+  void setBuffer(llvm::StringRef buffer) { this->buffer = buffer; }
+
+  // Number of objects and bytes allocated in this context and its children.
+  uint64_t getNumAllocs() const;
+  size_t getBytesAllocated() const;
+
+  // Print the memory usage statistics.
+  void printStats(llvm::raw_ostream &out) const;
+};
+
+} // namespace mxrlang
+
+#endif // ASTCONTEXT_H
@@ -0,0 +1,281 @@
+#ifndef ASTVISITOR_H
+#define ASTVISITOR_H
+
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/Support/ErrorHandling.h"
+
+#include "Tree.h"
+
+namespace mxrlang {
+
+namespace detail {
+// Result of an evaluated operand. Specialized for visitors whose expression
+// visit methods return nothing.
+template <typename T> struct OperandResult {
+  T value{};
+
+  template <typename Fn> void set(Fn fn) { value = fn(); }
+  T get() const { return value; }
+};
+
+template <> struct OperandResult<void> {
+  template <typename Fn> void set(Fn fn) { fn(); }
+  void get() const {}
+};
+} // namespace detail
+
+// Inherit from ASTVisitor in order to create an AST traversal class. The
+// visitor is statically dispatched: evaluate() switches on the kind stored in
+// the node and calls the visit() overload of the derived class, so the calls
+// can be inlined. Expression visit methods return ExprRetTy, which lets the
+// passes hand the intermediate results directly to their callers.
+//
+// Chains of operator expressions can be arbitrarily deep. These are the
+// binary and unary operators and the conversions, whose operands are their
+// subexpressions, the calls, whose operands are their arguments, and the
+// loads of array elements, whose operands are the indices of the accessed
+// element. Expressions are evaluated recursively up to
+// MaxRecursionDepth, and deeper operator chains are walked with an explicit
+// stack, which evaluates the operands of an operator before visiting the
+// operator itself. When the visit method of the operator then evaluates its
+// operands, it gets the stored results. The visit methods of operator
+// expressions must therefore evaluate their operands first, and must not
+// replace them. A derived class which cannot follow this (e.g. one which does
+// something before evaluating the operands) should define
+// `static constexpr bool EvaluateOperandsFirst = false;`.
+//
+// The derived class should bring the default visit methods into scope with
+// `using ASTVisitor::visit;`, and befriend ASTVisitor if its visit methods are
+// private.
+template <typename Derived, typename ExprRetTy = void> class ASTVisitor {
+  // An operator expression in the explicit-stack walk, with its operands.
+  struct OperatorFrame {
+    Expr *expr;
+    llvm::SmallVector<Expr *, 2> operands;
+    // Results of the operands evaluated so far.
+    llvm::SmallVector<detail::OperandResult<ExprRetTy>, 2> results;
+    // Whether the operands are evaluated and the expression is being visited.
+    bool visiting = false;
+  };
+
+  llvm::SmallVector<OperatorFrame, 16> operatorStack;
+
+  // Number of expressions currently being evaluated recursively.
+  unsigned depth = 0;
+
+  struct DepthGuard {
+    unsigned &depth;
+    explicit DepthGuard(unsigned &depth) : depth(depth) { ++depth; }
+    ~DepthGuard() { --depth; }
+  };
+
+  Derived &derived() { return *static_cast<Derived *>(this); }
+
+  static bool isOperator(Expr *expr) {
+    switch (expr->getKind()) {
+    case Expr::ExprKind::BinaryArith:
+    case Expr::ExprKind::BinaryLogical:
+    case Expr::ExprKind::Call:
+    case Expr::ExprKind::Cast:
+    case Expr::ExprKind::Unary:
+      return true;
+    case Expr::ExprKind::Load:
+      return llvm::isa<ArrayAccessExpr>(llvm::cast<LoadExpr>(expr)->getExpr());
+    default:
+      return false;
+    }
+  }
+
+  void pushOperator(Expr *expr) {
+    OperatorFrame frame;
+    frame.expr = expr;
+    if (auto *binExpr = llvm::dyn_cast<BinaryArithExpr>(expr)) {
+      frame.operands = {binExpr->getLeft(), binExpr->getRight()};
+    } else if (auto *binExpr = llvm::dyn_cast<BinaryLogicalExpr>(expr)) {
+      frame.operands = {binExpr->getLeft(), binExpr->getRight()};
+    } else if (auto *callExpr = llvm::dyn_cast<CallExpr>(expr)) {
+      frame.operands.append(callExpr->getArgs().begin(),
+                            callExpr->getArgs().end());
+    } else if (auto *castExpr = llvm::dyn_cast<CastExpr>(expr)) {
+      frame.operands = {castExpr->getExpr()};
+    } else if (auto *loadExpr = llvm::dyn_cast<LoadExpr>(expr)) {
+      // Indices of the innermost array come first, as they are evaluated
+      // first.
+      for (auto *access = llvm::cast<ArrayAccessExpr>(loadExpr->getExpr());
+           access; access = llvm::dyn_cast<ArrayAccessExpr>(access->getArray()))
+        frame.operands.insert(frame.operands.begin(), access->getElement());
+    } else {
+      frame.operands = {llvm::cast<UnaryExpr>(expr)->getExpr()};
+    }
+    operatorStack.push_back(std::move(frame));
+  }
+
+  // Evaluate a chain of operator expressions rooted at expr, with an explicit
+  // stack.
+  ExprRetTy walkOperators(Expr *expr) {
+    auto base = operatorStack.size();
+    pushOperator(expr);
+
+    while (true) {
+      // Evaluating an operand may walk another chain (e.g. one inside a call
+      // argument) and reallocate the stack, so the frame is always indexed.
+      auto idx = operatorStack.size() - 1;
+      auto next = operatorStack[idx].results.size();
+      if (next < operatorStack[idx].operands.size()) {
+        Expr *operand = operatorStack[idx].operands[next];
+        if (isOperator(operand)) {
+          pushOperator(operand);
+          continue;
+        }
+
+        detail::OperandResult<ExprRetTy> result;
+        result.set([&] { return dispatch(operand); });
+        operatorStack[idx].results.push_back(result);
+        continue;
+      }
+
+      operatorStack[idx].visiting = true;
+      detail::OperandResult<ExprRetTy> result;
+      result.set([&] { return dispatch(operatorStack[idx].expr); });
+      operatorStack.pop_back();
+
+      if (operatorStack.size() == base)
+        return result.get();
+      operatorStack.back().results.push_back(result);
+    }
+  }
+
+  ExprRetTy dispatch(Expr *expr) {
+    switch (expr->getKind()) {
+    case Expr::ExprKind::ArrayAccess:
+      return derived().visit(llvm::cast<ArrayAccessExpr>(expr));
+    case Expr::ExprKind::ArrayInit:
+      return derived().visit(llvm::cast<ArrayInitExpr>(expr));
+    case Expr::ExprKind::Assign:
+      return derived().visit(llvm::cast<AssignExpr>(expr));
+    case Expr::ExprKind::BinaryArith:
+      return derived().visit(llvm::cast<BinaryArithExpr>(expr));
+    case Expr::ExprKind::BinaryLogical:
+      return derived().visit(llvm::cast<BinaryLogicalExpr>(expr));
+    case Expr::ExprKind::BoolLiteral:
+      return derived().visit(llvm::cast<BoolLiteralExpr>(expr));
+    case Expr::ExprKind::Call:
+      return derived().visit(llvm::cast<CallExpr>(expr));
+    case Expr::ExprKind::Cast:
+      return derived().visit(llvm::cast<CastExpr>(expr));
+    case Expr::ExprKind::IntLiteral:
+      return derived().visit(llvm::cast<IntLiteralExpr>(expr));
+    case Expr::ExprKind::Load:
+      return derived().visit(llvm::cast<LoadExpr>(expr));
+    case Expr::ExprKind::PointerOp:
+      return derived().visit(llvm::cast<PointerOpExpr>(expr));
+    case Expr::ExprKind::Unary:
+      return derived().visit(llvm::cast<UnaryExpr>(expr));
+    case Expr::ExprKind::Var:
+      return derived().visit(llvm::cast<VarExpr>(expr));
+    }
+    llvm_unreachable("Unknown expression kind.");
+  }
+
+public:
+  // Depth of expression evaluation beyond which the operator chains are
+  // walked with an explicit stack.
+  static constexpr unsigned MaxRecursionDepth = 512;
+
+  // By default, deep operator chains are walked with an explicit stack.
+  static constexpr bool EvaluateOperandsFirst = true;
+
+  ExprRetTy evaluate(Expr *expr) {
+    if (Derived::EvaluateOperandsFirst) {
+      // Operands of the operator being visited have already been evaluated.
+      if (!operatorStack.empty() && operatorStack.back().visiting) {
+        auto &frame = operatorStack.back();
+        for (unsigned i = 0; i < frame.operands.size(); ++i)
+          if (frame.operands[i] == expr)
+            return frame.results[i].get();
+      }
+
+      if (depth >= MaxRecursionDepth && isOperator(expr))
+        return walkOperators(expr);
+    }
+
+    DepthGuard guard(depth);
+    return dispatch(expr);
+  }
+
+  void evaluate(Stmt *stmt) {
+    switch (stmt->getKind()) {
+    case Stmt::StmtKind::Expr:
+      return derived().visit(llvm::cast<ExprStmt>(stmt));
+    case Stmt::StmtKind::If:
+      return derived().visit(llvm::cast<IfStmt>(stmt));
+    case Stmt::StmtKind::Print:
+      return derived().visit(llvm::cast<PrintStmt>(stmt));
+    case Stmt::StmtKind::Return:
+      return derived().visit(llvm::cast<ReturnStmt>(stmt));
+    case Stmt::StmtKind::Scan:
+      return derived().visit(llvm::cast<ScanStmt>(stmt));
+    case Stmt::StmtKind::While:
+      return derived().visit(llvm::cast<WhileStmt>(stmt));
+    default:
+      llvm_unreachable("Unknown statement kind.");
+    }
+  }
+
+  void evaluate(Decl *decl) {
+    switch (decl->getKind()) {
+    case Decl::DeclKind::Fun:
+      return derived().visit(llvm::cast<FunDecl>(decl));
+    case Decl::DeclKind::Module:
+      return derived().visit(llvm::cast<ModuleDecl>(decl));
+    case Decl::DeclKind::Var:
+      return derived().visit(llvm::cast<VarDecl>(decl));
+    }
+    llvm_unreachable("Unknown declaration kind.");
+  }
+
+  // Evaluate a member of a statement list, which is either a statement or
+  // a declaration.
+  void evaluate(Node *node) {
+    switch (node->getKind()) {
+    case Node::NodeKind::Decl:
+      return evaluate(llvm::cast<Decl>(node));
+    case Node::NodeKind::Expr:
+      evaluate(llvm::cast<Expr>(node));
+      return;
+    case Node::NodeKind::Stmt:
+      return evaluate(llvm::cast<Stmt>(node));
+    }
+    llvm_unreachable("Unknown node kind.");
+  }
+
+  // Default visit methods, which do nothing.
+  ExprRetTy visit(ArrayAccessExpr *expr) { return ExprRetTy(); }
+  ExprRetTy visit(ArrayInitExpr *expr) { return ExprRetTy(); }
+  ExprRetTy visit(AssignExpr *expr) { return ExprRetTy(); }
+  ExprRetTy visit(BinaryArithExpr *expr) { return ExprRetTy(); }
+  ExprRetTy visit(BinaryLogicalExpr *expr) { return ExprRetTy(); }
+  ExprRetTy visit(BoolLiteralExpr *expr) { return ExprRetTy(); }
+  ExprRetTy visit(CallExpr *expr) { return ExprRetTy(); }
+  ExprRetTy visit(CastExpr *expr) { return ExprRetTy(); }
+  ExprRetTy visit(IntLiteralExpr *expr) { return ExprRetTy(); }
+  ExprRetTy visit(LoadExpr *expr) { return ExprRetTy(); }
+  ExprRetTy visit(PointerOpExpr *expr) { return ExprRetTy(); }
+  ExprRetTy visit(UnaryExpr *expr) { return ExprRetTy(); }
+  ExprRetTy visit(VarExpr *expr) { return ExprRetTy(); }
+
+  void visit(ExprStmt *stmt) {}
+  void visit(IfStmt *stmt) {}
+  void visit(PrintStmt *stmt) {}
+  void visit(ReturnStmt *stmt) {}
+  void visit(ScanStmt *stmt) {}
+  void visit(WhileStmt *stmt) {}
+
+  void visit(FunDecl *decl) {}
+  void visit(ModuleDecl *decl) {}
+  void visit(VarDecl *decl) {}
+};
+
+} // namespace mxrlang
+
+#endif // ASTVISITOR_H
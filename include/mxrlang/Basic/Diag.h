@@ -1,46 +1,124 @@
 #ifndef DIAG_H
 #define DIAG_H
 
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/SmallVector.h"
 #include "llvm/ADT/StringRef.h"
-#include "llvm/Support/FormatVariadic.h"
 #include "llvm/Support/SMLoc.h"
 #include "llvm/Support/SourceMgr.h"
 #include "llvm/Support/raw_ostream.h"
+#include <atomic>
 #include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "SourceLoc.h"
 
 namespace mxrlang {
 
-enum class DiagID {
+enum class DiagID : uint16_t {
 #define DIAG(ID, Level, Msg) ID,
 #include "Diag.def"
 };
 
+// Format in which the diagnostics are rendered.
+enum class DiagFormat : uint8_t {
+  Text, // Human readable, with source line and caret.
+  JSON  // One JSON object per line.
+};
+
+// Diagnostics engine. Reported diagnostics are recorded and rendered in a
+// batch, sorted by their location, when the engine is flushed (typically at
+// the end of each compilation phase). Repeated diagnostics are dropped.
+// Reporting is thread safe.
 class Diag {
+  // A reported diagnostic. Textual arguments are kept in a shared pool.
+  struct StoredDiag {
+    llvm::SMLoc loc;
+    DiagID id;
+    uint32_t firstArg;
+    uint32_t numArgs;
+  };
+
   // Returns the error text based on the error ID.
   static const char *getDiagText(DiagID diagType);
   // Returns the error kind based on the error ID.
   static llvm::SourceMgr::DiagKind getDiagKind(DiagID diagID);
+  // Returns the name of the error ID.
+  static const char *getDiagName(DiagID diagID);
 
   llvm::SourceMgr &srcMgr;
+  DiagFormat format;
+  llvm::raw_ostream &os;
+
+  // All diagnostics reported so far, and their arguments.
+  std::vector<StoredDiag> diags;
+  std::vector<std::string> args;
+  // Index of the first diagnostic which hasn't been rendered yet.
+  uint32_t firstPending = 0;
+
+  // Diagnostics reported at a given location. Used for deduplication.
+  llvm::DenseMap<const char *, llvm::SmallVector<uint32_t, 1>> diagsAtLoc;
 
   // Total number of seen errors.
-  uint32_t numErrs;
+  std::atomic<uint32_t> numErrs;
+
+  std::mutex mutex;
+
+  // Record a diagnostic whose arguments are the last numArgs entries of the
+  // argument pool. Returns false if it is a duplicate.
+  bool record(llvm::SMLoc loc, DiagID diagID, uint32_t numArgs);
+
+  // Substitute the {N} placeholders in the error text with the arguments.
+  std::string formatMessage(const StoredDiag &stored) const;
+
+  void renderText(llvm::raw_ostream &out, const StoredDiag &stored);
+  void renderJSON(llvm::raw_ostream &out, const StoredDiag &stored);
 
 public:
-  Diag(llvm::SourceMgr &srcMgr) : srcMgr(srcMgr), numErrs(0) {}
+  Diag(llvm::SourceMgr &srcMgr, DiagFormat format = DiagFormat::Text,
+       llvm::raw_ostream &os = llvm::errs())
+      : srcMgr(srcMgr), format(format), os(os), numErrs(0) {}
+
+  ~Diag() { flush(); }
 
   // Report an error. Provide the LoC where it happened, its ID, and additional
   // textual parameters where needed.
   template <typename... Args>
-  void report(llvm::SMLoc loc, DiagID diagID, Args &&...args) {
-    auto msg =
-        llvm::formatv(getDiagText(diagID), std::forward<Args>(args)...).str();
-    auto kind = getDiagKind(diagID);
-    srcMgr.PrintMessage(loc, kind, msg);
-    numErrs += (kind == llvm::SourceMgr::DK_Error);
+  void report(llvm::SMLoc loc, DiagID diagID, Args &&...diagArgs) {
+    std::lock_guard<std::mutex> lock(mutex);
+    // Expand the pack in order, pushing each argument into the pool.
+    int expand[] = {0, (args.emplace_back(std::forward<Args>(diagArgs)), 0)...};
+    (void)expand;
+    if (record(loc, diagID, sizeof...(Args)) &&
+        getDiagKind(diagID) == llvm::SourceMgr::DK_Error)
+      ++numErrs;
+  }
+
+  // Report an error at a location given as an offset into the main buffer.
+  template <typename... Args>
+  void report(SourceLoc loc, DiagID diagID, Args &&...diagArgs) {
+    auto *bufferStart =
+        srcMgr.getMemoryBuffer(srcMgr.getMainFileID())->getBufferStart();
+    report(loc.toSMLoc(bufferStart), diagID, std::forward<Args>(diagArgs)...);
   }
 
+  // Render all diagnostics reported since the last flush.
+  void flush();
+
+  // Drop the pending diagnostics without rendering them.
+  void discard() {
+    std::lock_guard<std::mutex> lock(mutex);
+    firstPending = static_cast<uint32_t>(diags.size());
+  }
+
+  // Move the pending diagnostics of another engine into this one. Used to
+  // collect the diagnostics of worker threads in a deterministic order.
+  void merge(Diag &other);
+
   uint32_t getNumErrs() { return numErrs; }
+  llvm::SourceMgr &getSourceMgr() { return srcMgr; }
 };
 
 } // namespace mxrlang
@@ -1,46 +1,82 @@
 #ifndef ENVIRONMENT_H
 #define ENVIRONMENT_H
 
-#include "llvm/ADT/StringMap.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/SmallVector.h"
 
+#include "IdentifierTable.h"
 #include "Tree.h"
 
 namespace mxrlang {
 
-// Models the scope.
+// Models the nested scopes. All scopes share a single table, which maps each
+// name to its innermost visible value. A value which shadows another one is
+// recorded in an undo log, and the shadowed value is restored when its scope
+// is left. Lookups thus take constant time regardless of the nesting depth,
+// and entering or leaving a scope allocates nothing once the table and the
+// log have grown. Names are interned identifiers, so the table hashes the
+// pointers rather than the spellings.
+//
+// An environment may have an enclosing one, which is only read, and which
+// provides the names not bound in this environment. This lets several
+// threads share the module scope while each of them owns its local scopes.
 template <typename T> class Environment {
-  llvm::StringMap<T *> values;
+  // Value bound to a name, and the depth of the scope which bound it.
+  struct Binding {
+    T *value = nullptr;
+    unsigned depth = 0;
+  };
 
-  // Parent scope in the scope chain.
-  Environment *parent = nullptr;
+  // Binding which was replaced in the table, and has to be restored when
+  // the scope of the replacing binding is left.
+  struct Shadowed {
+    const IdentifierInfo *name;
+    Binding binding;
+  };
+
+  llvm::DenseMap<const IdentifierInfo *, Binding> table;
+  llvm::SmallVector<Shadowed, 32> undoLog;
+
+  // Size of the undo log at the entry to each of the open scopes.
+  llvm::SmallVector<size_t, 16> scopes;
+
+  const Environment *enclosing;
 
 public:
-  Environment(Environment *parent) : parent(parent) {}
+  explicit Environment(const Environment *enclosing = nullptr)
+      : enclosing(enclosing) {}
+
+  // Open a new innermost scope.
+  void pushScope() { scopes.push_back(undoLog.size()); }
+
+  // Close the innermost scope, and restore the values its names shadowed.
+  void popScope() {
+    assert(!scopes.empty() && "No scope to close.");
+    for (auto mark = scopes.pop_back_val(); undoLog.size() > mark;) {
+      auto shadowed = undoLog.pop_back_val();
+      table[shadowed.name] = shadowed.binding;
+    }
+  }
 
   // Insert a value in the current scope.
-  bool insert(T *value, llvm::StringRef name) {
-    auto v = values.find(name);
-    if (v != values.end())
+  bool insert(T *value, const IdentifierInfo *name) {
+    auto &binding = table[name];
+    if (binding.value && binding.depth == scopes.size())
       return false;
 
-    values[name] = value;
+    undoLog.push_back({name, binding});
+    binding = {value, static_cast<unsigned>(scopes.size())};
     return true;
   }
 
-  // Find the value in the current scope. If it doesn't exist,
-  // search the parent scopes.
-  T *find(llvm::StringRef name) {
-    auto v = values.find(name);
-    if (v != values.end())
-      return v->second;
+  // Find the value in the innermost scope which declares the name.
+  T *find(const IdentifierInfo *name) const {
+    auto v = table.find(name);
+    if (v != table.end() && v->second.value)
+      return v->second.value;
 
-    if (!parent)
-      return nullptr;
-
-    return parent->find(name);
+    return enclosing ? enclosing->find(name) : nullptr;
   }
-
-  Environment *getParent() { return parent; }
 };
 
 } // namespace mxrlang
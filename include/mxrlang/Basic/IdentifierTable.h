@@ -0,0 +1,59 @@
+#ifndef IDENTIFIERTABLE_H
+#define IDENTIFIERTABLE_H
+
+#include "llvm/ADT/CachedHashString.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/Allocator.h"
+#include <cstdint>
+#include <mutex>
+
+namespace mxrlang {
+
+// Spelling of an identifier, shared by all of its occurrences. Identifiers are
+// interned by the lexer, so two names are equal exactly when they are the same
+// IdentifierInfo, and passes can key their tables on the pointer instead of
+// hashing the spelling again.
+class IdentifierInfo {
+  friend class IdentifierTable;
+
+  const char *spelling;
+  uint32_t length;
+
+  IdentifierInfo(llvm::StringRef name)
+      : spelling(name.data()), length(static_cast<uint32_t>(name.size())) {}
+
+public:
+  llvm::StringRef getName() const { return llvm::StringRef(spelling, length); }
+};
+
+// Owner of the identifiers of a module. Spellings are copied into the table,
+// so the identifiers outlive the buffers they were lexed from. The table is
+// split into shards by the hash of the spelling, each with its own lock, so
+// that the lexers of different chunks rarely wait for each other.
+class IdentifierTable {
+  static constexpr unsigned NumShardBits = 4;
+
+  struct Shard {
+    llvm::BumpPtrAllocator allocator;
+    llvm::DenseMap<llvm::CachedHashStringRef, IdentifierInfo *> identifiers;
+    std::mutex mutex;
+  };
+
+  Shard shards[1 << NumShardBits];
+
+public:
+  IdentifierTable() = default;
+  IdentifierTable(const IdentifierTable &) = delete;
+  IdentifierTable &operator=(const IdentifierTable &) = delete;
+
+  // Get the identifier with the given spelling, creating it on first use.
+  IdentifierInfo *get(llvm::StringRef name);
+
+  // Number of distinct identifiers in the table.
+  size_t getNumIdentifiers();
+};
+
+} // namespace mxrlang
+
+#endif // IDENTIFIERTABLE_H
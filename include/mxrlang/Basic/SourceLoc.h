@@ -0,0 +1,34 @@
+#ifndef SOURCELOC_H
+#define SOURCELOC_H
+
+#include "llvm/Support/SMLoc.h"
+#include <cassert>
+#include <cstdint>
+
+namespace mxrlang {
+
+// Compact location in the source code, kept as a 32-bit offset into the
+// buffer of the module. Converted to SMLoc when it needs to be reported.
+class SourceLoc {
+  uint32_t offset = 0;
+
+public:
+  SourceLoc() = default;
+  explicit SourceLoc(uint32_t offset) : offset(offset) {}
+
+  // Convert an SMLoc pointing into the buffer starting at bufferStart.
+  static SourceLoc get(llvm::SMLoc loc, const char *bufferStart) {
+    assert(loc.getPointer() >= bufferStart && "Location outside the buffer.");
+    return SourceLoc(static_cast<uint32_t>(loc.getPointer() - bufferStart));
+  }
+
+  llvm::SMLoc toSMLoc(const char *bufferStart) const {
+    return llvm::SMLoc::getFromPointer(bufferStart + offset);
+  }
+
+  uint32_t getOffset() const { return offset; }
+};
+
+} // namespace mxrlang
+
+#endif // SOURCELOC_H
@@ -1,14 +1,41 @@
 #ifndef TOKENKINDS_H
 #define TOKENKINDS_H
 
+#include <cstdint>
+
 namespace mxrlang {
 
-enum class TokenKind {
+enum class TokenKind : uint8_t {
 #define TOK(ID) ID,
 #include "TokenKinds.def"
   NUM_TOKENS
 };
 
+// Binding power of binary operators. Operators with a higher precedence bind
+// tighter.
+enum class Precedence : uint8_t {
+  Unknown, // Not a binary operator.
+  Assignment,
+  LogicalOr,
+  LogicalAnd,
+  Equality,
+  Relational,
+  Additive,
+  Multiplicative
+};
+
+// Return the precedence of the token when used as a binary operator.
+inline Precedence getBinaryPrecedence(TokenKind kind) {
+  switch (kind) {
+#define BINARY_OPERATOR(ID, PREC)                                              \
+  case TokenKind::ID:                                                          \
+    return Precedence::PREC;
+#include "TokenKinds.def"
+  default:
+    return Precedence::Unknown;
+  }
+}
+
 const char *getTokenName(TokenKind kind);
 const char *getPunctuatorSpelling(TokenKind kind);
 const char *getKeywordSpelling(TokenKind kind);
@@ -1,21 +1,19 @@
 ﻿#ifndef TREE_H
 #define TREE_H
 
-#include "llvm/ADT/APSInt.h"
 #include "llvm/Support/Casting.h"
-#include "llvm/Support/SMLoc.h"
+#include "llvm/Support/ErrorHandling.h"
 #include "llvm/Support/raw_ostream.h"
 #include <vector>
 
+#include "ASTContext.h"
+#include "SourceLoc.h"
 #include "Type.h"
 
 // This file contains definitions of abstract syntax tree expression
 // and statement classes.
 
 // Generates boilerplate code for each class.
-#define ACCEPT()                                                               \
-  virtual void accept(Visitor *visitor) override { visitor->visit(this); }
-
 #define CLASSOF(PARENT, KIND)                                                  \
   static bool classof(const PARENT *node) {                                    \
     return node->getKind() == PARENT##Kind::KIND;                              \
@@ -34,6 +32,7 @@ class BinaryArithExpr;
 class BinaryLogicalExpr;
 class BoolLiteralExpr;
 class CallExpr;
+class CastExpr;
 class IntLiteralExpr;
 class LoadExpr;
 class PointerOpExpr;
@@ -59,54 +58,36 @@ using Exprs = std::vector<Expr *>;
 using FunCallArgs = std::vector<Expr *>;
 using FunDeclArgs = std::vector<VarDecl *>;
 
-// Inherit from Visitor class in order to create an AST traversal class.
-class Visitor {
-public:
-  virtual void visit(ArrayAccessExpr *expr) {}
-  virtual void visit(ArrayInitExpr *expr) {}
-  virtual void visit(AssignExpr *expr) {}
-  virtual void visit(BinaryArithExpr *expr) {}
-  virtual void visit(BinaryLogicalExpr *expr) {}
-  virtual void visit(BoolLiteralExpr *expr) {}
-  virtual void visit(CallExpr *expr) {}
-  virtual void visit(IntLiteralExpr *expr) {}
-  virtual void visit(LoadExpr *expr) {}
-  virtual void visit(PointerOpExpr *expr) {}
-  virtual void visit(UnaryExpr *expr) {}
-  virtual void visit(VarExpr *expr) {}
-
-  virtual void visit(ExprStmt *stmt) {}
-  virtual void visit(IfStmt *stmt) {}
-  virtual void visit(PrintStmt *stmt) {}
-  virtual void visit(ReturnStmt *stmt) {}
-  virtual void visit(ScanStmt *stmt) {}
-  virtual void visit(WhileStmt *stmt) {}
-
-  virtual void visit(FunDecl *decl) {}
-  virtual void visit(ModuleDecl *decl) {}
-  virtual void visit(VarDecl *decl) {}
-};
-
-// Node class describes a single AST node.
+// Node class describes a single AST node. Nodes are created in, and owned by,
+// the ASTContext of the module.
 class Node {
 public:
   enum class NodeKind { Decl, Expr, Stmt };
 
+protected:
+  // All kinds of a node are packed in a single word: the node class, the kind
+  // within the class (ExprKind, StmtKind or DeclKind) and, for operator
+  // expressions, the operator kind.
+  uint32_t kind : 2;
+  uint32_t subclassKind : 4;
+  uint32_t opKind : 4;
+
 private:
-  NodeKind kind;
   // Ties the node to the location in the source code. Useful for error
   // reporting.
-  llvm::SMLoc loc;
+  SourceLoc loc;
 
 public:
-  Node(NodeKind kind, llvm::SMLoc loc) : kind(kind), loc(loc) {}
-  virtual ~Node() = default;
+  Node(NodeKind kind, uint32_t subclassKind, SourceLoc loc)
+      : kind(static_cast<uint32_t>(kind)), subclassKind(subclassKind),
+        opKind(0), loc(loc) {}
 
-  // Pure virtual accept method of the visitor pattern.
-  virtual void accept(Visitor *visitor) = 0;
+  NodeKind getKind() const { return static_cast<NodeKind>(kind); }
+  SourceLoc getLoc() const { return loc; }
 
-  NodeKind getKind() const { return kind; }
-  llvm::SMLoc getLoc() const { return loc; }
+  // Move the node to another location, e.g. after the source code in front
+  // of it was edited.
+  void setLoc(SourceLoc loc) { this->loc = loc; }
 };
 
 // Expr class describes expression nodes of the AST.
@@ -120,6 +101,7 @@ public:
     BinaryLogical,
     BoolLiteral,
     Call,
+    Cast,
     IntLiteral,
     Load,
     PointerOp,
@@ -128,18 +110,17 @@ public:
   };
 
 private:
-  ExprKind kind;
   // Every expression should have a type.
   Type *type;
 
 public:
-  Expr(ExprKind kind, llvm::SMLoc loc, Type *type = Type::getNoneType())
-      : Node(NodeKind::Expr, loc), kind(kind), type(type) {}
+  Expr(ExprKind kind, SourceLoc loc, Type *type = Type::getNoneType())
+      : Node(NodeKind::Expr, static_cast<uint32_t>(kind), loc), type(type) {}
 
   // Check whether we can take the address of an expression.
-  virtual bool canTakeAddressOf() { return false; }
+  bool canTakeAddressOf() const;
 
-  ExprKind getKind() const { return kind; }
+  ExprKind getKind() const { return static_cast<ExprKind>(subclassKind); }
   Type *getType() const { return type; }
 
   void setType(Type *type) { this->type = type; }
@@ -152,14 +133,10 @@ class Stmt : public Node {
 public:
   enum class StmtKind { Expr, Fun, If, Module, Print, Return, Scan, While };
 
-private:
-  StmtKind kind;
-
-public:
-  Stmt(StmtKind kind, llvm::SMLoc loc)
-      : Node(NodeKind::Stmt, loc), kind(kind) {}
+  Stmt(StmtKind kind, SourceLoc loc)
+      : Node(NodeKind::Stmt, static_cast<uint32_t>(kind), loc) {}
 
-  StmtKind getKind() const { return kind; }
+  StmtKind getKind() const { return static_cast<StmtKind>(subclassKind); }
 
   CLASSOF(Node, Stmt)
 };
@@ -170,16 +147,22 @@ public:
   enum class DeclKind { Fun, Module, Var };
 
 private:
-  DeclKind kind;
   // Every declaration should have a name
-  llvm::StringRef name;
+  IdentifierInfo *name;
+  // Number of the declaration within its module, assigned by the semantic
+  // check. Passes use it to index their side tables of declarations.
+  uint32_t index = 0;
 
 public:
-  Decl(DeclKind kind, llvm::StringRef name, llvm::SMLoc loc)
-      : Node(NodeKind::Decl, loc), kind(kind), name(name) {}
+  Decl(DeclKind kind, IdentifierInfo *name, SourceLoc loc)
+      : Node(NodeKind::Decl, static_cast<uint32_t>(kind), loc), name(name) {}
+
+  DeclKind getKind() const { return static_cast<DeclKind>(subclassKind); }
+  IdentifierInfo *getIdentifier() const { return name; }
+  llvm::StringRef getName() const { return name->getName(); }
+  uint32_t getIndex() const { return index; }
 
-  DeclKind getKind() const { return kind; }
-  const llvm::StringRef &getName() const { return name; }
+  void setIndex(uint32_t index) { this->index = index; }
 
   CLASSOF(Node, Decl)
 };
@@ -192,7 +175,7 @@ class ArrayAccessExpr : public Expr {
   Expr *element;
 
 public:
-  ArrayAccessExpr(Expr *array, Expr *element, llvm::SMLoc loc)
+  ArrayAccessExpr(Expr *array, Expr *element, SourceLoc loc)
       : Expr(ExprKind::ArrayAccess, loc), array(array), element(element) {}
 
   Expr *getArray() const { return array; }
@@ -201,10 +184,12 @@ public:
   void setArray(Expr *array) { this->array = array; }
   void setElement(Expr *element) { this->element = element; }
 
-  ACCEPT()
-  CLASSOF(Expr, ArrayAccess)
+  // Whether the element is proven to be within the bounds of the array, so
+  // that the access needs no bounds check. Kept in the spare kind bits.
+  bool isInBounds() const { return opKind; }
+  void setInBounds(bool inBounds) { opKind = inBounds; }
 
-  bool canTakeAddressOf() override { return array->canTakeAddressOf(); }
+  CLASSOF(Expr, ArrayAccess)
 };
 
 // Describes an array initializer list (e.g. VAR arr : INT[3] := {1,2,3};)
@@ -212,12 +197,11 @@ class ArrayInitExpr : public Expr {
   Exprs vals;
 
 public:
-  ArrayInitExpr(Exprs vals, llvm::SMLoc loc)
+  ArrayInitExpr(Exprs vals, SourceLoc loc)
       : Expr(ExprKind::ArrayInit, loc), vals(std::move(vals)) {}
 
   Exprs &getVals() { return vals; }
 
-  ACCEPT()
   CLASSOF(Expr, ArrayInit)
 };
 
@@ -227,7 +211,7 @@ class AssignExpr : public Expr {
   Expr *source;
 
 public:
-  AssignExpr(Expr *dest, Expr *source, llvm::SMLoc loc)
+  AssignExpr(Expr *dest, Expr *source, SourceLoc loc)
       : Expr(ExprKind::Assign, loc), dest(dest), source(source) {}
 
   Expr *getDest() const { return dest; }
@@ -236,7 +220,6 @@ public:
   void setDest(Expr *dest) { this->dest = dest; }
   void setSource(Expr *source) { this->source = source; }
 
-  ACCEPT()
   CLASSOF(Expr, Assign)
 };
 
@@ -246,27 +229,40 @@ public:
   enum class BinaryArithExprKind { Add, Div, Mul, Sub };
 
 private:
-  BinaryArithExprKind binKind;
   Expr *left;
   Expr *right;
-  // Useful for printing out the AST.
-  llvm::StringRef opString;
 
 public:
   BinaryArithExpr(BinaryArithExprKind binKind, Expr *left, Expr *right,
-                  llvm::StringRef opString, llvm::SMLoc loc)
-      : Expr(ExprKind::BinaryArith, loc), binKind(binKind), left(left),
-        right(right), opString(opString) {}
+                  SourceLoc loc)
+      : Expr(ExprKind::BinaryArith, loc), left(left), right(right) {
+    opKind = static_cast<uint32_t>(binKind);
+  }
 
-  BinaryArithExprKind getBinaryKind() const { return binKind; }
+  BinaryArithExprKind getBinaryKind() const {
+    return static_cast<BinaryArithExprKind>(opKind);
+  }
   Expr *getLeft() const { return left; }
   Expr *getRight() const { return right; }
-  const llvm::StringRef &getOpString() const { return opString; }
+
+  // Useful for printing out the AST.
+  llvm::StringRef getOpString() const {
+    switch (getBinaryKind()) {
+    case BinaryArithExprKind::Add:
+      return "+";
+    case BinaryArithExprKind::Div:
+      return "/";
+    case BinaryArithExprKind::Mul:
+      return "*";
+    case BinaryArithExprKind::Sub:
+      return "-";
+    }
+    llvm_unreachable("Unknown binary arithmetic expression kind.");
+  }
 
   void setLeft(Expr *left) { this->left = left; }
   void setRight(Expr *right) { this->right = right; }
 
-  ACCEPT()
   CLASSOF(Expr, BinaryArith)
 };
 
@@ -285,78 +281,122 @@ public:
   };
 
 private:
-  BinaryLogicalExprKind binKind;
   Expr *left;
   Expr *right;
-  // Useful for printing out the AST.
-  llvm::StringRef opString;
 
 public:
   BinaryLogicalExpr(BinaryLogicalExprKind binKind, Expr *left, Expr *right,
-                    llvm::StringRef opString, llvm::SMLoc loc)
-      : Expr(ExprKind::BinaryLogical, loc), binKind(binKind), left(left),
-        right(right), opString(opString) {}
+                    SourceLoc loc)
+      : Expr(ExprKind::BinaryLogical, loc), left(left), right(right) {
+    opKind = static_cast<uint32_t>(binKind);
+  }
 
-  BinaryLogicalExprKind getBinaryKind() const { return binKind; }
+  BinaryLogicalExprKind getBinaryKind() const {
+    return static_cast<BinaryLogicalExprKind>(opKind);
+  }
   Expr *getLeft() const { return left; }
   Expr *getRight() const { return right; }
-  const llvm::StringRef &getOpString() const { return opString; }
+
+  // Useful for printing out the AST.
+  llvm::StringRef getOpString() const {
+    switch (getBinaryKind()) {
+    case BinaryLogicalExprKind::And:
+      return "&&";
+    case BinaryLogicalExprKind::Eq:
+      return "=";
+    case BinaryLogicalExprKind::Greater:
+      return ">";
+    case BinaryLogicalExprKind::GreaterEq:
+      return ">=";
+    case BinaryLogicalExprKind::Less:
+      return "<";
+    case BinaryLogicalExprKind::LessEq:
+      return "<=";
+    case BinaryLogicalExprKind::NotEq:
+      return "!=";
+    case BinaryLogicalExprKind::Or:
+      return "||";
+    }
+    llvm_unreachable("Unknown binary logical expression kind.");
+  }
 
   void setLeft(Expr *left) { this->left = left; }
   void setRight(Expr *right) { this->right = right; }
 
-  ACCEPT()
   CLASSOF(Expr, BinaryLogical)
 };
 
 // Descibes a BOOL type literal (e.g TRUE).
 class BoolLiteralExpr : public Expr {
-  bool value;
-
 public:
-  BoolLiteralExpr(bool value, llvm::SMLoc loc)
-      : Expr(ExprKind::BoolLiteral, loc, Type::getBoolType()), value(value) {}
+  // The value is kept in the spare kind bits.
+  BoolLiteralExpr(bool value, SourceLoc loc)
+      : Expr(ExprKind::BoolLiteral, loc, Type::getBoolType()) {
+    opKind = value;
+  }
 
-  bool getValue() const { return value; }
+  bool getValue() const { return opKind; }
 
-  ACCEPT()
   CLASSOF(Expr, BoolLiteral)
 };
 
 // Describes a function call (e.g. fun(5, 6)).
 class CallExpr : public Expr {
-  llvm::StringRef funName;
+  IdentifierInfo *funName;
   FunCallArgs args;
+  // Called function, resolved by the semantic check.
+  FunDecl *decl = nullptr;
 
 public:
-  CallExpr(llvm::StringRef funName, FunCallArgs &&args, llvm::SMLoc loc)
+  CallExpr(IdentifierInfo *funName, FunCallArgs &&args, SourceLoc loc)
       : Expr(ExprKind::Call, loc), funName(funName), args(std::move(args)) {}
 
-  const llvm::StringRef &getName() const { return funName; }
+  IdentifierInfo *getIdentifier() const { return funName; }
+  llvm::StringRef getName() const { return funName->getName(); }
   FunCallArgs &getArgs() { return args; }
+  FunDecl *getDecl() const { return decl; }
+
+  void setDecl(FunDecl *decl) { this->decl = decl; }
 
-  ACCEPT()
   CLASSOF(Expr, Call)
 };
 
-// Describes an INT type literal (e.g. 1264).
-class IntLiteralExpr : public Expr {
-  llvm::APSInt value;
+// Describes an explicit conversion of an integer to another integer type
+// (e.g. INT8(x)).
+class CastExpr : public Expr {
+  Type *destType;
+  Expr *expr;
 
 public:
-  IntLiteralExpr(llvm::StringRef valueString, llvm::SMLoc loc)
-      : Expr(ExprKind::IntLiteral, loc, Type::getIntType()) {
-    value = llvm::APInt(/* numBits= */ 64, valueString, /* radix= */ 10);
-    value.setIsSigned(true);
-  }
+  CastExpr(Type *destType, Expr *expr, SourceLoc loc)
+      : Expr(ExprKind::Cast, loc), destType(destType), expr(expr) {}
+
+  Type *getDestType() const { return destType; }
+  Expr *getExpr() const { return expr; }
 
-  IntLiteralExpr(llvm::APSInt value, llvm::SMLoc loc)
+  void setExpr(Expr *expr) { this->expr = expr; }
+
+  CLASSOF(Expr, Cast)
+};
+
+// Describes an integer literal (e.g. 1264). The literal is of INT type,
+// unless the semantic check gives it the integer type its context expects.
+// Literals created by constant folding keep the type of the folded expression.
+class IntLiteralExpr : public Expr {
+  // Two's complement bit pattern of the value, as decoded by the lexer.
+  uint64_t value;
+
+public:
+  IntLiteralExpr(uint64_t value, SourceLoc loc)
       : Expr(ExprKind::IntLiteral, loc, Type::getIntType()), value(value) {}
 
-  const llvm::APSInt &getValue() const { return value; }
-  uint64_t getRawValue() const { return *value.getRawData(); }
+  uint64_t getValue() const { return value; }
+
+  // Whether the literal is the result of constant folding. Kept in the spare
+  // kind bits.
+  bool isFolded() const { return opKind; }
+  void setFolded() { opKind = 1; }
 
-  ACCEPT()
   CLASSOF(Expr, IntLiteral)
 };
 
@@ -368,17 +408,14 @@ class LoadExpr : public Expr {
   Expr *expr;
 
 public:
-  LoadExpr(Expr *expr, llvm::SMLoc loc)
+  LoadExpr(Expr *expr, SourceLoc loc)
       : Expr(ExprKind::Load, loc), expr(expr) {}
 
   Expr *getExpr() const { return expr; }
 
   void setExpr(Expr *expr) { this->expr = expr; }
 
-  ACCEPT()
   CLASSOF(Expr, Load)
-
-  bool canTakeAddressOf() override { return true; }
 };
 
 // Describes an operation on a pointer (address-of/dereference).
@@ -387,25 +424,27 @@ public:
   enum class PointerOpKind { AddressOf, Dereference };
 
 private:
-  PointerOpKind pointerOpKind;
   // Pointer.
   Expr *expr;
-  // Useful for printing out the AST.
-  llvm::StringRef opString;
 
 public:
-  PointerOpExpr(PointerOpKind pointerOpKind, Expr *expr,
-                llvm::StringRef opString, llvm::SMLoc loc)
-      : Expr(ExprKind::PointerOp, loc), pointerOpKind(pointerOpKind),
-        expr(expr), opString(opString) {}
+  PointerOpExpr(PointerOpKind pointerOpKind, Expr *expr, SourceLoc loc)
+      : Expr(ExprKind::PointerOp, loc), expr(expr) {
+    opKind = static_cast<uint32_t>(pointerOpKind);
+  }
 
-  PointerOpKind getPointerOpKind() const { return pointerOpKind; }
+  PointerOpKind getPointerOpKind() const {
+    return static_cast<PointerOpKind>(opKind);
+  }
   Expr *getExpr() const { return expr; }
-  const llvm::StringRef &getOpString() const { return opString; }
+
+  // Useful for printing out the AST.
+  llvm::StringRef getOpString() const {
+    return getPointerOpKind() == PointerOpKind::AddressOf ? "&" : "*";
+  }
 
   void setExpr(Expr *expr) { this->expr = expr; }
 
-  ACCEPT()
   CLASSOF(Expr, PointerOp)
 };
 
@@ -415,41 +454,46 @@ public:
   enum class UnaryExprKind { NegArith, NegLogic };
 
 private:
-  UnaryExprKind unaryKind;
   Expr *expr;
-  // Useful for printing out the AST.
-  llvm::StringRef opString;
 
 public:
-  UnaryExpr(UnaryExprKind unaryKind, Expr *expr, llvm::StringRef opString,
-            llvm::SMLoc loc)
-      : Expr(ExprKind::Unary, loc), unaryKind(unaryKind), expr(expr),
-        opString(opString) {}
+  UnaryExpr(UnaryExprKind unaryKind, Expr *expr, SourceLoc loc)
+      : Expr(ExprKind::Unary, loc), expr(expr) {
+    opKind = static_cast<uint32_t>(unaryKind);
+  }
 
-  UnaryExprKind getUnaryKind() const { return unaryKind; }
+  UnaryExprKind getUnaryKind() const {
+    return static_cast<UnaryExprKind>(opKind);
+  }
   Expr *getExpr() const { return expr; }
-  const llvm::StringRef &getOpString() const { return opString; }
+
+  // Useful for printing out the AST.
+  llvm::StringRef getOpString() const {
+    return getUnaryKind() == UnaryExprKind::NegArith ? "-" : "!";
+  }
 
   void setExpr(Expr *expr) { this->expr = expr; }
 
-  ACCEPT()
   CLASSOF(Expr, Unary)
 };
 
 // Describes a variable acces (either to read or to write).
 class VarExpr : public Expr {
-  llvm::StringRef name;
+  IdentifierInfo *name;
+  // Accessed variable, resolved by the semantic check.
+  VarDecl *decl = nullptr;
 
 public:
-  VarExpr(llvm::StringRef name, llvm::SMLoc loc)
+  VarExpr(IdentifierInfo *name, SourceLoc loc)
       : Expr(ExprKind::Var, loc), name(name) {}
 
-  const llvm::StringRef &getName() const { return name; }
+  IdentifierInfo *getIdentifier() const { return name; }
+  llvm::StringRef getName() const { return name->getName(); }
+  VarDecl *getDecl() const { return decl; }
 
-  ACCEPT()
-  CLASSOF(Expr, Var)
+  void setDecl(VarDecl *decl) { this->decl = decl; }
 
-  bool canTakeAddressOf() override { return true; }
+  CLASSOF(Expr, Var)
 };
 
 // The following classes describe statement nodes of the AST.
@@ -459,14 +503,13 @@ class ExprStmt : public Stmt {
   Expr *expr;
 
 public:
-  ExprStmt(Expr *expr, llvm::SMLoc loc)
+  ExprStmt(Expr *expr, SourceLoc loc)
       : Stmt(StmtKind::Expr, loc), expr(expr) {}
 
   Expr *getExpr() const { return expr; }
 
   void setExpr(Expr *expr) { this->expr = expr; }
 
-  ACCEPT()
   CLASSOF(Stmt, Expr)
 };
 
@@ -477,7 +520,7 @@ class IfStmt : public Stmt {
   Nodes elseBody;
 
 public:
-  IfStmt(Expr *cond, Nodes &&thenBody, Nodes &&elseBody, llvm::SMLoc loc)
+  IfStmt(Expr *cond, Nodes &&thenBody, Nodes &&elseBody, SourceLoc loc)
       : Stmt(StmtKind::If, loc), cond(cond), thenBody(std::move(thenBody)),
         elseBody(std::move(elseBody)) {}
 
@@ -487,7 +530,6 @@ public:
 
   void setCond(Expr *cond) { this->cond = cond; }
 
-  ACCEPT()
   CLASSOF(Stmt, If)
 };
 
@@ -496,14 +538,13 @@ class PrintStmt : public Stmt {
   Expr *printExpr;
 
 public:
-  PrintStmt(Expr *printExpr, llvm::SMLoc loc)
+  PrintStmt(Expr *printExpr, SourceLoc loc)
       : Stmt(StmtKind::Print, loc), printExpr(printExpr) {}
 
   Expr *getPrintExpr() const { return printExpr; }
 
   void setPrintExpr(Expr *printExpr) { this->printExpr = printExpr; }
 
-  ACCEPT()
   CLASSOF(Stmt, Print)
 };
 
@@ -512,14 +553,13 @@ class ReturnStmt : public Stmt {
   Expr *retExpr;
 
 public:
-  ReturnStmt(Expr *retExpr, llvm::SMLoc loc)
+  ReturnStmt(Expr *retExpr, SourceLoc loc)
       : Stmt(StmtKind::Return, loc), retExpr(retExpr) {}
 
   Expr *getRetExpr() const { return retExpr; }
 
   void setRetExpr(Expr *retExpr) { this->retExpr = retExpr; }
 
-  ACCEPT()
   CLASSOF(Stmt, Return)
 };
 
@@ -528,14 +568,13 @@ class ScanStmt : public Stmt {
   Expr *scanVar;
 
 public:
-  ScanStmt(Expr *scanVar, llvm::SMLoc loc)
+  ScanStmt(Expr *scanVar, SourceLoc loc)
       : Stmt(StmtKind::Scan, loc), scanVar(scanVar) {}
 
   Expr *getScanVar() const { return scanVar; }
 
   void setScanVar(Expr *scanVar) { this->scanVar = scanVar; }
 
-  ACCEPT()
   CLASSOF(Stmt, Scan)
 };
 
@@ -545,15 +584,14 @@ class WhileStmt : public Stmt {
   Nodes body;
 
 public:
-  WhileStmt(Expr *cond, Nodes &&body, llvm::SMLoc loc)
-      : Stmt(StmtKind::While, loc), cond(cond), body(body) {}
+  WhileStmt(Expr *cond, Nodes &&body, SourceLoc loc)
+      : Stmt(StmtKind::While, loc), cond(cond), body(std::move(body)) {}
 
   Expr *getCond() const { return cond; }
   Nodes &getBody() { return body; }
 
   void setCond(Expr *cond) { this->cond = cond; }
 
-  ACCEPT()
   CLASSOF(Stmt, While)
 };
 
@@ -565,12 +603,11 @@ class ModuleDecl : public Decl {
   Decls body;
 
 public:
-  ModuleDecl(llvm::StringRef name, Decls &&body, llvm::SMLoc loc)
+  ModuleDecl(IdentifierInfo *name, Decls &&body, SourceLoc loc)
       : Decl(DeclKind::Module, name, loc), body(std::move(body)) {}
 
   Decls &getBody() { return body; }
 
-  ACCEPT()
   CLASSOF(Decl, Module)
 };
 
@@ -578,55 +615,107 @@ public:
 class VarDecl : public Decl {
   Type *type;
   Expr *initializer;
-  // If this is a local variable of array type, and it has an initializer,
-  // lower the initialization into a list of expressions, each representing
-  // an assignment of an initialization expression to an array member.
-  Exprs loweredArrayInit;
+  // Initializer of a global variable, evaluated at compile time into
+  // literals. Takes the place of the initializer in code generation.
+  Expr *evaluatedInit = nullptr;
+  // Sizes of the array type of the variable, if any of them is not an integer
+  // literal, and the type of the array elements. The semantic check computes
+  // the sizes and sets the type of the variable.
+  Exprs arrayDims;
+  Type *arrayElType = nullptr;
   // Whether this is a global variable declaration.
   bool global;
+  // Whether the variable is accessed through a pointer anywhere (e.g. its
+  // address is taken or it is passed to a function). Set by the semantic
+  // check.
+  bool escaping = false;
 
 public:
-  VarDecl(llvm::StringRef name, Expr *initializer, Type *type, bool global,
-          llvm::SMLoc loc)
+  VarDecl(IdentifierInfo *name, Expr *initializer, Type *type, bool global,
+          SourceLoc loc)
       : Decl(DeclKind::Var, name, loc), type(type), initializer(initializer),
         global(global) {}
 
   Type *getType() const { return type; }
   Expr *getInitializer() const { return initializer; }
-  Exprs &getLoweredArrayInit() { return loweredArrayInit; }
+  Expr *getEvaluatedInit() const { return evaluatedInit; }
+  Exprs &getArrayDims() { return arrayDims; }
+  Type *getArrayElType() const { return arrayElType; }
+  bool hasArrayDims() const { return !arrayDims.empty(); }
   bool isGlobal() const { return global; }
+  bool isEscaping() const { return escaping; }
 
+  void setType(Type *type) { this->type = type; }
   void setInitializer(Expr *init) { this->initializer = init; }
-  void setLoweredArrayInit(Exprs &&init) { loweredArrayInit = std::move(init); }
+  void setEvaluatedInit(Expr *init) { evaluatedInit = init; }
+  void setArrayDims(Exprs &&dims, Type *elType) {
+    arrayDims = std::move(dims);
+    arrayElType = elType;
+  }
   void setGlobal(bool global) { this->global = global; }
+  void setEscaping(bool escaping) { this->escaping = escaping; }
 
-  ACCEPT()
   CLASSOF(Decl, Var)
 };
 
 // Declaration node describing a function definition.
 class FunDecl : public Decl {
+public:
+  // Effect of the function on the memory visible to its callers (globals,
+  // and memory accessed through pointers). Printing and scanning write.
+  enum class MemoryEffect { None, Read, Write };
+
+private:
   Type *retType;
   FunDeclArgs args;
   Nodes body;
+  // Whether the function declares an array variable whose size is computed.
+  bool computedArrays = false;
+  // Effects of the function, inferred by the effect analysis. Until then,
+  // the function may do anything.
+  MemoryEffect memoryEffect = MemoryEffect::Write;
+  bool willReturn = false;
+  bool recursive = true;
 
 public:
-  FunDecl(llvm::StringRef name, Type *retType, FunDeclArgs &&args, Nodes &&body,
-          llvm::SMLoc loc)
+  FunDecl(IdentifierInfo *name, Type *retType, FunDeclArgs &&args,
+          Nodes &&body, SourceLoc loc)
       : Decl(DeclKind::Fun, name, loc), retType(retType), args(std::move(args)),
         body(std::move(body)) {}
 
   Type *getRetType() const { return retType; }
   FunDeclArgs &getArgs() { return args; }
   Nodes &getBody() { return body; }
+  bool declaresComputedArrays() const { return computedArrays; }
+  MemoryEffect getMemoryEffect() const { return memoryEffect; }
+  // Whether every call of the function returns.
+  bool isWillReturn() const { return willReturn; }
+  // Whether the function may call itself, directly or through other calls.
+  bool isRecursive() const { return recursive; }
+
+  void setComputedArrays(bool computed) { computedArrays = computed; }
+  void setMemoryEffect(MemoryEffect effect) { memoryEffect = effect; }
+  void setWillReturn(bool willReturn) { this->willReturn = willReturn; }
+  void setRecursive(bool recursive) { this->recursive = recursive; }
 
-  ACCEPT()
   CLASSOF(Decl, Fun)
 };
 
+// Check whether we can take the address of an expression.
+inline bool Expr::canTakeAddressOf() const {
+  switch (getKind()) {
+  case ExprKind::ArrayAccess:
+    return llvm::cast<ArrayAccessExpr>(this)->getArray()->canTakeAddressOf();
+  case ExprKind::Load:
+  case ExprKind::Var:
+    return true;
+  default:
+    return false;
+  }
+}
+
 } // namespace mxrlang
 
-#undef ACCEPT
 #undef CLASSOF
 
 #endif // TREE_H
@@ -1,10 +1,10 @@
 #ifndef TYPE_H
 #define TYPE_H
 
+#include "llvm/ADT/FoldingSet.h"
 #include "llvm/IR/DerivedTypes.h"
 #include "llvm/IR/Type.h"
 #include <cstdint>
-#include <unordered_map>
 
 #include "Token.h"
 
@@ -12,7 +12,12 @@ using namespace std::string_literals;
 
 namespace mxrlang {
 
-// Holds the expression type.
+class ASTContext;
+class TypeContext;
+
+// Holds the expression type. Types other than the built-in ones are created
+// in, and owned by, the TypeContext of the module. Every type exists only
+// once, so types can be compared by their addresses.
 class Type {
 public:
   enum class TypeKind { Basic, Pointer, Array };
@@ -20,31 +25,21 @@ public:
 protected:
   TypeKind type;
 
-  // A register of all program types (built-in and user defined).
-  static std::unordered_map<std::string, Type *> typeTable;
-
 public:
   Type(TypeKind type) : type(type) {}
 
   // Convert the type token.
-  static Type *getTypeFromToken(const Token &token) {
-    if (token.getKind() == TokenKind::kw_BOOL)
-      return getBoolType();
-    else if (token.getKind() == TokenKind::kw_INT)
-      return getIntType();
-
-    return nullptr;
-  }
+  static Type *getTypeFromToken(const Token &token);
 
   // Get the built-in bool type.
-  static Type *getBoolType() { return typeTable["BOOL"]; }
+  static Type *getBoolType();
 
   // Get the built-in integer type.
-  static Type *getIntType() { return typeTable["INT"]; }
+  static Type *getIntType();
 
   // Get the NONE type, which suggests that the type of expression
   // hasn't been inferred yet.
-  static Type *getNoneType() { return typeTable["NONE"]; }
+  static Type *getNoneType();
 
   // Check if the two provided types match.
   static bool checkTypesMatching(const Type *left, const Type *right,
@@ -52,6 +47,15 @@ public:
 
   TypeKind getTypeKind() const { return type; }
 
+  // Check whether this is one of the built-in integer types.
+  bool isInteger() const;
+
+  // Check whether this is a built-in integer type with a sign.
+  bool isSigned() const;
+
+  // Return width of the built-in type in bits (0 for the other types).
+  unsigned getWidth() const;
+
   // Return the subtype (only for array and pointer types).
   virtual Type *getSubtype() const { return getNoneType(); }
 
@@ -65,7 +69,18 @@ public:
 // Holds the mxrlang built-in types.
 class BasicType : public Type {
 public:
-  enum class BasicTypeKind { Bool, Int, None };
+  enum class BasicTypeKind {
+    Bool,
+    Int,
+    Int8,
+    Int16,
+    Int32,
+    UInt,
+    UInt8,
+    UInt16,
+    UInt32,
+    None
+  };
 
 private:
   BasicTypeKind basicType;
@@ -76,6 +91,13 @@ public:
   // Mxrlang built-in types.
   static BasicType boolType;
   static BasicType intType;
+  static BasicType int8Type;
+  static BasicType int16Type;
+  static BasicType int32Type;
+  static BasicType uintType;
+  static BasicType uint8Type;
+  static BasicType uint16Type;
+  static BasicType uint32Type;
   static BasicType noneType;
 
   BasicTypeKind getBasicTypeKind() const { return basicType; }
@@ -85,32 +107,68 @@ public:
     switch (basicType) {
     case BasicTypeKind::Bool:
       return 1;
+    case BasicTypeKind::Int8:
+    case BasicTypeKind::UInt8:
+      return 8;
+    case BasicTypeKind::Int16:
+    case BasicTypeKind::UInt16:
+      return 16;
+    case BasicTypeKind::Int32:
+    case BasicTypeKind::UInt32:
+      return 32;
     case BasicTypeKind::Int:
+    case BasicTypeKind::UInt:
       return 64;
     default:
       return 0;
     }
   }
 
+  // Check whether this is an integer type, and whether it has a sign.
+  bool isInteger() const {
+    return basicType != BasicTypeKind::Bool &&
+           basicType != BasicTypeKind::None;
+  }
+  bool isSigned() const {
+    return basicType == BasicTypeKind::Int ||
+           basicType == BasicTypeKind::Int8 ||
+           basicType == BasicTypeKind::Int16 ||
+           basicType == BasicTypeKind::Int32;
+  }
+
   // Convert the type to string. Useful when printing out the type.
   std::string toString() const override {
-    if (basicType == BasicTypeKind::Bool)
+    switch (basicType) {
+    case BasicTypeKind::Bool:
       return "bool";
-    else if (basicType == BasicTypeKind::Int)
+    case BasicTypeKind::Int:
       return "int";
-    else if (basicType == BasicTypeKind::None)
+    case BasicTypeKind::Int8:
+      return "int8";
+    case BasicTypeKind::Int16:
+      return "int16";
+    case BasicTypeKind::Int32:
+      return "int32";
+    case BasicTypeKind::UInt:
+      return "uint";
+    case BasicTypeKind::UInt8:
+      return "uint8";
+    case BasicTypeKind::UInt16:
+      return "uint16";
+    case BasicTypeKind::UInt32:
+      return "uint32";
+    case BasicTypeKind::None:
       return "none";
+    }
 
     llvm_unreachable("Defective type.");
   }
 
   // Convert the Mxrlang type to LLVM type.
   llvm::Type *toLLVMType(llvm::LLVMContext &ctx) const override {
-    if (basicType == BasicTypeKind::Int)
-      return llvm::Type::getInt64Ty(ctx);
-    else if (basicType == BasicTypeKind::Bool)
-      return llvm::Type::getInt1Ty(ctx);
-    llvm_unreachable("Unknown type.");
+    if (basicType == BasicTypeKind::None)
+      llvm_unreachable("Unknown type.");
+    return llvm::Type::getIntNTy(ctx, getWidth());
   }
 
   static bool classof(const Type *node) {
@@ -118,15 +176,44 @@ public:
   }
 };
 
+inline Type *Type::getBoolType() { return &BasicType::boolType; }
+inline Type *Type::getIntType() { return &BasicType::intType; }
+inline Type *Type::getNoneType() { return &BasicType::noneType; }
+
+inline bool Type::isInteger() const {
+  auto *basicType = llvm::dyn_cast<BasicType>(this);
+  return basicType && basicType->isInteger();
+}
+
+inline bool Type::isSigned() const {
+  auto *basicType = llvm::dyn_cast<BasicType>(this);
+  return basicType && basicType->isSigned();
+}
+
+inline unsigned Type::getWidth() const {
+  auto *basicType = llvm::dyn_cast<BasicType>(this);
+  return basicType ? basicType->getWidth() : 0;
+}
+
 // Holds the pointer types.
-class PointerType : public Type {
+class PointerType : public Type, public llvm::FoldingSetNode {
+  friend class TypeContext;
+
 private:
   Type *pointeeType;
 
-public:
   PointerType(Type *pointeeType)
       : Type(TypeKind::Pointer), pointeeType(pointeeType) {}
 
+public:
+  // Get the type of a pointer to the pointee type.
+  static PointerType *get(ASTContext &ctx, Type *pointeeType);
+
+  static void Profile(llvm::FoldingSetNodeID &id, const Type *pointeeType) {
+    id.AddPointer(pointeeType);
+  }
+  void Profile(llvm::FoldingSetNodeID &id) const { Profile(id, pointeeType); }
+
   // Return the subtype (only for array and pointer types).
   Type *getSubtype() const override { return pointeeType; }
 
@@ -146,16 +233,30 @@ public:
 };
 
 // Holds the array type.
-class ArrayType : public Type {
+class ArrayType : public Type, public llvm::FoldingSetNode {
+  friend class TypeContext;
+
 private:
   Type *arrayType;
   // Size of the array (number of elements).
   uint64_t elNum;
 
-public:
   ArrayType(Type *arrayType, uint64_t elNum)
       : Type(TypeKind::Array), arrayType(arrayType), elNum(elNum) {}
 
+public:
+  // Get the type of an array of elNum elements of the element type.
+  static ArrayType *get(ASTContext &ctx, Type *arrayType, uint64_t elNum);
+
+  static void Profile(llvm::FoldingSetNodeID &id, const Type *arrayType,
+                      uint64_t elNum) {
+    id.AddPointer(arrayType);
+    id.AddInteger(elNum);
+  }
+  void Profile(llvm::FoldingSetNodeID &id) const {
+    Profile(id, arrayType, elNum);
+  }
+
   // Return the subtype (only for array and pointer types)
   Type *getSubtype() const override { return arrayType; }
   uint64_t getElNum() const { return elNum; }
@@ -169,7 +270,7 @@ public:
   }
 
   // Decays the array type to pointer type.
-  Type *decay() const { return new PointerType(arrayType); }
+  Type *decay(ASTContext &ctx) const;
 
   // Convert the Mxrlang type to LLVM type.
   llvm::Type *toLLVMType(llvm::LLVMContext &ctx) const override {
@@ -0,0 +1,42 @@
+#ifndef TYPECONTEXT_H
+#define TYPECONTEXT_H
+
+#include "llvm/ADT/FoldingSet.h"
+#include "llvm/Support/Allocator.h"
+#include <cstdint>
+#include <mutex>
+
+#include "Type.h"
+
+namespace mxrlang {
+
+// Owner of the pointer and array types of a module. Each type is created only
+// once, so two types are equal exactly when they are the same object. Types
+// are looked up by their structure, and can be requested from multiple
+// threads.
+class TypeContext {
+  llvm::BumpPtrAllocator allocator;
+
+  llvm::FoldingSet<PointerType> pointerTypes;
+  llvm::FoldingSet<ArrayType> arrayTypes;
+
+  std::mutex mutex;
+
+public:
+  TypeContext() = default;
+  TypeContext(const TypeContext &) = delete;
+  TypeContext &operator=(const TypeContext &) = delete;
+
+  // Get the type of a pointer to the pointee type.
+  PointerType *getPointerType(Type *pointeeType);
+
+  // Get the type of an array of elNum elements of the element type.
+  ArrayType *getArrayType(Type *elType, uint64_t elNum);
+
+  // Number of types created in this context.
+  size_t getNumTypes();
+};
+
+} // namespace mxrlang
+
+#endif // TYPECONTEXT_H
@@ -1,38 +1,35 @@
 #ifndef LEXER_H
 #define LEXER_H
 
-#include "llvm/ADT/StringMap.h"
 #include "llvm/ADT/StringRef.h"
 #include "llvm/Support/MemoryBuffer.h"
 #include "llvm/Support/SourceMgr.h"
 
 #include "Diag.h"
+#include "IdentifierTable.h"
 #include "Token.h"
 
 namespace mxrlang {
 
-// Mapping of keywords to their textual representations.
+// Mapping of keywords to their textual representations. The mapping is a
+// perfect hash table built at compile time from TokenKinds.def.
 class KeywordFilter {
-  llvm::StringMap<TokenKind> kwTable;
-
-  void addKeyword(llvm::StringRef kw, TokenKind kind);
-
 public:
-  void addKeywords();
-
-  TokenKind getKeyword(llvm::StringRef name,
-                       TokenKind defaultTokKind = TokenKind::unknown) {
-    auto result = kwTable.find(name);
-    if (result != kwTable.end())
-      return result->second;
-    return defaultTokKind;
-  }
+  static TokenKind getKeyword(llvm::StringRef name,
+                              TokenKind defaultTokKind = TokenKind::unknown);
 };
 
+// Implementations of the scanners which skip over runs of whitespace,
+// identifier and digit characters.
+enum class ScanImpl { Auto, Scalar, SSE2, AVX2 };
+
 class Lexer {
   llvm::SourceMgr &srcMgr;
   Diag &diag;
 
+  // Table which the identifiers are interned in.
+  IdentifierTable &identifiers;
+
   // Buffer containing the source code.
   llvm::StringRef currBuff;
   // Pointer in the buffer to the character that we're currently processing.
@@ -42,29 +39,57 @@ class Lexer {
   // as managed by the SourceMgr object.
   uint32_t currBuffer = 0;
 
-  // Filter the keywords from the identifiers.
-  KeywordFilter keywords;
-
-  // List of all tokens.
-  Tokens tokens;
+  // Table of all tokens.
+  TokenTable tokens;
 
 public:
-  Lexer(llvm::SourceMgr &srcMgr, Diag &diag) : srcMgr(srcMgr), diag(diag) {
+  Lexer(llvm::SourceMgr &srcMgr, Diag &diag, IdentifierTable &identifiers)
+      : srcMgr(srcMgr), diag(diag), identifiers(identifiers) {
     currBuffer = srcMgr.getMainFileID();
     currBuff = srcMgr.getMemoryBuffer(currBuffer)->getBuffer();
     currPtr = currBuff.begin();
-    keywords.addKeywords();
+    tokens = TokenTable(currBuff.begin());
   }
 
+  // Create a lexer for a range of the main buffer. The range must start and
+  // end at token boundaries.
+  Lexer(llvm::SourceMgr &srcMgr, Diag &diag, IdentifierTable &identifiers,
+        llvm::StringRef range)
+      : Lexer(srcMgr, diag, identifiers, range,
+              srcMgr.getMemoryBuffer(srcMgr.getMainFileID())
+                  ->getBufferStart()) {}
+
   Diag &getDiag() { return diag; }
 
   llvm::StringRef getBuffer() const { return currBuff; }
 
   // Perform lexing.
-  Tokens &&lex();
+  TokenTable &&lex();
+
+  // Perform lexing on multiple threads. The buffer is split into chunks at
+  // whitespace, which can never be a part of a token, and the chunks are
+  // lexed concurrently. Tokens and diagnostics end up the same as with lex().
+  TokenTable &&lexParallel(unsigned numThreads);
+
+  // Get the next token. Used directly when the parser pulls the tokens on
+  // demand instead of lexing the whole buffer up front.
+  void next(Token &result);
+
+  // Make all the lexers use the given scanners, instead of the best ones the
+  // host supports. Returns false if the host does not support them. Must not
+  // be called while lexing.
+  static bool setScanImpl(ScanImpl impl);
 
 private:
-  // Lex an identifier.
+  // Create a lexer for a chunk of the main buffer.
+  Lexer(llvm::SourceMgr &srcMgr, Diag &diag, IdentifierTable &identifiers,
+        llvm::StringRef chunk, const char *bufferStart)
+      : srcMgr(srcMgr), diag(diag), identifiers(identifiers), currBuff(chunk),
+        currPtr(chunk.begin()), tokens(bufferStart) {
+    currBuffer = srcMgr.getMainFileID();
+  }
+
+  // Lex an identifier, and intern it unless it is a keyword.
   void identifier(Token &result);
   // Lex a number.
   void number(Token &result);
@@ -73,8 +98,6 @@ private:
 
   // Create a token, given a pointer to its end in the buffer, and its kind.
   void formToken(Token &result, const char *tokEnd, TokenKind kind);
-  // Get the next token.
-  void next(Token &result);
 };
 
 } // namespace mxrlang
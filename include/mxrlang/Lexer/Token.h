@@ -3,16 +3,21 @@
 
 #include "llvm/ADT/StringRef.h"
 #include "llvm/Support/SMLoc.h"
-#include <list>
+#include <cassert>
+#include <cstdint>
+#include <vector>
 
+#include "IdentifierTable.h"
 #include "TokenKinds.h"
 
 namespace mxrlang {
 
 class Lexer;
+class TokenTable;
 
 class Token {
   friend class Lexer;
+  friend class TokenTable;
 
   // Textual contents of the token.
   const char *lexeme;
@@ -20,6 +25,13 @@ class Token {
   uint32_t length;
   TokenKind kind;
 
+  union {
+    // Value of an integer literal, decoded by the lexer.
+    uint64_t intValue;
+    // Interned spelling of an identifier.
+    IdentifierInfo *identInfo;
+  };
+
 public:
   TokenKind getKind() const { return kind; }
   void setKind(TokenKind k) { kind = k; }
@@ -43,9 +55,119 @@ public:
   uint32_t getLength() { return length; }
 
   llvm::StringRef getData() const { return llvm::StringRef(lexeme, length); }
+
+  uint64_t getIntValue() const {
+    assert(is(TokenKind::integer_literal) && "Not an integer literal.");
+    return intValue;
+  }
+
+  IdentifierInfo *getIdentifier() const {
+    assert(is(TokenKind::identifier) && "Not an identifier.");
+    return identInfo;
+  }
 };
 
-using Tokens = std::list<Token>;
+// Stream of tokens produced by the lexer. Tokens are kept in a
+// structure-of-arrays layout: kinds, buffer offsets and lengths live in
+// separate contiguous arrays, so the whole stream costs a handful of
+// allocations and the parser can walk it by index.
+class TokenTable {
+  // Buffer which the token offsets are relative to.
+  const char *bufferStart;
+
+  std::vector<TokenKind> kinds;
+  std::vector<uint32_t> offsets;
+  std::vector<uint32_t> lengths;
+  // Per-token payload. For integer literals, index into intValues, and for
+  // identifiers, index into identInfos.
+  std::vector<uint32_t> payloads;
+
+  // Decoded values of the integer literals.
+  std::vector<uint64_t> intValues;
+  // Interned spellings of the identifiers.
+  std::vector<IdentifierInfo *> identInfos;
+
+public:
+  explicit TokenTable(const char *bufferStart = nullptr)
+      : bufferStart(bufferStart) {}
+
+  // Append a token to the end of the stream.
+  void push_back(const Token &tok) {
+    kinds.push_back(tok.kind);
+    offsets.push_back(static_cast<uint32_t>(tok.lexeme - bufferStart));
+    lengths.push_back(tok.length);
+
+    uint32_t payload = 0;
+    if (tok.is(TokenKind::integer_literal)) {
+      payload = static_cast<uint32_t>(intValues.size());
+      intValues.push_back(tok.intValue);
+    } else if (tok.is(TokenKind::identifier)) {
+      payload = static_cast<uint32_t>(identInfos.size());
+      identInfos.push_back(tok.identInfo);
+    }
+    payloads.push_back(payload);
+  }
+
+  // Remove the last token of the stream.
+  void pop_back() {
+    if (kinds.back() == TokenKind::integer_literal)
+      intValues.pop_back();
+    else if (kinds.back() == TokenKind::identifier)
+      identInfos.pop_back();
+    kinds.pop_back();
+    offsets.pop_back();
+    lengths.pop_back();
+    payloads.pop_back();
+  }
+
+  // Append all tokens of another stream, lexed from the same buffer.
+  void append(const TokenTable &other) {
+    assert(bufferStart == other.bufferStart && "Appending a foreign stream.");
+    auto firstValue = static_cast<uint32_t>(intValues.size());
+    auto firstIdent = static_cast<uint32_t>(identInfos.size());
+    kinds.insert(kinds.end(), other.kinds.begin(), other.kinds.end());
+    offsets.insert(offsets.end(), other.offsets.begin(), other.offsets.end());
+    lengths.insert(lengths.end(), other.lengths.begin(), other.lengths.end());
+    for (uint32_t i = 0; i < other.size(); ++i) {
+      auto payload = other.payloads[i];
+      if (other.kinds[i] == TokenKind::integer_literal)
+        payload += firstValue;
+      else if (other.kinds[i] == TokenKind::identifier)
+        payload += firstIdent;
+      payloads.push_back(payload);
+    }
+    intValues.insert(intValues.end(), other.intValues.begin(),
+                     other.intValues.end());
+    identInfos.insert(identInfos.end(), other.identInfos.begin(),
+                      other.identInfos.end());
+  }
+
+  void reserve(size_t num) {
+    kinds.reserve(num);
+    offsets.reserve(num);
+    lengths.reserve(num);
+    payloads.reserve(num);
+  }
+
+  // Reconstruct the token at the given index.
+  Token operator[](uint32_t idx) const {
+    assert(idx < size() && "Token index out of range.");
+    Token tok;
+    tok.lexeme = bufferStart + offsets[idx];
+    tok.length = lengths[idx];
+    tok.kind = kinds[idx];
+    if (tok.is(TokenKind::integer_literal))
+      tok.intValue = intValues[payloads[idx]];
+    else if (tok.is(TokenKind::identifier))
+      tok.identInfo = identInfos[payloads[idx]];
+    return tok;
+  }
+
+  TokenKind getKind(uint32_t idx) const { return kinds[idx]; }
+
+  uint32_t size() const { return static_cast<uint32_t>(kinds.size()); }
+  bool empty() const { return kinds.empty(); }
+};
 
 } // namespace mxrlang
 
@@ -0,0 +1,90 @@
+#ifndef INCREMENTALPARSER_H
+#define INCREMENTALPARSER_H
+
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/SourceMgr.h"
+#include <memory>
+#include <vector>
+
+#include "ASTContext.h"
+#include "Diag.h"
+#include "Parser.h"
+#include "Token.h"
+#include "Tree.h"
+
+namespace mxrlang {
+
+// Extent of a top-level declaration in the source code, and the hash of its
+// text.
+struct DeclExtent {
+  uint32_t begin;
+  uint32_t end;
+  uint64_t hash;
+};
+
+// Parser which keeps the AST of a module between its revisions. When the
+// module is edited, only the top-level declarations whose text changed are
+// lexed and parsed again, and the new subtrees are spliced into the existing
+// module. The rest of the declarations are reused, and those after the edit
+// only have their locations moved, which is much cheaper than parsing them.
+//
+// Reused declarations keep pointing into the buffers of the revisions they
+// were parsed from, so those buffers are kept alive. Replaced declarations
+// stay in the context until the next full parse, which happens once they
+// take up as much memory as the live AST.
+class IncrementalParser {
+  std::unique_ptr<ASTContext> ctx;
+
+  // Buffers of the revisions which the AST points into. The last one is the
+  // current revision.
+  std::vector<std::unique_ptr<llvm::MemoryBuffer>> buffers;
+
+  // Current module, and the extents of its top-level declarations. Null if
+  // the last revision failed to parse.
+  ModuleDecl *module = nullptr;
+  std::vector<DeclExtent> extents;
+
+  // Bytes allocated in the context right after the last full parse.
+  size_t bytesAfterFullParse = 0;
+
+  // Number of top-level declarations parsed and reused so far.
+  uint64_t numParsed = 0;
+  uint64_t numReused = 0;
+
+  // Parse the whole revision into a new context.
+  ModuleDecl *parseFull(llvm::SourceMgr &srcMgr, Diag &diag);
+
+  // Parse only the part of the revision which changed since the previous
+  // one. Returns null, without reporting anything, if the changed part does
+  // not parse on its own.
+  ModuleDecl *reparse(llvm::SourceMgr &srcMgr, Diag &diag);
+
+  // Parse the top-level declarations in the token stream, and record their
+  // extents. Declarations in the candidates range of the current module
+  // whose text did not change are reused instead of being parsed again.
+  bool parseDecls(Parser &parser, const TokenTable &tokens, Decls &decls,
+                  std::vector<DeclExtent> &newExtents,
+                  size_t firstCandidate = 0, size_t lastCandidate = 0);
+
+  // Check whether every function in the token stream ends with its own NUF.
+  static bool isTerminated(const TokenTable &tokens);
+
+  // Move the declaration (and all nodes inside of it) by delta bytes.
+  static void shiftDecl(Decl *decl, int64_t delta);
+
+public:
+  // Parse a new revision of the module. The buffer must be the main buffer
+  // of srcMgr. Returns null on error.
+  ModuleDecl *parse(std::unique_ptr<llvm::MemoryBuffer> buffer,
+                    llvm::SourceMgr &srcMgr, Diag &diag);
+
+  // Context which owns the AST of the current revision.
+  ASTContext &getContext() { return *ctx; }
+
+  uint64_t getNumParsed() const { return numParsed; }
+  uint64_t getNumReused() const { return numReused; }
+};
+
+} // namespace mxrlang
+
+#endif // INCREMENTALPARSER_H
@@ -1,57 +1,98 @@
 #ifndef PARSER_H
 #define PARSER_H
 
+#include <array>
+
+#include "ASTContext.h"
 #include "Diag.h"
+#include "Lexer.h"
 #include "Token.h"
 #include "Tree.h"
 
 namespace mxrlang {
 
 class Parser {
-  using TokenIterator = Tokens::iterator;
+  friend class IncrementalParser;
+
+  // Number of most recently lexed tokens kept around in streaming mode.
+  // Must be a power of two.
+  static constexpr uint32_t WindowSize = 4;
+
+  // Stream of tokens acquired from the lexer. Null in streaming mode.
+  const TokenTable *tokens = nullptr;
+
+  // Lexer which the tokens are pulled from on demand. Null unless we are
+  // parsing in streaming mode.
+  Lexer *lexer = nullptr;
+  // Ring buffer holding the tokens around the current one in streaming mode.
+  // Token with index i lives in window[i % WindowSize].
+  std::array<Token, WindowSize> window;
+  // Whether the lexer stopped at an unknown token in streaming mode.
+  bool lexFailed = false;
+
+  // Index of the currently processed token.
+  uint32_t current = 0;
+  // Index of the token which ends the stream. Unless we are parsing a range
+  // of the stream, this is the EOF token. Unused in streaming mode.
+  uint32_t end = 0;
 
-  // Custom parser exception class.
-  class ParserError : public std::exception {};
+  Diag &diag;
 
-  // Stream of tokens acquired from the lexer.
-  Tokens &tokens;
-  // Currently processed token.
-  TokenIterator current;
+  // Context which owns the created AST nodes.
+  ASTContext &ctx;
 
-  Diag &diag;
+  // Whether the function being parsed declares an array variable whose size
+  // is computed.
+  bool seenComputedArray = false;
+
+  // Location of the token, as stored in the AST nodes.
+  SourceLoc getLoc(const Token &tok) const {
+    return ctx.getSourceLoc(tok.getLocation());
+  }
 
   // If the next token matches the expected, advance the token stream.
   bool match(TokenKind kind);
   // Whether the next token matches the expected.
   bool check(TokenKind kind);
   // Advance the token stream.
-  Token &advance();
+  Token advance();
   // Whether the current token signalizes the end of the token stream.
   bool isAtEnd();
   // Return the next token, but don't advance the stream.
-  Token &peek();
+  Token peek();
   // Return the previous token.
-  Token &previous();
+  Token previous();
+  // Return the kind of the token with the given index.
+  TokenKind getKind(uint32_t idx);
+  // In streaming mode, lex the token with the given index into the window.
+  void pull(uint32_t idx);
   // Check whether the next token matches the expected and advance the stream
-  // if it does. Conversely, throw an error.
-  Token &consume(std::initializer_list<TokenKind> kinds, DiagID diagID,
-                 std::string args...);
+  // if it does. Conversely, report an error and return false.
+  bool consume(std::initializer_list<TokenKind> kinds, DiagID diagID,
+               std::string args...);
 
   // Discard the (possibly) erroneous tokens until we see one of the
   // synchronization tokens. Called after the parser reports an error.
   void synchronize();
 
-  // Report an error and throw an exception.
-  ParserError error(const Token &tok, DiagID diagID, std::string args...);
+  // Report an error. Returns null, so that the productions can report and
+  // bail out in a single statement.
+  std::nullptr_t error(const Token &tok, DiagID diagID, std::string args...);
 
   // Helper which creates a VarDecl while parsing variable declarations,
   // or function declaration arguments.
   VarDecl *parseSingleVar(bool isFunArg, bool isGlobalScope = false);
 
-  // Parse a type declaration.
-  Type *parseType();
+  // Parse a type declaration. If arrayDims is given, array sizes which are
+  // not integer literals are allowed, and are moved to it.
+  Type *parseType(Exprs *arrayDims = nullptr);
+
+  // Parse the top-level declarations up to the end of the stream. Returns
+  // false if one of them fails to parse.
+  bool parseDecls(Decls &decls);
 
-  // Productions.
+  // Productions. Each returns null after reporting an error, and the error is
+  // propagated up to the enclosing declaration, which recovers from it.
   Node *declaration(bool isGlobalScope = false);
   Decl *funDeclaration();
   Decl *varDeclaration(bool isGlobalScope);
@@ -64,27 +105,39 @@ class Parser {
   Stmt *scanStmt();
   Stmt *whileStmt();
 
-  Expr *expression();
-  Expr *assignment();
-  Expr *logicalOr();
-  Expr *logicalAnd();
-  Expr *equality();
-  Expr *comparison();
-  Expr *addSub();
-  Expr *mulDiv();
-  Expr *unary();
+  Expr *expression(bool allowAssignment = true);
   Expr *primary();
-  Expr *identifier();
-  Expr *funCall(const Token &name);
-  Expr *arrayAccess(Expr *var);
   Expr *arrayInit();
 
+  // Create the node of a binary or a prefix operator.
+  Expr *createBinary(TokenKind op, Expr *left, Expr *right);
+  Expr *createPrefix(TokenKind op, Expr *expr);
+
+  // Create a parser of the tokens in the [begin, end) range of the stream.
+  Parser(const TokenTable &tokens, uint32_t begin, uint32_t end, Diag &diag,
+         ASTContext &ctx)
+      : tokens(&tokens), current(begin), end(end), diag(diag), ctx(ctx) {}
+
 public:
-  Parser(Tokens &tokens, Diag &diag)
-      : tokens(tokens), current(tokens.begin()), diag(diag) {}
+  Parser(const TokenTable &tokens, Diag &diag, ASTContext &ctx)
+      : Parser(tokens, 0, tokens.size() - 1, diag, ctx) {}
+
+  // Create a parser which pulls the tokens from the lexer on demand. Only a
+  // small window of tokens is alive at any time, so memory used for tokens
+  // does not depend on the size of the input.
+  Parser(Lexer &lexer, Diag &diag, ASTContext &ctx)
+      : lexer(&lexer), diag(diag), ctx(ctx) {
+    pull(0);
+  }
 
   // Parse the token stream and return the root of the AST.
   ModuleDecl *parse();
+
+  // Parse the token stream on multiple threads. The stream is split into
+  // ranges of top-level declarations, which are parsed concurrently, each
+  // into its own context. The AST and diagnostics end up the same as with
+  // parse(). Not available in streaming mode.
+  ModuleDecl *parseParallel(unsigned numThreads);
 };
 
 } // namespace mxrlang
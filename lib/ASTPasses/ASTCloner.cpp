@@ -0,0 +1,220 @@
+#include "ASTCloner.h"
+
+using namespace mxrlang;
+
+// Copy a list of statements and declarations.
+Nodes ASTCloner::cloneAll(Nodes &nodes) {
+  Nodes clones;
+  clones.reserve(nodes.size());
+  for (auto *node : nodes) {
+    if (auto *expr = llvm::dyn_cast<Expr>(node)) {
+      clones.push_back(evaluate(expr));
+    } else {
+      evaluate(node);
+      clones.push_back(cloned);
+    }
+  }
+  return clones;
+}
+
+// Copy a variable declaration, without its initializer. The array sizes are
+// only looked at by the semantic check, and the evaluated initializer of a
+// global is never changed after it, so neither is copied.
+VarDecl *ASTCloner::cloneDecl(VarDecl *decl) {
+  auto *clone = ctx.create<VarDecl>(decl->getIdentifier(), nullptr,
+                                    decl->getType(), decl->isGlobal(),
+                                    decl->getLoc());
+  clone->setIndex(decl->getIndex());
+  clone->setEvaluatedInit(decl->getEvaluatedInit());
+  clone->setEscaping(decl->isEscaping());
+  clones[decl] = clone;
+  return clone;
+}
+
+// Copy a function declaration and its arguments, without its body, so that
+// the calls which come before the body is copied can be bound to it.
+FunDecl *ASTCloner::cloneDecl(FunDecl *decl) {
+  FunDeclArgs args;
+  for (auto *arg : decl->getArgs())
+    args.push_back(cloneDecl(arg));
+
+  auto *clone = ctx.create<FunDecl>(decl->getIdentifier(), decl->getRetType(),
+                                    std::move(args), Nodes(), decl->getLoc());
+  clone->setIndex(decl->getIndex());
+  clone->setComputedArrays(decl->declaresComputedArrays());
+  clone->setMemoryEffect(decl->getMemoryEffect());
+  clone->setWillReturn(decl->isWillReturn());
+  clone->setRecursive(decl->isRecursive());
+  clones[decl] = clone;
+  return clone;
+}
+
+Expr *ASTCloner::visit(ArrayAccessExpr *expr) {
+  auto *array = evaluate(expr->getArray());
+  auto *element = evaluate(expr->getElement());
+  auto *clone = ctx.create<ArrayAccessExpr>(array, element, expr->getLoc());
+  clone->setInBounds(expr->isInBounds());
+  return finish(clone, expr);
+}
+
+Expr *ASTCloner::visit(ArrayInitExpr *expr) {
+  Exprs vals;
+  vals.reserve(expr->getVals().size());
+  for (auto *val : expr->getVals())
+    vals.push_back(evaluate(val));
+  return finish(ctx.create<ArrayInitExpr>(std::move(vals), expr->getLoc()),
+                expr);
+}
+
+Expr *ASTCloner::visit(AssignExpr *expr) {
+  auto *dest = evaluate(expr->getDest());
+  auto *source = evaluate(expr->getSource());
+  return finish(ctx.create<AssignExpr>(dest, source, expr->getLoc()), expr);
+}
+
+Expr *ASTCloner::visit(BinaryArithExpr *expr) {
+  auto *left = evaluate(expr->getLeft());
+  auto *right = evaluate(expr->getRight());
+  return finish(ctx.create<BinaryArithExpr>(expr->getBinaryKind(), left, right,
+                                            expr->getLoc()),
+                expr);
+}
+
+Expr *ASTCloner::visit(BinaryLogicalExpr *expr) {
+  auto *left = evaluate(expr->getLeft());
+  auto *right = evaluate(expr->getRight());
+  return finish(ctx.create<BinaryLogicalExpr>(expr->getBinaryKind(), left,
+                                              right, expr->getLoc()),
+                expr);
+}
+
+Expr *ASTCloner::visit(BoolLiteralExpr *expr) {
+  return finish(ctx.create<BoolLiteralExpr>(expr->getValue(), expr->getLoc()),
+                expr);
+}
+
+Expr *ASTCloner::visit(CallExpr *expr) {
+  FunCallArgs args;
+  args.reserve(expr->getArgs().size());
+  for (auto *arg : expr->getArgs())
+    args.push_back(evaluate(arg));
+
+  auto *clone = ctx.create<CallExpr>(expr->getIdentifier(), std::move(args),
+                                     expr->getLoc());
+  clone->setDecl(getClone(expr->getDecl()));
+  return finish(clone, expr);
+}
+
+Expr *ASTCloner::visit(CastExpr *expr) {
+  auto *operand = evaluate(expr->getExpr());
+  return finish(
+      ctx.create<CastExpr>(expr->getDestType(), operand, expr->getLoc()),
+      expr);
+}
+
+Expr *ASTCloner::visit(IntLiteralExpr *expr) {
+  auto *clone = ctx.create<IntLiteralExpr>(expr->getValue(), expr->getLoc());
+  if (expr->isFolded())
+    clone->setFolded();
+  return finish(clone, expr);
+}
+
+Expr *ASTCloner::visit(LoadExpr *expr) {
+  auto *operand = evaluate(expr->getExpr());
+  return finish(ctx.create<LoadExpr>(operand, expr->getLoc()), expr);
+}
+
+Expr *ASTCloner::visit(PointerOpExpr *expr) {
+  auto *operand = evaluate(expr->getExpr());
+  return finish(ctx.create<PointerOpExpr>(expr->getPointerOpKind(), operand,
+                                          expr->getLoc()),
+                expr);
+}
+
+Expr *ASTCloner::visit(UnaryExpr *expr) {
+  auto *operand = evaluate(expr->getExpr());
+  return finish(
+      ctx.create<UnaryExpr>(expr->getUnaryKind(), operand, expr->getLoc()),
+      expr);
+}
+
+Expr *ASTCloner::visit(VarExpr *expr) {
+  auto *clone = ctx.create<VarExpr>(expr->getIdentifier(), expr->getLoc());
+  clone->setDecl(getClone(expr->getDecl()));
+  return finish(clone, expr);
+}
+
+void ASTCloner::visit(ExprStmt *stmt) {
+  cloned = ctx.create<ExprStmt>(evaluate(stmt->getExpr()), stmt->getLoc());
+}
+
+void ASTCloner::visit(IfStmt *stmt) {
+  auto *cond = evaluate(stmt->getCond());
+  auto thenBody = cloneAll(stmt->getThenBody());
+  auto elseBody = cloneAll(stmt->getElseBody());
+  cloned = ctx.create<IfStmt>(cond, std::move(thenBody), std::move(elseBody),
+                              stmt->getLoc());
+}
+
+void ASTCloner::visit(PrintStmt *stmt) {
+  cloned =
+      ctx.create<PrintStmt>(evaluate(stmt->getPrintExpr()), stmt->getLoc());
+}
+
+void ASTCloner::visit(ReturnStmt *stmt) {
+  auto *retExpr = stmt->getRetExpr() ? evaluate(stmt->getRetExpr()) : nullptr;
+  cloned = ctx.create<ReturnStmt>(retExpr, stmt->getLoc());
+}
+
+void ASTCloner::visit(ScanStmt *stmt) {
+  cloned = ctx.create<ScanStmt>(evaluate(stmt->getScanVar()), stmt->getLoc());
+}
+
+void ASTCloner::visit(WhileStmt *stmt) {
+  auto *cond = evaluate(stmt->getCond());
+  auto body = cloneAll(stmt->getBody());
+  cloned = ctx.create<WhileStmt>(cond, std::move(body), stmt->getLoc());
+}
+
+void ASTCloner::visit(FunDecl *decl) {
+  auto *clone = cloneDecl(decl);
+  clone->getBody() = cloneAll(decl->getBody());
+  cloned = clone;
+}
+
+void ASTCloner::visit(ModuleDecl *decl) {
+  // Functions may be called, and globals accessed, before they are declared,
+  // so all of them are copied before the code which refers to them.
+  Decls body;
+  body.reserve(decl->getBody().size());
+  for (auto *dec : decl->getBody()) {
+    if (auto *funDecl = llvm::dyn_cast<FunDecl>(dec))
+      body.push_back(cloneDecl(funDecl));
+    else
+      body.push_back(cloneDecl(llvm::cast<VarDecl>(dec)));
+  }
+
+  for (size_t i = 0; i < body.size(); ++i) {
+    if (auto *funDecl = llvm::dyn_cast<FunDecl>(decl->getBody()[i])) {
+      llvm::cast<FunDecl>(body[i])->getBody() =
+          cloneAll(funDecl->getBody());
+    } else {
+      auto *varDecl = llvm::cast<VarDecl>(decl->getBody()[i]);
+      if (varDecl->getInitializer())
+        llvm::cast<VarDecl>(body[i])->setInitializer(
+            evaluate(varDecl->getInitializer()));
+    }
+  }
+
+  auto *clone = ctx.create<ModuleDecl>(decl->getIdentifier(), std::move(body),
+                                       decl->getLoc());
+  clone->setIndex(decl->getIndex());
+  cloned = clone;
+}
+
+void ASTCloner::visit(VarDecl *decl) {
+  auto *clone = cloneDecl(decl);
+  if (decl->getInitializer())
+    clone->setInitializer(evaluate(decl->getInitializer()));
+  cloned = clone;
+}
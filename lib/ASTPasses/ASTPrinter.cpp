@@ -1,18 +1,47 @@
-#include "llvm/ADT/SmallString.h"
-
 #include "ASTPrinter.h"
 
 using namespace mxrlang;
 
-// Helper function which prints a binary operator.
+// Helper function which prints a chain of operator expressions.
 // (binop type (leftExpr) (rightExpr))
-template <typename BinExpr>
-void ASTPrinter::printBinary(const llvm::StringRef &op, const BinExpr binExpr) {
-  out() << "(" + op.str() + " " + binExpr->getType()->toString() + " ";
-  evaluate(binExpr->getLeft());
-  out() << " ";
-  evaluate(binExpr->getRight());
-  out() << ")";
+// (op (expr))
+// The chain may be arbitrarily deep, so the output which is still to be
+// printed is kept on an explicit stack instead of recursing.
+void ASTPrinter::printOperators(Expr *expr) {
+  // Either an expression, or a piece of text if expr is null.
+  struct PendingOutput {
+    Expr *expr;
+    const char *text;
+  };
+  llvm::SmallVector<PendingOutput, 16> pending;
+  pending.push_back({expr, nullptr});
+
+  auto printBinary = [&](llvm::StringRef op, Expr *binExpr, Expr *left,
+                         Expr *right) {
+    out() << "(" + op.str() + " " + binExpr->getType()->toString() + " ";
+    pending.push_back({nullptr, ")"});
+    pending.push_back({right, nullptr});
+    pending.push_back({nullptr, " "});
+    pending.push_back({left, nullptr});
+  };
+
+  while (!pending.empty()) {
+    auto item = pending.pop_back_val();
+    if (!item.expr)
+      out() << item.text;
+    else if (auto *binExpr = llvm::dyn_cast<BinaryArithExpr>(item.expr))
+      printBinary(binExpr->getOpString(), binExpr, binExpr->getLeft(),
+                  binExpr->getRight());
+    else if (auto *binExpr = llvm::dyn_cast<BinaryLogicalExpr>(item.expr))
+      printBinary(binExpr->getOpString(), binExpr, binExpr->getLeft(),
+                  binExpr->getRight());
+    else if (auto *unaryExpr = llvm::dyn_cast<UnaryExpr>(item.expr)) {
+      out() << "(" + unaryExpr->getOpString().str() + " ";
+      pending.push_back({nullptr, ")"});
+      pending.push_back({unaryExpr->getExpr(), nullptr});
+    } else
+      evaluate(item.expr);
+  }
 }
 
 // Helper funcion which prints out a variable declaration or a function
@@ -49,13 +78,9 @@ void ASTPrinter::visit(AssignExpr *expr) {
   out() << ")";
 }
 
-void ASTPrinter::visit(BinaryArithExpr *expr) {
-  printBinary(expr->getOpString(), expr);
-}
+void ASTPrinter::visit(BinaryArithExpr *expr) { printOperators(expr); }
 
-void ASTPrinter::visit(BinaryLogicalExpr *expr) {
-  printBinary(expr->getOpString(), expr);
-}
+void ASTPrinter::visit(BinaryLogicalExpr *expr) { printOperators(expr); }
 
 // (true/false bool)
 void ASTPrinter::visit(BoolLiteralExpr *expr) {
@@ -73,13 +98,20 @@ void ASTPrinter::visit(CallExpr *expr) {
   out() << ")";
 }
 
+// (cast type (expr))
+void ASTPrinter::visit(CastExpr *expr) {
+  out() << "(cast " + expr->getDestType()->toString() + " ";
+  evaluate(expr->getExpr());
+  out() << ")";
+}
+
 // (intLiteral int)
 void ASTPrinter::visit(IntLiteralExpr *expr) {
-  // Convert APSInt to string.
-  llvm::SmallString<30> literal;
-  expr->getValue().toString(literal);
+  auto literal = expr->getType()->isSigned()
+                     ? std::to_string(static_cast<int64_t>(expr->getValue()))
+                     : std::to_string(expr->getValue());
 
-  out() << "(" + std::string(literal) + " " + expr->getType()->toString() + ")";
+  out() << "(" + literal + " " + expr->getType()->toString() + ")";
 }
 
 // (load var)
@@ -96,12 +128,7 @@ void ASTPrinter::visit(PointerOpExpr *expr) {
   out() << ")";
 }
 
-// (op (expr))
-void ASTPrinter::visit(UnaryExpr *expr) {
-  out() << "(" + expr->getOpString().str() + " ";
-  evaluate(expr->getExpr());
-  out() << ")";
-}
+void ASTPrinter::visit(UnaryExpr *expr) { printOperators(expr); }
 
 // (varName varType)
 void ASTPrinter::visit(VarExpr *expr) {
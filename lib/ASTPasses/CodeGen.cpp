@@ -1,9 +1,13 @@
 #include "CodeGen.h"
 
+#include "llvm/Support/MathExtras.h"
+
+#include "IntSemantics.h"
+
 using namespace mxrlang;
 
 void CodeGen::createPrintScanFunctions() {
-  llvm::ArrayRef<llvm::Type *> argTys = {llvm::Type::getInt8PtrTy(ctx)};
+  llvm::Type *argTys[] = {llvm::Type::getInt8PtrTy(ctx)};
   auto *funTy =
       llvm::FunctionType::get(llvm::Type::getInt32Ty(ctx), argTys, true);
 
@@ -11,6 +15,8 @@ void CodeGen::createPrintScanFunctions() {
                                     "printf", module.get());
   scanFun = llvm::Function::Create(funTy, llvm::GlobalValue::ExternalLinkage,
                                    "__isoc99_scanf", module.get());
+  printFun->setDoesNotThrow();
+  scanFun->setDoesNotThrow();
 
   printFormatStr = builder.CreateGlobalStringPtr(llvm::StringRef("%lld\n"),
                                                  "formatstr", 0, module.get());
@@ -18,31 +24,156 @@ void CodeGen::createPrintScanFunctions() {
                                                 "formatstr", 0, module.get());
 }
 
+// Convert the mxrlang type to LLVM type. Types are unique, so the conversions
+// are cached by the addresses of the types.
+llvm::Type *CodeGen::getLLVMType(const Type *type) {
+  auto &llvmType = llvmTypes[type];
+  if (!llvmType)
+    llvmType = type->toLLVMType(ctx);
+  return llvmType;
+}
+
+// Extend an integer value to 64 bits, according to the sign of its type.
+llvm::Value *CodeGen::extendToInt64(llvm::Value *val, const Type *type) {
+  return builder.CreateIntCast(val, llvm::Type::getInt64Ty(ctx),
+                               type->isSigned());
+}
+
+// Check whether the variable is a BOOL array stored as a bit vector. Arrays
+// accessed through pointers keep one byte per element, since a pointer cannot
+// address a single bit.
+bool CodeGen::isPackedArray(VarDecl *decl) {
+  return packBoolArrays && !decl->isEscaping() &&
+         llvm::isa<ArrayType>(decl->getType()) &&
+         decl->getType()->getSubtype() == Type::getBoolType();
+}
+
+// Type of the bit vector storing a BOOL array.
+llvm::Type *CodeGen::getPackedArrayType(const Type *type) {
+  auto elNum = llvm::cast<ArrayType>(type)->getElNum();
+  return llvm::ArrayType::get(llvm::Type::getInt8Ty(ctx), (elNum + 7) / 8);
+}
+
+// Get the bit vector which the expression accesses an element of, or null
+// if the expression is not such an access.
+llvm::Value *CodeGen::getPackedArray(Expr *expr) {
+  auto *arrayAccess = llvm::dyn_cast<ArrayAccessExpr>(expr);
+  if (!arrayAccess || !packBoolArrays)
+    return nullptr;
+
+  auto *varExpr = llvm::dyn_cast<VarExpr>(arrayAccess->getArray());
+  if (!varExpr || !isPackedArray(varExpr->getDecl()))
+    return nullptr;
+
+  return getValue(varExpr->getDecl());
+}
+
+// Get the element accessed in the array, as a 64-bit index. Unless the
+// element is proven to be in bounds, accesses to arrays of known size branch
+// to a trap if the element is out of bounds. Negative elements become large
+// unsigned indices, so a single comparison checks both bounds.
+llvm::Value *CodeGen::getElementIndex(ArrayAccessExpr *expr) {
+  auto *element = extendToInt64(evaluate(expr->getElement()),
+                                expr->getElement()->getType());
+  auto *arrayTy = llvm::dyn_cast<ArrayType>(expr->getArray()->getType());
+  if (!boundsCheck || expr->isInBounds() || !arrayTy)
+    return element;
+
+  auto *inBounds = builder.CreateICmpULT(
+      element,
+      llvm::ConstantInt::get(llvm::Type::getInt64Ty(ctx), arrayTy->getElNum()),
+      "inbounds");
+
+  // All the checks in a function share a single trap. The trap is a cold
+  // call, so the checks are predicted to pass.
+  if (!trapBB) {
+    trapBB = llvm::BasicBlock::Create(ctx, "trap", currFun);
+    llvm::IRBuilder<> trapBuilder(trapBB);
+    trapBuilder.CreateCall(
+        llvm::Intrinsic::getDeclaration(module.get(), llvm::Intrinsic::trap));
+    trapBuilder.CreateUnreachable();
+  }
+
+  auto *checkedBB = llvm::BasicBlock::Create(ctx, "checked", currFun);
+  builder.CreateCondBr(inBounds, checkedBB, trapBB);
+  setCurrBB(checkedBB);
+  return element;
+}
+
+// Get the address of the byte holding the element of a bit vector, and the
+// position of the element's bit in that byte.
+llvm::Value *CodeGen::getPackedElement(const Type *arrayType,
+                                       llvm::Value *array,
+                                       llvm::Value *element,
+                                       llvm::Value *&bit) {
+  auto *int8Ty = llvm::Type::getInt8Ty(ctx);
+  bit = builder.CreateTrunc(builder.CreateAnd(element, 7), int8Ty, "bit");
+
+  llvm::Value *zero = llvm::ConstantInt::get(llvm::Type::getInt64Ty(ctx),
+                                             llvm::APInt::getZero(64));
+  llvm::Value *idxs[] = {zero, builder.CreateLShr(element, 3)};
+  return builder.CreateInBoundsGEP(getPackedArrayType(arrayType), array, idxs);
+}
+
+// Store the BOOL value into the element of a bit vector, by replacing the
+// element's bit in its byte.
+llvm::Value *CodeGen::storePackedElement(const Type *arrayType,
+                                         llvm::Value *array,
+                                         llvm::Value *element,
+                                         llvm::Value *source) {
+  llvm::Value *bit;
+  auto *addr = getPackedElement(arrayType, array, element, bit);
+  auto *int8Ty = llvm::Type::getInt8Ty(ctx);
+  auto *byte = builder.CreateLoad(int8Ty, addr);
+  auto *mask = builder.CreateShl(llvm::ConstantInt::get(int8Ty, 1), bit);
+  auto *cleared = builder.CreateAnd(byte, builder.CreateNot(mask));
+  auto *val = builder.CreateShl(builder.CreateZExt(source, int8Ty), bit);
+  return builder.CreateStore(builder.CreateOr(cleared, val), addr);
+}
+
 llvm::FunctionType *CodeGen::createFunctionType(FunDecl *decl) {
-  auto *retTy = decl->getRetType()->toLLVMType(ctx);
+  auto *retTy = getLLVMType(decl->getRetType());
 
   // Convert argument types to LLVM types.
   std::vector<llvm::Type *> args;
   for (auto arg : decl->getArgs())
-    args.push_back(arg->getType()->toLLVMType(ctx));
+    args.push_back(getLLVMType(arg->getType()));
 
   return llvm::FunctionType::get(retTy, args, /*isVarArg*/ false);
 }
 
 llvm::Function *CodeGen::createFunction(FunDecl *decl,
                                         llvm::FunctionType *type) {
-  return llvm::Function::Create(type, llvm::GlobalValue::ExternalLinkage,
-                                decl->getName(), module.get());
-}
+  auto *fun = llvm::Function::Create(type, llvm::GlobalValue::ExternalLinkage,
+                                     decl->getName(), module.get());
+
+  // Mxrlang has no exceptions, and the C functions it calls do not throw.
+  fun->setDoesNotThrow();
+
+  // Annotate the function with the inferred effects, so that the calls of
+  // the functions without effects can be eliminated, or moved out of loops.
+  switch (decl->getMemoryEffect()) {
+  case FunDecl::MemoryEffect::None:
+    fun->setDoesNotAccessMemory();
+    break;
+  case FunDecl::MemoryEffect::Read:
+    fun->setOnlyReadsMemory();
+    break;
+  case FunDecl::MemoryEffect::Write:
+    break;
+  }
+  if (decl->isWillReturn())
+    fun->addFnAttr(llvm::Attribute::WillReturn);
+  if (!decl->isRecursive())
+    fun->setDoesNotRecurse();
 
-void CodeGen::visit(ArrayAccessExpr *expr) {
-  evaluate(expr->getArray());
-  auto *array = interResult;
+  return fun;
+}
 
-  evaluate(expr->getElement());
-  auto *element = interResult;
+llvm::Value *CodeGen::visit(ArrayAccessExpr *expr) {
+  auto *array = evaluate(expr->getArray());
+  auto *element = getElementIndex(expr);
 
-  std::vector<llvm::Value *> idxs;
   // When loading from an array we need two GEP indices.
   // The first index is always zero, as it indexes the POINTER to the array
   // (e.g. [5 x i64]*). The second index gets us the address of wanted array
@@ -50,134 +181,110 @@ void CodeGen::visit(ArrayAccessExpr *expr) {
   if (expr->getArray()->getType()->getTypeKind() == Type::TypeKind::Array) {
     llvm::Value *zero = llvm::ConstantInt::get(llvm::Type::getInt64Ty(ctx),
                                                llvm::APInt::getZero(64));
-    idxs = {zero, element};
-    interResult = builder.CreateInBoundsGEP(
-        expr->getArray()->getType()->toLLVMType(ctx), array, idxs);
-  } else {
-    // When indexing a pointer, we MUST first load its contents from memory.
-    assert(expr->getArray()->getType()->getTypeKind() ==
-           Type::TypeKind::Pointer);
-    idxs = {element};
-    auto *ptr =
-        builder.CreateLoad(expr->getArray()->getType()->toLLVMType(ctx), array);
-    interResult = builder.CreateGEP(
-        expr->getArray()->getType()->getSubtype()->toLLVMType(ctx), ptr, idxs);
+    llvm::Value *idxs[] = {zero, element};
+    return builder.CreateInBoundsGEP(getLLVMType(expr->getArray()->getType()),
+                                     array, idxs);
   }
+
+  // When indexing a pointer, we MUST first load its contents from memory.
+  assert(expr->getArray()->getType()->getTypeKind() == Type::TypeKind::Pointer);
+  auto *ptr =
+      builder.CreateLoad(getLLVMType(expr->getArray()->getType()), array);
+  return builder.CreateGEP(
+      getLLVMType(expr->getArray()->getType()->getSubtype()), ptr, element);
 }
 
-void CodeGen::visit(ArrayInitExpr *expr) {
+llvm::Value *CodeGen::visit(ArrayInitExpr *expr) {
   llvm::SmallVector<llvm::Constant *> vals;
-  for (auto *val : expr->getVals()) {
-    evaluate(val);
-    vals.push_back(llvm::dyn_cast<llvm::Constant>(interResult));
-  }
+  for (auto *val : expr->getVals())
+    vals.push_back(llvm::dyn_cast<llvm::Constant>(evaluate(val)));
 
-  interResult = llvm::ConstantArray::get(
-      llvm::dyn_cast<llvm::ArrayType>(expr->getType()->toLLVMType(ctx)), vals);
+  return llvm::ConstantArray::get(
+      llvm::dyn_cast<llvm::ArrayType>(getLLVMType(expr->getType())), vals);
 }
 
-void CodeGen::visit(AssignExpr *expr) {
-  evaluate(expr->getSource());
-  auto *source = interResult;
+llvm::Value *CodeGen::visit(AssignExpr *expr) {
+  auto *source = evaluate(expr->getSource());
 
-  evaluate(expr->getDest());
-  auto *destVal = interResult;
-  builder.CreateStore(source, destVal);
-}
+  // Replace the bit of the assigned element in a bit vector.
+  if (auto *array = getPackedArray(expr->getDest())) {
+    auto *dest = llvm::cast<ArrayAccessExpr>(expr->getDest());
+    return storePackedElement(dest->getArray()->getType(), array,
+                              getElementIndex(dest), source);
+  }
 
-void CodeGen::visit(BinaryArithExpr *expr) {
-  llvm::Value *left = nullptr;
-  llvm::Value *right = nullptr;
+  auto *destVal = evaluate(expr->getDest());
+  return builder.CreateStore(source, destVal);
+}
 
-  evaluate(expr->getLeft());
-  left = interResult;
-  evaluate(expr->getRight());
-  right = interResult;
+llvm::Value *CodeGen::visit(BinaryArithExpr *expr) {
+  auto *left = evaluate(expr->getLeft());
+  auto *right = evaluate(expr->getRight());
 
-  switch (expr->getBinaryKind()) {
-  case BinaryArithExpr::BinaryArithExprKind::Add:
-    interResult = builder.CreateAdd(left, right, "add");
-    break;
-  case BinaryArithExpr::BinaryArithExprKind::Div:
-    interResult = builder.CreateSDiv(left, right, "sdiv");
-    break;
-  case BinaryArithExpr::BinaryArithExprKind::Mul:
-    interResult = builder.CreateMul(left, right, "mul");
-    break;
-  case BinaryArithExpr::BinaryArithExprKind::Sub:
-    interResult = builder.CreateSub(left, right, "sub");
-    break;
-  default:
-    llvm_unreachable("Unexpected binary arithmetic expression kind.");
-  }
+  auto opcode =
+      IntSemantics::getOpcode(expr->getBinaryKind(), expr->getType());
+  return builder.CreateBinOp(opcode, left, right,
+                             llvm::Instruction::getOpcodeName(opcode));
 }
 
-void CodeGen::visit(BinaryLogicalExpr *expr) {
-  llvm::Value *left = nullptr;
-  llvm::Value *right = nullptr;
-
-  evaluate(expr->getLeft());
-  left = interResult;
-  evaluate(expr->getRight());
-  right = interResult;
+llvm::Value *CodeGen::visit(BinaryLogicalExpr *expr) {
+  auto *left = evaluate(expr->getLeft());
+  auto *right = evaluate(expr->getRight());
 
   switch (expr->getBinaryKind()) {
   case BinaryLogicalExpr::BinaryLogicalExprKind::And:
-    interResult = builder.CreateAnd(left, right, "and");
-    break;
-  case BinaryLogicalExpr::BinaryLogicalExprKind::Eq:
-    interResult = builder.CreateICmpEQ(left, right, "eq");
-    break;
-  case BinaryLogicalExpr::BinaryLogicalExprKind::Greater:
-    interResult = builder.CreateICmpSGT(left, right, "greater");
-    break;
-  case BinaryLogicalExpr::BinaryLogicalExprKind::GreaterEq:
-    interResult = builder.CreateICmpSGE(left, right, "greatereq");
-    break;
-  case BinaryLogicalExpr::BinaryLogicalExprKind::Less:
-    interResult = builder.CreateICmpSLT(left, right, "less");
-    break;
-  case BinaryLogicalExpr::BinaryLogicalExprKind::LessEq:
-    interResult = builder.CreateICmpSLE(left, right, "lesseq");
-    break;
-  case BinaryLogicalExpr::BinaryLogicalExprKind::NotEq:
-    interResult = builder.CreateICmpNE(left, right, "noteq");
-    break;
+    return builder.CreateAnd(left, right, "and");
   case BinaryLogicalExpr::BinaryLogicalExprKind::Or:
-    interResult = builder.CreateOr(left, right, "or");
-    break;
+    return builder.CreateOr(left, right, "or");
   default:
-    llvm_unreachable("Unexpected binary logical expression kind.");
+    auto pred = IntSemantics::getPredicate(expr->getBinaryKind(),
+                                           expr->getLeft()->getType());
+    return builder.CreateICmp(pred, left, right,
+                              llvm::CmpInst::getPredicateName(pred));
   }
 }
 
-void CodeGen::visit(BoolLiteralExpr *expr) {
-  auto *lit = llvm::ConstantInt::get(expr->getType()->toLLVMType(ctx),
-                                     expr->getValue());
-  interResult = lit;
+llvm::Value *CodeGen::visit(BoolLiteralExpr *expr) {
+  return llvm::ConstantInt::get(getLLVMType(expr->getType()),
+                                expr->getValue());
 }
 
-void CodeGen::visit(CallExpr *expr) {
+llvm::Value *CodeGen::visit(CallExpr *expr) {
   llvm::Function *callee =
-      llvm::dyn_cast<llvm::Function>(env->find(expr->getName()));
+      llvm::cast<llvm::Function>(getValue(expr->getDecl()));
 
   std::vector<llvm::Value *> args;
-  for (auto arg : expr->getArgs()) {
-    evaluate(arg);
-    args.push_back(interResult);
-  }
+  for (auto arg : expr->getArgs())
+    args.push_back(evaluate(arg));
 
-  interResult = builder.CreateCall(callee, args, "calltmp");
+  return builder.CreateCall(callee, args, "calltmp");
 }
 
-void CodeGen::visit(IntLiteralExpr *expr) {
-  auto *lit = llvm::ConstantInt::get(expr->getType()->toLLVMType(ctx),
-                                     expr->getValue());
-  interResult = lit;
+llvm::Value *CodeGen::visit(CastExpr *expr) {
+  auto *val = evaluate(expr->getExpr());
+  return builder.CreateCast(
+      IntSemantics::getCastOpcode(expr->getExpr()->getType(), expr->getType()),
+      val, getLLVMType(expr->getType()), "cast");
 }
 
-void CodeGen::visit(LoadExpr *expr) {
-  evaluate(expr->getExpr());
+llvm::Value *CodeGen::visit(IntLiteralExpr *expr) {
+  return llvm::ConstantInt::get(getLLVMType(expr->getType()),
+                                expr->getValue());
+}
+
+llvm::Value *CodeGen::visit(LoadExpr *expr) {
+  // Extract the bit of the loaded element from a bit vector.
+  if (auto *array = getPackedArray(expr->getExpr())) {
+    auto *access = llvm::cast<ArrayAccessExpr>(expr->getExpr());
+    llvm::Value *bit;
+    auto *addr = getPackedElement(access->getArray()->getType(), array,
+                                  getElementIndex(access), bit);
+    auto *byte = builder.CreateLoad(llvm::Type::getInt8Ty(ctx), addr);
+    return builder.CreateTrunc(builder.CreateLShr(byte, bit),
+                               llvm::Type::getInt1Ty(ctx));
+  }
+
+  auto *addr = evaluate(expr->getExpr());
 
   // Accessing an array variable should only happen when passing it through
   // funtion parameters. In that case, we extract the address of
@@ -187,57 +294,60 @@ void CodeGen::visit(LoadExpr *expr) {
   if (expr->getType()->getTypeKind() == Type::TypeKind::Array) {
     llvm::Value *zero = llvm::ConstantInt::get(llvm::Type::getInt64Ty(ctx),
                                                llvm::APInt::getZero(64));
-    llvm::ArrayRef<llvm::Value *> idxs = {zero, zero};
-    interResult = builder.CreateGEP(expr->getExpr()->getType()->toLLVMType(ctx),
-                                    interResult, idxs);
-  } else
-    interResult =
-        builder.CreateLoad(expr->getType()->toLLVMType(ctx), interResult);
-}
-
-void CodeGen::visit(PointerOpExpr *expr) {
-  auto kind = expr->getPointerOpKind();
-  if (kind == PointerOpExpr::PointerOpKind::AddressOf) {
-    // "&" returns the pointer to the variable, but since allocas ARE
-    // variable pointers, we just need to get the corresponding alloca.
-    evaluate(expr->getExpr());
-  } else {
-    evaluate(expr->getExpr());
-    auto *pointerTy = llvm::dyn_cast<PointerType>(expr->getExpr()->getType());
-    assert(pointerTy && "Dereferencing a non-pointer type.");
-
-    interResult = builder.CreateLoad(pointerTy->toLLVMType(ctx), interResult);
+    llvm::Value *idxs[] = {zero, zero};
+    return builder.CreateGEP(getLLVMType(expr->getExpr()->getType()), addr,
+                             idxs);
   }
+
+  return builder.CreateLoad(getLLVMType(expr->getType()), addr);
+}
+
+llvm::Value *CodeGen::visit(PointerOpExpr *expr) {
+  // "&" returns the pointer to the variable, but since allocas ARE
+  // variable pointers, we just need to get the corresponding alloca.
+  auto *val = evaluate(expr->getExpr());
+  if (expr->getPointerOpKind() == PointerOpExpr::PointerOpKind::AddressOf)
+    return val;
+
+  auto *pointerTy = llvm::dyn_cast<PointerType>(expr->getExpr()->getType());
+  assert(pointerTy && "Dereferencing a non-pointer type.");
+
+  return builder.CreateLoad(getLLVMType(pointerTy), val);
 }
 
-void CodeGen::visit(UnaryExpr *expr) {
-  evaluate(expr->getExpr());
+llvm::Value *CodeGen::visit(UnaryExpr *expr) {
+  auto *val = evaluate(expr->getExpr());
 
   switch (expr->getUnaryKind()) {
   case UnaryExpr::UnaryExprKind::NegArith:
-    interResult = builder.CreateNeg(interResult, "neg");
-    break;
+    return builder.CreateNeg(val, "neg");
   case UnaryExpr::UnaryExprKind::NegLogic:
-    interResult = builder.CreateNot(interResult, "not");
-    break;
+    return builder.CreateNot(val, "not");
   default:
     llvm_unreachable("Unexpected unary expression kind.");
   }
 }
 
-void CodeGen::visit(VarExpr *expr) {
-  auto *valAlloca = env->find(expr->getName());
+llvm::Value *CodeGen::visit(VarExpr *expr) {
+  auto *valAlloca = getValue(expr->getDecl());
   assert(valAlloca && "Undefined alloca");
 
-  interResult = valAlloca;
+  return valAlloca;
 }
 
 void CodeGen::visit(ExprStmt *stmt) { evaluate(stmt->getExpr()); }
 
 void CodeGen::visit(IfStmt *stmt) {
+  // Emit only the branch which is taken if the condition is constant.
+  if (auto *cond = llvm::dyn_cast<BoolLiteralExpr>(stmt->getCond())) {
+    for (auto *s : cond->getValue() ? stmt->getThenBody()
+                                    : stmt->getElseBody())
+      evaluate(s);
+    return;
+  }
+
   // Evalute the condition Value.
-  evaluate(stmt->getCond());
-  auto *cond = interResult;
+  auto *cond = evaluate(stmt->getCond());
 
   // Create the BBs. ElseBB is MergeBB if is no ELSE block.
   auto *thenBB = llvm::BasicBlock::Create(ctx, "then", currFun);
@@ -251,24 +361,16 @@ void CodeGen::visit(IfStmt *stmt) {
 
   // Emit the THEN block.
   setCurrBB(thenBB);
-  // Use RAII to manage the lifetime of scopes.
-  {
-    ValueScopeMgr scopeMgr(*this);
-    for (auto thenStmt : stmt->getThenBody())
-      evaluate(thenStmt);
-  }
+  for (auto thenStmt : stmt->getThenBody())
+    evaluate(thenStmt);
   builder.CreateBr(mergeBB);
 
   // Emit the ELSE block.
   if (!stmt->getElseBody().empty()) {
     currFun->getBasicBlockList().push_back(elseBB);
     setCurrBB(elseBB);
-    // Use RAII to manage the lifetime of scopes.
-    {
-      ValueScopeMgr scopeMgr(*this);
-      for (auto elseStmt : stmt->getElseBody())
-        evaluate(elseStmt);
-    }
+    for (auto elseStmt : stmt->getElseBody())
+      evaluate(elseStmt);
     builder.CreateBr(mergeBB);
   }
 
@@ -278,25 +380,69 @@ void CodeGen::visit(IfStmt *stmt) {
 }
 
 void CodeGen::visit(PrintStmt *stmt) {
-  evaluate(stmt->getPrintExpr());
+  auto *val = evaluate(stmt->getPrintExpr());
+  auto *type = stmt->getPrintExpr()->getType();
+  auto *formatStr = printFormatStr;
+
+  // Integers and BOOLs are printed as 64-bit values.
+  if (llvm::isa<BasicType>(type)) {
+    val = extendToInt64(val, type);
+    if (type->isInteger() && !type->isSigned()) {
+      if (!printUnsignedFormatStr)
+        printUnsignedFormatStr = builder.CreateGlobalStringPtr(
+            llvm::StringRef("%llu\n"), "formatstr", 0, module.get());
+      formatStr = printUnsignedFormatStr;
+    }
+  }
 
-  builder.CreateCall(printFun, {printFormatStr, interResult}, "print");
+  builder.CreateCall(printFun, {formatStr, val}, "print");
 }
 
 void CodeGen::visit(ReturnStmt *stmt) {
-  evaluate(stmt->getRetExpr());
-
-  builder.CreateRet(interResult);
+  builder.CreateRet(evaluate(stmt->getRetExpr()));
 }
 
 void CodeGen::visit(ScanStmt *stmt) {
   // Get the alloca for the scanned variable and pass it as a scanf parameter.
-  evaluate(stmt->getScanVar());
+  auto *scanVar = evaluate(stmt->getScanVar());
+  auto *type = stmt->getScanVar()->getType();
+  if (!type->isInteger()) {
+    builder.CreateCall(scanFun, {scanFormatStr, scanVar}, "scan");
+    return;
+  }
+
+  auto *formatStr = scanFormatStr;
+  if (!type->isSigned()) {
+    if (!scanUnsignedFormatStr)
+      scanUnsignedFormatStr = builder.CreateGlobalStringPtr(
+          llvm::StringRef("%llu"), "formatstr", 0, module.get());
+    formatStr = scanUnsignedFormatStr;
+  }
 
-  builder.CreateCall(scanFun, {scanFormatStr, interResult}, "scan");
+  // Integers narrower than 64 bits are scanned into a temporary, and then
+  // truncated.
+  auto *llvmType = getLLVMType(type);
+  if (llvmType->getIntegerBitWidth() < 64) {
+    llvm::IRBuilder<> tmpBuilder(&currFun->getEntryBlock(),
+                                 currFun->getEntryBlock().begin());
+    auto *int64Ty = llvm::Type::getInt64Ty(ctx);
+    auto *tmp = tmpBuilder.CreateAlloca(int64Ty, 0, "scantmp");
+    builder.CreateCall(scanFun, {formatStr, tmp}, "scan");
+    builder.CreateStore(
+        builder.CreateTrunc(builder.CreateLoad(int64Ty, tmp), llvmType),
+        scanVar);
+    return;
+  }
+
+  builder.CreateCall(scanFun, {formatStr, scanVar}, "scan");
 }
 
 void CodeGen::visit(WhileStmt *stmt) {
+  // A loop which is never entered has no code.
+  auto *literalCond = llvm::dyn_cast<BoolLiteralExpr>(stmt->getCond());
+  if (literalCond && !literalCond->getValue())
+    return;
+
   // Create the BBs.
   auto *condBB = llvm::BasicBlock::Create(ctx, "cond", currFun);
   auto *bodyBB = llvm::BasicBlock::Create(ctx, "body");
@@ -309,19 +455,14 @@ void CodeGen::visit(WhileStmt *stmt) {
   // Emit the condition BB. We will always return to this BB after the body
   // finishes exection.
   setCurrBB(condBB);
-  evaluate(stmt->getCond());
-  auto *cond = interResult;
+  auto *cond = evaluate(stmt->getCond());
   builder.CreateCondBr(cond, bodyBB, mergeBB);
 
   // Emit the body block.
   currFun->getBasicBlockList().push_back(bodyBB);
   setCurrBB(bodyBB);
-  // Use RAII to manage the lifetime of scopes.
-  {
-    ValueScopeMgr scopeMgr(*this);
-    for (auto s : stmt->getBody())
-      evaluate(s);
-  }
+  for (auto s : stmt->getBody())
+    evaluate(s);
   // Branch to the condition BB.
   builder.CreateBr(condBB);
 
@@ -332,14 +473,14 @@ void CodeGen::visit(WhileStmt *stmt) {
 
 void CodeGen::visit(FunDecl *decl) {
   llvm::Function *fun =
-      llvm::dyn_cast<llvm::Function>(env->find(decl->getName()));
+      llvm::dyn_cast<llvm::Function>(getValue(decl));
   currFun = fun;
+  trapBB = nullptr;
 
   // Create the entry BB.
   llvm::BasicBlock *entryBB = llvm::BasicBlock::Create(ctx, "entry", fun);
   setCurrBB(entryBB);
 
-  ValueScopeMgr scopeMgr(*this);
   // Record the function arguments.
   auto declArg = decl->getArgs().begin();
   auto llvmArg = fun->args().begin();
@@ -350,7 +491,7 @@ void CodeGen::visit(FunDecl *decl) {
     auto *alloca =
         tmpBuilder.CreateAlloca(llvmArg->getType(), 0, (*declArg)->getName());
     tmpBuilder.CreateStore(llvmArg, alloca);
-    env->insert(alloca, (*declArg)->getName());
+    setValue(*declArg, alloca);
   }
 
   for (auto funDecl : decl->getBody())
@@ -358,7 +499,6 @@ void CodeGen::visit(FunDecl *decl) {
 }
 
 void CodeGen::visit(ModuleDecl *decl) {
-  ValueScopeMgr scopeMgr(*this);
   // Create a built-in PRINT/SCAN functions.
   createPrintScanFunctions();
 
@@ -367,7 +507,7 @@ void CodeGen::visit(ModuleDecl *decl) {
     if (auto *funDecl = llvm::dyn_cast<FunDecl>(dec)) {
       auto *funTy = createFunctionType(funDecl);
       auto *fun = createFunction(funDecl, funTy);
-      env->insert(fun, funDecl->getName());
+      setValue(funDecl, fun);
       // Emit all global variables.
     } else if (llvm::isa<VarDecl>(dec))
       evaluate(dec);
@@ -382,47 +522,180 @@ void CodeGen::visit(ModuleDecl *decl) {
   }
 }
 
+// Pack the elements of a constant BOOL array into a bit vector.
+static llvm::Constant *packBoolArray(llvm::LLVMContext &ctx,
+                                     llvm::Constant *init, uint64_t elNum) {
+  std::vector<uint8_t> bytes((elNum + 7) / 8);
+  for (uint64_t ind = 0; ind < elNum; ind++) {
+    auto *val = llvm::dyn_cast_or_null<llvm::ConstantInt>(
+        init->getAggregateElement(ind));
+    if (val && val->isOne())
+      bytes[ind / 8] |= 1 << (ind % 8);
+  }
+
+  return llvm::ConstantDataArray::get(ctx, bytes);
+}
+
+// Get the byte which every byte of the constant's memory holds, if there is
+// one. BOOLs are stored as bytes holding 0 or 1.
+static llvm::Optional<uint8_t> getSplatByte(llvm::Constant *init) {
+  if (init->isNullValue())
+    return uint8_t(0);
+
+  if (auto *val = llvm::dyn_cast<llvm::ConstantInt>(init)) {
+    auto &value = val->getValue();
+    if (value.getBitWidth() == 1)
+      return uint8_t(value.getZExtValue());
+    if (value.getBitWidth() % 8 || !value.isSplat(8))
+      return llvm::None;
+    return uint8_t(value.getLoBits(8).getZExtValue());
+  }
+
+  auto *arrayTy = llvm::dyn_cast<llvm::ArrayType>(init->getType());
+  if (!arrayTy)
+    return llvm::None;
+
+  llvm::Optional<uint8_t> splat;
+  for (uint64_t ind = 0; ind < arrayTy->getNumElements(); ind++) {
+    auto elSplat = getSplatByte(init->getAggregateElement(ind));
+    if (!elSplat || (splat && *splat != *elSplat))
+      return llvm::None;
+    splat = elSplat;
+  }
+
+  return splat;
+}
+
+// Get the constant array of the literals in the initializer, with zeros in
+// place of the other elements. The other elements are collected, with the
+// indices of their place in the array.
+llvm::Constant *
+CodeGen::getArrayInitConstant(ArrayInitExpr *init, const Type *type,
+                              std::vector<uint64_t> &indices,
+                              std::vector<ArrayInitStore> &stores) {
+  auto *elType = type->getSubtype();
+  std::vector<llvm::Constant *> vals;
+  for (uint64_t ind = 0; ind < init->getVals().size(); ind++) {
+    auto *val = init->getVals()[ind];
+    indices.push_back(ind);
+    if (auto *subInit = llvm::dyn_cast<ArrayInitExpr>(val))
+      vals.push_back(getArrayInitConstant(subInit, elType, indices, stores));
+    else if (llvm::isa<IntLiteralExpr>(val) || llvm::isa<BoolLiteralExpr>(val))
+      vals.push_back(llvm::cast<llvm::Constant>(evaluate(val)));
+    else {
+      vals.push_back(llvm::Constant::getNullValue(getLLVMType(elType)));
+      stores.push_back({indices, val});
+    }
+    indices.pop_back();
+  }
+
+  return llvm::ConstantArray::get(
+      llvm::cast<llvm::ArrayType>(getLLVMType(type)), vals);
+}
+
+// Initialize a local array from its initialization list. The literals are
+// set at once, by a memset if every byte of the array is the same, or by a
+// memcpy from a private constant otherwise. Only the elements which are not
+// literals are stored one by one, so the code stays the same size as the
+// array grows.
+void CodeGen::initLocalArray(VarDecl *decl, ArrayInitExpr *init,
+                             llvm::AllocaInst *alloca) {
+  std::vector<uint64_t> indices;
+  std::vector<ArrayInitStore> stores;
+  auto *constInit =
+      getArrayInitConstant(init, decl->getType(), indices, stores);
+
+  bool packed = isPackedArray(decl);
+  if (packed)
+    constInit = packBoolArray(
+        ctx, constInit, llvm::cast<ArrayType>(decl->getType())->getElNum());
+
+  // Nothing is left to set at once if no element is a literal.
+  auto &DL = module->getDataLayout();
+  auto size = DL.getTypeAllocSize(alloca->getAllocatedType());
+  auto align = alloca->getAlign();
+  uint64_t elNum = 1;
+  for (auto *type = decl->getType(); llvm::isa<ArrayType>(type);
+       type = type->getSubtype())
+    elNum = llvm::SaturatingMultiply(elNum,
+                                     llvm::cast<ArrayType>(type)->getElNum());
+  if (stores.size() < elNum) {
+    if (auto splat = getSplatByte(constInit)) {
+      builder.CreateMemSet(alloca, builder.getInt8(*splat), size, align);
+    } else {
+      auto *global = new llvm::GlobalVariable(
+          *module, constInit->getType(), /*isConstant*/ true,
+          llvm::GlobalValue::PrivateLinkage, constInit,
+          decl->getName() + ".init");
+      global->setUnnamedAddr(llvm::GlobalValue::UnnamedAddr::Global);
+      global->setAlignment(align);
+      builder.CreateMemCpy(alloca, align, global, align, size);
+    }
+  }
+
+  // Store the remaining elements in order.
+  auto *int64Ty = llvm::Type::getInt64Ty(ctx);
+  for (auto &store : stores) {
+    auto *source = evaluate(store.expr);
+    if (packed) {
+      storePackedElement(decl->getType(), alloca,
+                         llvm::ConstantInt::get(int64Ty, store.indices[0]),
+                         source);
+      continue;
+    }
+
+    std::vector<llvm::Value *> idxs = {llvm::ConstantInt::get(int64Ty, 0)};
+    for (auto ind : store.indices)
+      idxs.push_back(llvm::ConstantInt::get(int64Ty, ind));
+    builder.CreateStore(source,
+                        builder.CreateInBoundsGEP(alloca->getAllocatedType(),
+                                                  alloca, idxs));
+  }
+}
+
 void CodeGen::visit(VarDecl *decl) {
+  bool packed = isPackedArray(decl);
+  auto *llvmType = packed ? getPackedArrayType(decl->getType())
+                          : getLLVMType(decl->getType());
+
   if (decl->isGlobal()) {
     // Create a global variable, set the linkage to private...
-    module->getOrInsertGlobal(decl->getName(),
-                              decl->getType()->toLLVMType(ctx));
+    module->getOrInsertGlobal(decl->getName(), llvmType);
     auto *globalVar = module->getNamedGlobal(decl->getName());
     globalVar->setLinkage(llvm::GlobalValue::PrivateLinkage);
-    globalVar->setAlignment(
-        llvm::MaybeAlign(getModule()->getDataLayout().getPrefTypeAlignment(
-            decl->getType()->toLLVMType(ctx))));
-    // ... and register it in the scope manager.
-    env->insert(globalVar, decl->getName());
-
-    if (decl->getInitializer()) {
-      evaluate(decl->getInitializer());
-      globalVar->setInitializer(llvm::dyn_cast<llvm::Constant>(interResult));
+    globalVar->setAlignment(llvm::MaybeAlign(
+        getModule()->getDataLayout().getPrefTypeAlignment(llvmType)));
+    // ... and record it for the accesses to the variable.
+    setValue(decl, globalVar);
+
+    // The initializer was evaluated into literals by the semantic check.
+    if (decl->getEvaluatedInit()) {
+      auto *init =
+          llvm::cast<llvm::Constant>(evaluate(decl->getEvaluatedInit()));
+      if (packed && init)
+        init = packBoolArray(
+            ctx, init, llvm::cast<ArrayType>(decl->getType())->getElNum());
+      globalVar->setInitializer(init);
+    } else {
+      // Without an initializer, the global would only be declared.
+      globalVar->setInitializer(llvm::Constant::getNullValue(llvmType));
     }
   } else {
     // Create an alloca for this variable in the entry BB of the current
     // function...
     llvm::IRBuilder<> tmpBuilder(&currFun->getEntryBlock(),
                                  currFun->getEntryBlock().begin());
-    auto *alloca = tmpBuilder.CreateAlloca(decl->getType()->toLLVMType(ctx), 0,
-                                           decl->getName());
-    // ... and register it in the scope menager.
-    env->insert(alloca, decl->getName());
-
-    // Generate the code for the variable initializer (if it exists),
-    // and store the result in the alloca.
-    if (decl->getInitializer()) {
-      evaluate(decl->getInitializer());
-      builder.CreateStore(interResult, alloca);
-    }
-
-    // If this is a local variable of array type, and it has an initializer,
-    // lower the initialization into a list of expressions, each representing
-    // an assignment of an initialization expression to an array member.
-    if (decl->getLoweredArrayInit().size()) {
-      assert(!decl->getInitializer());
-      for (auto *expr : decl->getLoweredArrayInit())
-        evaluate(expr);
-    }
+    auto *alloca = tmpBuilder.CreateAlloca(llvmType, 0, decl->getName());
+    // ... and record it for the accesses to the variable.
+    setValue(decl, alloca);
+
+    // Arrays are initialized from their initialization lists in bulk.
+    // Otherwise, generate the code for the variable initializer (if it
+    // exists), and store the result in the alloca.
+    auto *init = decl->getInitializer();
+    if (auto *arrayInit = llvm::dyn_cast_or_null<ArrayInitExpr>(init))
+      initLocalArray(decl, arrayInit, alloca);
+    else if (init)
+      builder.CreateStore(evaluate(init), alloca);
   }
 }
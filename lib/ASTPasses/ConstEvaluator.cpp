@@ -0,0 +1,351 @@
+#include "ConstEvaluator.h"
+
+#include "llvm/Support/MathExtras.h"
+
+#include "IntSemantics.h"
+
+using namespace mxrlang;
+
+static std::string overflows(const Type *type) {
+  return "type " + type->toString() + " overflows";
+}
+
+// Record why the evaluation failed, unless that is already known.
+llvm::NoneType ConstEvaluator::fail(const std::string &reason) {
+  if (failure.empty())
+    failure = reason;
+  return llvm::None;
+}
+
+// Take steps out of the budget. Fails once it is exhausted.
+bool ConstEvaluator::step(uint64_t num) {
+  if (num <= budget.left) {
+    budget.left -= num;
+    return true;
+  }
+
+  fail("the module needs more than " + std::to_string(budget.max) + " steps");
+  return false;
+}
+
+// Get the values stored in the variable or the array element which the
+// expression refers to. Returns false if the evaluation failed.
+bool ConstEvaluator::getStorage(Expr *expr,
+                                llvm::MutableArrayRef<Value> &storage) {
+  if (auto *varExpr = llvm::dyn_cast<VarExpr>(expr)) {
+    auto *decl = varExpr->getDecl();
+    if (decl->isGlobal()) {
+      fail("a global variable is accessed");
+      return false;
+    }
+
+    // Only the variables of the interpreted functions have values.
+    if (!frames.empty()) {
+      auto found = frames.back().find(decl);
+      if (found != frames.back().end()) {
+        storage = found->second;
+        return true;
+      }
+    }
+
+    fail("variable " + decl->getName().str() + " is not a constant");
+    return false;
+  }
+
+  if (auto *arrayAccess = llvm::dyn_cast<ArrayAccessExpr>(expr)) {
+    // Arrays passed to functions are accessed through pointers.
+    auto *arrayTy =
+        llvm::dyn_cast<ArrayType>(arrayAccess->getArray()->getType());
+    if (!arrayTy) {
+      fail("a pointer is used");
+      return false;
+    }
+
+    auto index = evaluate(arrayAccess->getElement());
+    if (!index)
+      return false;
+
+    llvm::MutableArrayRef<Value> array;
+    if (!getStorage(arrayAccess->getArray(), array))
+      return false;
+
+    auto elNum = arrayTy->getElNum();
+    if ((arrayAccess->getElement()->getType()->isSigned() &&
+         index->isNegative()) ||
+        index->uge(elNum)) {
+      fail("an array index is out of bounds");
+      return false;
+    }
+
+    // Elements of an array of arrays are stored one after another.
+    auto elSize = array.size() / elNum;
+    storage = array.slice(index->getZExtValue() * elSize, elSize);
+    return true;
+  }
+
+  fail("a pointer is used");
+  return false;
+}
+
+ConstEvaluator::Value ConstEvaluator::visit(ArrayAccessExpr *expr) {
+  return fail("a pointer is used");
+}
+
+ConstEvaluator::Value ConstEvaluator::visit(ArrayInitExpr *expr) {
+  return fail("an initialization list is used as a value");
+}
+
+ConstEvaluator::Value ConstEvaluator::visit(AssignExpr *expr) {
+  auto value = evaluate(expr->getSource());
+  if (!value)
+    return llvm::None;
+
+  llvm::MutableArrayRef<Value> storage;
+  if (!getStorage(expr->getDest(), storage))
+    return llvm::None;
+
+  storage.front() = value;
+  return value;
+}
+
+ConstEvaluator::Value ConstEvaluator::visit(BinaryArithExpr *expr) {
+  auto lhs = evaluate(expr->getLeft());
+  auto rhs = evaluate(expr->getRight());
+  if (!lhs || !rhs)
+    return llvm::None;
+
+  llvm::APInt result;
+  switch (IntSemantics::compute(expr->getBinaryKind(), expr->getType(), *lhs,
+                                *rhs, result)) {
+  case IntSemantics::Error::None:
+    return result;
+  case IntSemantics::Error::Overflow:
+    return fail(overflows(expr->getType()));
+  case IntSemantics::Error::DivByZero:
+    return fail("division by zero");
+  }
+  llvm_unreachable("Unexpected error of an arithmetic operation.");
+}
+
+ConstEvaluator::Value ConstEvaluator::visit(BinaryLogicalExpr *expr) {
+  auto lhs = evaluate(expr->getLeft());
+  auto rhs = evaluate(expr->getRight());
+  if (!lhs || !rhs)
+    return llvm::None;
+
+  bool result;
+  switch (expr->getBinaryKind()) {
+  case BinaryLogicalExpr::BinaryLogicalExprKind::And:
+    result = lhs->getBoolValue() && rhs->getBoolValue();
+    break;
+  case BinaryLogicalExpr::BinaryLogicalExprKind::Or:
+    result = lhs->getBoolValue() || rhs->getBoolValue();
+    break;
+  default:
+    result = IntSemantics::compare(expr->getBinaryKind(),
+                                   expr->getLeft()->getType(), *lhs, *rhs);
+    break;
+  }
+
+  return llvm::APInt(1, result);
+}
+
+ConstEvaluator::Value ConstEvaluator::visit(BoolLiteralExpr *expr) {
+  return llvm::APInt(1, expr->getValue());
+}
+
+ConstEvaluator::Value ConstEvaluator::visit(CallExpr *expr) {
+  std::vector<llvm::APInt> args;
+  for (auto *arg : expr->getArgs()) {
+    auto value = evaluate(arg);
+    if (!value)
+      return llvm::None;
+    args.push_back(std::move(*value));
+  }
+
+  auto *fun = expr->getDecl();
+  if (!isChecked(fun))
+    return fail("function " + fun->getName().str() + " is still being checked");
+  if (frames.size() >= MaxCallDepth)
+    return fail("calls are nested more than " + std::to_string(MaxCallDepth) +
+                " deep");
+  if (!step())
+    return llvm::None;
+
+  // The arguments are the first local variables of the function.
+  Frame frame;
+  for (size_t argNum = 0; argNum < args.size(); ++argNum)
+    frame[fun->getArgs()[argNum]].emplace_back(std::move(args[argNum]));
+
+  frames.push_back(std::move(frame));
+  run(fun->getBody());
+  frames.pop_back();
+
+  if (!failure.empty())
+    return llvm::None;
+  if (!returning)
+    return fail("function " + fun->getName().str() +
+                " ends without returning");
+
+  returning = false;
+  return std::move(retValue);
+}
+
+ConstEvaluator::Value ConstEvaluator::visit(CastExpr *expr) {
+  auto value = evaluate(expr->getExpr());
+  if (!value)
+    return llvm::None;
+
+  return IntSemantics::convert(*value, expr->getExpr()->getType(),
+                               expr->getType());
+}
+
+ConstEvaluator::Value ConstEvaluator::visit(IntLiteralExpr *expr) {
+  return llvm::APInt(expr->getType()->getWidth(), expr->getValue());
+}
+
+ConstEvaluator::Value ConstEvaluator::visit(LoadExpr *expr) {
+  // Loading an array decays it to a pointer.
+  if (llvm::isa<ArrayType>(expr->getType()))
+    return fail("an array is passed to a function");
+
+  llvm::MutableArrayRef<Value> storage;
+  if (!getStorage(expr->getExpr(), storage))
+    return llvm::None;
+
+  if (!storage.front()) {
+    auto *varExpr = expr->getExpr();
+    while (auto *arrayAccess = llvm::dyn_cast<ArrayAccessExpr>(varExpr))
+      varExpr = arrayAccess->getArray();
+    return fail("variable " +
+                llvm::cast<VarExpr>(varExpr)->getName().str() +
+                " is read before it is assigned");
+  }
+
+  return storage.front();
+}
+
+ConstEvaluator::Value ConstEvaluator::visit(PointerOpExpr *expr) {
+  return fail("a pointer is used");
+}
+
+ConstEvaluator::Value ConstEvaluator::visit(UnaryExpr *expr) {
+  auto value = evaluate(expr->getExpr());
+  if (!value)
+    return llvm::None;
+
+  if (expr->getUnaryKind() == UnaryExpr::UnaryExprKind::NegLogic)
+    return ~*value;
+
+  auto *literal = llvm::dyn_cast<IntLiteralExpr>(expr->getExpr());
+  bool isMagnitude = literal && !literal->isFolded();
+  llvm::APInt result;
+  if (IntSemantics::negate(expr->getType(), *value, isMagnitude, result) !=
+      IntSemantics::Error::None)
+    return fail(overflows(expr->getType()));
+  return result;
+}
+
+ConstEvaluator::Value ConstEvaluator::visit(VarExpr *expr) {
+  return fail("a pointer is used");
+}
+
+void ConstEvaluator::visit(ExprStmt *stmt) { evaluate(stmt->getExpr()); }
+
+void ConstEvaluator::visit(IfStmt *stmt) {
+  auto cond = evaluate(stmt->getCond());
+  if (!cond)
+    return;
+
+  run(cond->getBoolValue() ? stmt->getThenBody() : stmt->getElseBody());
+}
+
+void ConstEvaluator::visit(PrintStmt *stmt) { fail("a value is printed"); }
+
+void ConstEvaluator::visit(ReturnStmt *stmt) {
+  retValue = evaluate(stmt->getRetExpr());
+  returning = retValue.hasValue();
+}
+
+void ConstEvaluator::visit(ScanStmt *stmt) { fail("a value is scanned"); }
+
+void ConstEvaluator::visit(WhileStmt *stmt) {
+  while (!returning && step()) {
+    auto cond = evaluate(stmt->getCond());
+    if (!cond || !cond->getBoolValue())
+      return;
+
+    run(stmt->getBody());
+    if (!failure.empty())
+      return;
+  }
+}
+
+void ConstEvaluator::visit(VarDecl *decl) {
+  // Every element of an array counts as a step, which bounds the memory
+  // taken by the arrays. The number of elements saturates, so that an array
+  // too large to count runs out of steps.
+  uint64_t size = 1;
+  for (auto *type = decl->getType(); llvm::isa<ArrayType>(type);
+       type = type->getSubtype())
+    size = llvm::SaturatingMultiply(size,
+                                   llvm::cast<ArrayType>(type)->getElNum());
+  if (!step(size))
+    return;
+
+  // The variable is uninitialized, unless it has an initializer.
+  auto &storage = frames.back()[decl];
+  storage.assign(size, llvm::None);
+  auto *initializer = decl->getInitializer();
+  if (!initializer)
+    return;
+
+  if (auto *init = llvm::dyn_cast<ArrayInitExpr>(initializer)) {
+    initArray(init, storage);
+    return;
+  }
+
+  auto value = evaluate(initializer);
+  if (value)
+    storage.front() = std::move(value);
+}
+
+// Store the values of the initialization list into the flattened storage of
+// the array, in order. Returns false if the evaluation failed.
+bool ConstEvaluator::initArray(ArrayInitExpr *init,
+                               llvm::MutableArrayRef<Value> storage) {
+  auto elSize = storage.size() / init->getVals().size();
+  for (size_t idx = 0; idx < init->getVals().size(); ++idx) {
+    auto *val = init->getVals()[idx];
+    auto elStorage = storage.slice(idx * elSize, elSize);
+    if (auto *subInit = llvm::dyn_cast<ArrayInitExpr>(val)) {
+      if (!initArray(subInit, elStorage))
+        return false;
+      continue;
+    }
+
+    auto value = evaluate(val);
+    if (!value)
+      return false;
+    elStorage.front() = std::move(value);
+  }
+
+  return true;
+}
+
+// Interpret a list of statements, until the function returns or the
+// evaluation fails.
+void ConstEvaluator::run(Nodes &nodes) {
+  for (auto *node : nodes) {
+    if (returning || !failure.empty() || !step())
+      return;
+    evaluate(node);
+  }
+}
+
+ConstEvaluator::Value ConstEvaluator::evaluateConst(Expr *expr) {
+  auto value = evaluate(expr);
+  if (!failure.empty())
+    return llvm::None;
+  return value;
+}
@@ -0,0 +1,212 @@
+#include "ConstantFolder.h"
+
+#include "IntSemantics.h"
+
+using namespace mxrlang;
+
+// Get the value of an integer literal, in the width of its type.
+llvm::APInt ConstantFolder::getValue(IntLiteralExpr *literal) {
+  auto *type = literal->getType();
+  return llvm::APInt(type->getWidth(), literal->getValue(), type->isSigned());
+}
+
+// Create a folded literal of the given integer type. The value is stored
+// extended to 64 bits, according to the sign of the type.
+Expr *ConstantFolder::createLiteral(const llvm::APInt &value, Type *type,
+                                    SourceLoc loc) {
+  auto *literal = ctx.create<IntLiteralExpr>(
+      type->isSigned() ? value.getSExtValue() : value.getZExtValue(), loc);
+  literal->setType(type);
+  literal->setFolded();
+  return literal;
+}
+
+Expr *ConstantFolder::visit(ArrayAccessExpr *expr) {
+  expr->setArray(evaluate(expr->getArray()));
+  expr->setElement(evaluate(expr->getElement()));
+  return expr;
+}
+
+Expr *ConstantFolder::visit(ArrayInitExpr *expr) {
+  for (auto &val : expr->getVals())
+    val = evaluate(val);
+  return expr;
+}
+
+Expr *ConstantFolder::visit(AssignExpr *expr) {
+  expr->setDest(evaluate(expr->getDest()));
+  expr->setSource(evaluate(expr->getSource()));
+  return expr;
+}
+
+Expr *ConstantFolder::visit(BinaryArithExpr *expr) {
+  expr->setLeft(evaluate(expr->getLeft()));
+  expr->setRight(evaluate(expr->getRight()));
+
+  auto *left = llvm::dyn_cast<IntLiteralExpr>(expr->getLeft());
+  auto *right = llvm::dyn_cast<IntLiteralExpr>(expr->getRight());
+  if (!left || !right)
+    return expr;
+
+  llvm::APInt result;
+  switch (IntSemantics::compute(expr->getBinaryKind(), expr->getType(),
+                                getValue(left), getValue(right), result)) {
+  case IntSemantics::Error::None:
+    return createLiteral(result, expr->getType(), expr->getLoc());
+  case IntSemantics::Error::Overflow:
+    diag.report(expr->getLoc(), DiagID::err_const_overflow,
+                expr->getType()->toString());
+    return expr;
+  case IntSemantics::Error::DivByZero:
+    diag.report(expr->getLoc(), DiagID::err_const_div_by_zero);
+    return expr;
+  }
+  llvm_unreachable("Unexpected error of an arithmetic operation.");
+}
+
+Expr *ConstantFolder::visit(BinaryLogicalExpr *expr) {
+  expr->setLeft(evaluate(expr->getLeft()));
+  expr->setRight(evaluate(expr->getRight()));
+
+  // Operands are either both BOOL, or both of the same integer type.
+  bool result;
+  auto kind = expr->getBinaryKind();
+  auto *leftBool = llvm::dyn_cast<BoolLiteralExpr>(expr->getLeft());
+  auto *rightBool = llvm::dyn_cast<BoolLiteralExpr>(expr->getRight());
+  auto *leftInt = llvm::dyn_cast<IntLiteralExpr>(expr->getLeft());
+  auto *rightInt = llvm::dyn_cast<IntLiteralExpr>(expr->getRight());
+  if (leftBool && rightBool) {
+    bool lhs = leftBool->getValue();
+    bool rhs = rightBool->getValue();
+    switch (kind) {
+    case BinaryLogicalExpr::BinaryLogicalExprKind::And:
+      result = lhs && rhs;
+      break;
+    case BinaryLogicalExpr::BinaryLogicalExprKind::Eq:
+      result = lhs == rhs;
+      break;
+    case BinaryLogicalExpr::BinaryLogicalExprKind::NotEq:
+      result = lhs != rhs;
+      break;
+    case BinaryLogicalExpr::BinaryLogicalExprKind::Or:
+      result = lhs || rhs;
+      break;
+    default:
+      return expr;
+    }
+  } else if (leftInt && rightInt) {
+    result = IntSemantics::compare(kind, leftInt->getType(), getValue(leftInt),
+                                   getValue(rightInt));
+  } else
+    return expr;
+
+  return ctx.create<BoolLiteralExpr>(result, expr->getLoc());
+}
+
+Expr *ConstantFolder::visit(CallExpr *expr) {
+  for (auto &arg : expr->getArgs())
+    arg = evaluate(arg);
+  return expr;
+}
+
+Expr *ConstantFolder::visit(CastExpr *expr) {
+  expr->setExpr(evaluate(expr->getExpr()));
+
+  auto *literal = llvm::dyn_cast<IntLiteralExpr>(expr->getExpr());
+  if (!literal)
+    return expr;
+
+  auto value = IntSemantics::convert(getValue(literal), literal->getType(),
+                                     expr->getType());
+  return createLiteral(value, expr->getType(), expr->getLoc());
+}
+
+Expr *ConstantFolder::visit(LoadExpr *expr) {
+  expr->setExpr(evaluate(expr->getExpr()));
+  return expr;
+}
+
+Expr *ConstantFolder::visit(PointerOpExpr *expr) {
+  expr->setExpr(evaluate(expr->getExpr()));
+  return expr;
+}
+
+Expr *ConstantFolder::visit(UnaryExpr *expr) {
+  expr->setExpr(evaluate(expr->getExpr()));
+
+  if (auto *literal = llvm::dyn_cast<BoolLiteralExpr>(expr->getExpr()))
+    return ctx.create<BoolLiteralExpr>(!literal->getValue(), expr->getLoc());
+
+  auto *literal = llvm::dyn_cast<IntLiteralExpr>(expr->getExpr());
+  if (!literal)
+    return expr;
+
+  auto *type = expr->getType();
+  llvm::APInt value;
+  if (IntSemantics::negate(type, getValue(literal), !literal->isFolded(),
+                           value) != IntSemantics::Error::None) {
+    diag.report(expr->getLoc(), DiagID::err_const_overflow, type->toString());
+    return expr;
+  }
+
+  return createLiteral(value, type, expr->getLoc());
+}
+
+void ConstantFolder::visit(ExprStmt *stmt) {
+  stmt->setExpr(evaluate(stmt->getExpr()));
+}
+
+void ConstantFolder::visit(IfStmt *stmt) {
+  stmt->setCond(evaluate(stmt->getCond()));
+
+  // Drop the branch which can never be taken.
+  if (auto *cond = llvm::dyn_cast<BoolLiteralExpr>(stmt->getCond())) {
+    if (cond->getValue())
+      stmt->getElseBody().clear();
+    else
+      stmt->getThenBody().clear();
+  }
+
+  foldAll(stmt->getThenBody());
+  foldAll(stmt->getElseBody());
+}
+
+void ConstantFolder::visit(PrintStmt *stmt) {
+  stmt->setPrintExpr(evaluate(stmt->getPrintExpr()));
+}
+
+void ConstantFolder::visit(ReturnStmt *stmt) {
+  if (stmt->getRetExpr())
+    stmt->setRetExpr(evaluate(stmt->getRetExpr()));
+}
+
+void ConstantFolder::visit(ScanStmt *stmt) {
+  stmt->setScanVar(evaluate(stmt->getScanVar()));
+}
+
+void ConstantFolder::visit(WhileStmt *stmt) {
+  stmt->setCond(evaluate(stmt->getCond()));
+
+  // Drop the body of a loop which is never entered.
+  auto *cond = llvm::dyn_cast<BoolLiteralExpr>(stmt->getCond());
+  if (cond && !cond->getValue())
+    stmt->getBody().clear();
+
+  foldAll(stmt->getBody());
+}
+
+void ConstantFolder::visit(FunDecl *decl) { foldAll(decl->getBody()); }
+
+void ConstantFolder::visit(ModuleDecl *decl) {
+  for (auto *dec : decl->getBody())
+    evaluate(dec);
+}
+
+void ConstantFolder::visit(VarDecl *decl) {
+  // The initializer of a global is already evaluated into literals.
+  if (decl->getEvaluatedInit())
+    return;
+
+  if (decl->getInitializer())
+    decl->setInitializer(evaluate(decl->getInitializer()));
+}
@@ -0,0 +1,210 @@
+#include "EffectAnalysis.h"
+
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/GraphTraits.h"
+#include "llvm/ADT/SCCIterator.h"
+#include <algorithm>
+
+using namespace mxrlang;
+
+namespace {
+// Node of the call graph of a module, with the effects of the code of the
+// function. Once the strongly connected component of the function is
+// visited, the effects include those of all the functions it calls.
+struct CallNode {
+  FunDecl *fun = nullptr;
+  FunDecl::MemoryEffect effect = FunDecl::MemoryEffect::None;
+  bool mayNotReturn = false;
+  std::vector<CallNode *> callees;
+};
+} // namespace
+
+namespace llvm {
+template <> struct GraphTraits<CallNode *> {
+  using NodeRef = CallNode *;
+  using ChildIteratorType = std::vector<CallNode *>::iterator;
+
+  static NodeRef getEntryNode(CallNode *node) { return node; }
+  static ChildIteratorType child_begin(NodeRef node) {
+    return node->callees.begin();
+  }
+  static ChildIteratorType child_end(NodeRef node) {
+    return node->callees.end();
+  }
+};
+} // namespace llvm
+
+// Record an access to the memory at the address. Only the accesses to the
+// local variables of the function, and to the elements of local arrays, have
+// no effect visible to the callers.
+void EffectAnalysis::access(Expr *addr, FunDecl::MemoryEffect effect) {
+  while (auto *arrayAccess = llvm::dyn_cast<ArrayAccessExpr>(addr)) {
+    if (!llvm::isa<ArrayType>(arrayAccess->getArray()->getType()))
+      break;
+    addr = arrayAccess->getArray();
+  }
+
+  auto *varExpr = llvm::dyn_cast<VarExpr>(addr);
+  if (!varExpr || varExpr->getDecl()->isGlobal())
+    addEffect(effect);
+}
+
+void EffectAnalysis::visit(ArrayAccessExpr *expr) {
+  evaluate(expr->getArray());
+  evaluate(expr->getElement());
+
+  // Arrays passed to functions are accessed through the pointer stored in
+  // the argument.
+  auto *arrayTy = llvm::dyn_cast<ArrayType>(expr->getArray()->getType());
+  if (!arrayTy)
+    access(expr->getArray(), FunDecl::MemoryEffect::Read);
+  else if (boundsCheck && !expr->isInBounds())
+    mayNotReturn = true;
+}
+
+void EffectAnalysis::visit(ArrayInitExpr *expr) {
+  for (auto *val : expr->getVals())
+    evaluate(val);
+}
+
+void EffectAnalysis::visit(AssignExpr *expr) {
+  evaluate(expr->getSource());
+  evaluate(expr->getDest());
+  access(expr->getDest(), FunDecl::MemoryEffect::Write);
+}
+
+void EffectAnalysis::visit(BinaryArithExpr *expr) {
+  evaluate(expr->getLeft());
+  evaluate(expr->getRight());
+}
+
+void EffectAnalysis::visit(BinaryLogicalExpr *expr) {
+  evaluate(expr->getLeft());
+  evaluate(expr->getRight());
+}
+
+void EffectAnalysis::visit(CallExpr *expr) {
+  for (auto *arg : expr->getArgs())
+    evaluate(arg);
+  callees.push_back(expr->getDecl());
+}
+
+void EffectAnalysis::visit(CastExpr *expr) { evaluate(expr->getExpr()); }
+
+void EffectAnalysis::visit(LoadExpr *expr) {
+  evaluate(expr->getExpr());
+
+  // Loading an array only decays it to a pointer.
+  if (!llvm::isa<ArrayType>(expr->getType()))
+    access(expr->getExpr(), FunDecl::MemoryEffect::Read);
+}
+
+void EffectAnalysis::visit(PointerOpExpr *expr) {
+  evaluate(expr->getExpr());
+
+  // Dereferencing loads the pointer.
+  if (expr->getPointerOpKind() == PointerOpExpr::PointerOpKind::Dereference)
+    access(expr->getExpr(), FunDecl::MemoryEffect::Read);
+}
+
+void EffectAnalysis::visit(UnaryExpr *expr) { evaluate(expr->getExpr()); }
+
+void EffectAnalysis::visit(ExprStmt *stmt) { evaluate(stmt->getExpr()); }
+
+void EffectAnalysis::visit(IfStmt *stmt) {
+  evaluate(stmt->getCond());
+  analyzeAll(stmt->getThenBody());
+  analyzeAll(stmt->getElseBody());
+}
+
+void EffectAnalysis::visit(PrintStmt *stmt) {
+  evaluate(stmt->getPrintExpr());
+  addEffect(FunDecl::MemoryEffect::Write);
+  mayNotReturn = true;
+}
+
+void EffectAnalysis::visit(ReturnStmt *stmt) {
+  if (stmt->getRetExpr())
+    evaluate(stmt->getRetExpr());
+}
+
+void EffectAnalysis::visit(ScanStmt *stmt) {
+  evaluate(stmt->getScanVar());
+  addEffect(FunDecl::MemoryEffect::Write);
+  mayNotReturn = true;
+}
+
+void EffectAnalysis::visit(WhileStmt *stmt) {
+  // The loop may never end.
+  mayNotReturn = true;
+  evaluate(stmt->getCond());
+  analyzeAll(stmt->getBody());
+}
+
+void EffectAnalysis::visit(VarDecl *decl) {
+  if (decl->getInitializer())
+    evaluate(decl->getInitializer());
+}
+
+// Analyze the code of the function, and collect the functions it calls.
+void EffectAnalysis::analyzeFunction(FunDecl *decl) {
+  effect = FunDecl::MemoryEffect::None;
+  mayNotReturn = false;
+  callees.clear();
+  analyzeAll(decl->getBody());
+}
+
+void EffectAnalysis::run(ModuleDecl *moduleDecl) {
+  // Build the call graph, whose root calls every function.
+  std::vector<CallNode> nodes;
+  for (auto *dec : moduleDecl->getBody())
+    if (auto *funDecl = llvm::dyn_cast<FunDecl>(dec)) {
+      nodes.emplace_back();
+      nodes.back().fun = funDecl;
+    }
+
+  llvm::DenseMap<FunDecl *, CallNode *> nodeOf;
+  CallNode root;
+  for (auto &node : nodes) {
+    nodeOf[node.fun] = &node;
+    root.callees.push_back(&node);
+  }
+
+  for (auto &node : nodes) {
+    analyzeFunction(node.fun);
+    node.effect = effect;
+    node.mayNotReturn = mayNotReturn;
+    for (auto *callee : callees)
+      node.callees.push_back(nodeOf[callee]);
+  }
+
+  // The strongly connected components are visited callees first, so the
+  // effects of the functions called from outside a component are complete.
+  // The functions in a component may call each other, and share the
+  // effects. Recursion may never end.
+  for (auto scc = llvm::scc_begin(&root); !scc.isAtEnd(); ++scc) {
+    auto &members = *scc;
+    if (members.front() == &root)
+      continue;
+
+    bool recursive = scc.hasCycle();
+    auto sccEffect = FunDecl::MemoryEffect::None;
+    bool sccMayNotReturn = recursive;
+    for (auto *node : members) {
+      for (auto *callee : node->callees) {
+        sccEffect = std::max(sccEffect, callee->effect);
+        sccMayNotReturn |= callee->mayNotReturn;
+      }
+      sccEffect = std::max(sccEffect, node->effect);
+      sccMayNotReturn |= node->mayNotReturn;
+    }
+
+    for (auto *node : members) {
+      node->effect = sccEffect;
+      node->mayNotReturn = sccMayNotReturn;
+      node->fun->setMemoryEffect(sccEffect);
+      node->fun->setWillReturn(!sccMayNotReturn);
+      node->fun->setRecursive(recursive);
+    }
+  }
+}
@@ -0,0 +1,128 @@
+#include "IntSemantics.h"
+
+#include "llvm/IR/Instructions.h"
+
+using namespace mxrlang;
+
+llvm::Instruction::BinaryOps
+IntSemantics::getOpcode(BinaryArithExpr::BinaryArithExprKind kind,
+                        const Type *type) {
+  switch (kind) {
+  case BinaryArithExpr::BinaryArithExprKind::Add:
+    return llvm::Instruction::Add;
+  case BinaryArithExpr::BinaryArithExprKind::Div:
+    return type->isSigned() ? llvm::Instruction::SDiv
+                            : llvm::Instruction::UDiv;
+  case BinaryArithExpr::BinaryArithExprKind::Mul:
+    return llvm::Instruction::Mul;
+  case BinaryArithExpr::BinaryArithExprKind::Sub:
+    return llvm::Instruction::Sub;
+  }
+  llvm_unreachable("Unexpected binary arithmetic expression kind.");
+}
+
+llvm::CmpInst::Predicate
+IntSemantics::getPredicate(BinaryLogicalExpr::BinaryLogicalExprKind kind,
+                           const Type *type) {
+  bool isSigned = type->isSigned();
+  switch (kind) {
+  case BinaryLogicalExpr::BinaryLogicalExprKind::Eq:
+    return llvm::CmpInst::ICMP_EQ;
+  case BinaryLogicalExpr::BinaryLogicalExprKind::Greater:
+    return isSigned ? llvm::CmpInst::ICMP_SGT : llvm::CmpInst::ICMP_UGT;
+  case BinaryLogicalExpr::BinaryLogicalExprKind::GreaterEq:
+    return isSigned ? llvm::CmpInst::ICMP_SGE : llvm::CmpInst::ICMP_UGE;
+  case BinaryLogicalExpr::BinaryLogicalExprKind::Less:
+    return isSigned ? llvm::CmpInst::ICMP_SLT : llvm::CmpInst::ICMP_ULT;
+  case BinaryLogicalExpr::BinaryLogicalExprKind::LessEq:
+    return isSigned ? llvm::CmpInst::ICMP_SLE : llvm::CmpInst::ICMP_ULE;
+  case BinaryLogicalExpr::BinaryLogicalExprKind::NotEq:
+    return llvm::CmpInst::ICMP_NE;
+  default:
+    return llvm::CmpInst::BAD_ICMP_PREDICATE;
+  }
+}
+
+llvm::Instruction::CastOps IntSemantics::getCastOpcode(const Type *from,
+                                                       const Type *to) {
+  auto fromWidth = from->getWidth();
+  auto toWidth = to->getWidth();
+  if (toWidth < fromWidth)
+    return llvm::Instruction::Trunc;
+  if (toWidth > fromWidth)
+    return from->isSigned() ? llvm::Instruction::SExt
+                            : llvm::Instruction::ZExt;
+  return llvm::Instruction::BitCast;
+}
+
+IntSemantics::Error
+IntSemantics::compute(BinaryArithExpr::BinaryArithExprKind kind,
+                      const Type *type, const llvm::APInt &lhs,
+                      const llvm::APInt &rhs, llvm::APInt &result) {
+  bool isSigned = type->isSigned();
+  bool overflow = false;
+  switch (getOpcode(kind, type)) {
+  case llvm::Instruction::Add:
+    result = isSigned ? lhs.sadd_ov(rhs, overflow) : lhs.uadd_ov(rhs, overflow);
+    break;
+  case llvm::Instruction::SDiv:
+    if (rhs.isZero())
+      return Error::DivByZero;
+    result = lhs.sdiv_ov(rhs, overflow);
+    break;
+  case llvm::Instruction::UDiv:
+    if (rhs.isZero())
+      return Error::DivByZero;
+    result = lhs.udiv(rhs);
+    break;
+  case llvm::Instruction::Mul:
+    result = isSigned ? lhs.smul_ov(rhs, overflow) : lhs.umul_ov(rhs, overflow);
+    break;
+  case llvm::Instruction::Sub:
+    result = isSigned ? lhs.ssub_ov(rhs, overflow) : lhs.usub_ov(rhs, overflow);
+    break;
+  default:
+    llvm_unreachable("Unexpected arithmetic instruction.");
+  }
+
+  return overflow ? Error::Overflow : Error::None;
+}
+
+bool IntSemantics::compare(BinaryLogicalExpr::BinaryLogicalExprKind kind,
+                           const Type *type, const llvm::APInt &lhs,
+                           const llvm::APInt &rhs) {
+  return llvm::ICmpInst::compare(lhs, rhs, getPredicate(kind, type));
+}
+
+IntSemantics::Error IntSemantics::negate(const Type *type,
+                                         const llvm::APInt &value,
+                                         bool isMagnitude,
+                                         llvm::APInt &result) {
+  // Only zero has an unsigned negation, and only the most negative value has
+  // no signed one.
+  if (type->isSigned() ? !isMagnitude && value.isMinSignedValue()
+                       : !value.isZero())
+    return Error::Overflow;
+
+  result = -value;
+  return Error::None;
+}
+
+llvm::APInt IntSemantics::convert(const llvm::APInt &value, const Type *from,
+                                  const Type *to) {
+  switch (getCastOpcode(from, to)) {
+  case llvm::Instruction::Trunc:
+    return value.trunc(to->getWidth());
+  case llvm::Instruction::SExt:
+    return value.sext(to->getWidth());
+  case llvm::Instruction::ZExt:
+    return value.zext(to->getWidth());
+  default:
+    return value;
+  }
+}
+
+llvm::ConstantRange IntSemantics::convert(const llvm::ConstantRange &range,
+                                          const Type *from, const Type *to) {
+  return range.castOp(getCastOpcode(from, to), to->getWidth());
+}
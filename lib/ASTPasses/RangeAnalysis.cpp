@@ -0,0 +1,367 @@
+#include "RangeAnalysis.h"
+
+#include "IntSemantics.h"
+
+using namespace mxrlang;
+
+// Check whether the ranges of the variable are tracked. Variables accessed
+// through pointers may change anywhere, e.g. in the called functions.
+bool RangeAnalysis::isTracked(const VarDecl *decl) {
+  return !decl->isGlobal() && !decl->isEscaping() &&
+         decl->getType()->isInteger();
+}
+
+// Get the tracked variable which the expression loads, or null.
+const VarDecl *RangeAnalysis::getLoadedVar(Expr *expr) {
+  auto *loadExpr = llvm::dyn_cast<LoadExpr>(expr);
+  if (!loadExpr)
+    return nullptr;
+
+  auto *varExpr = llvm::dyn_cast<VarExpr>(loadExpr->getExpr());
+  if (!varExpr || !isTracked(varExpr->getDecl()))
+    return nullptr;
+  return varExpr->getDecl();
+}
+
+// Get the range of the value of an integer or BOOL expression.
+llvm::ConstantRange RangeAnalysis::getRange(Expr *expr) {
+  auto range = evaluate(expr);
+  if (range)
+    return *range;
+  return llvm::ConstantRange::getFull(expr->getType()->getWidth());
+}
+
+// Get the range of the value of the expression in the current state, without
+// changing the state (e.g. by an assignment inside the expression) or
+// marking the accesses.
+llvm::ConstantRange RangeAnalysis::peekRange(Expr *expr) {
+  auto saved = state;
+  bool wasMarking = marking;
+  marking = false;
+  auto range = getRange(expr);
+  marking = wasMarking;
+  state = std::move(saved);
+  return range;
+}
+
+// Record the range of a tracked variable. Variables which may hold any value
+// are left out of the state.
+void RangeAnalysis::setRange(const VarDecl *decl,
+                             const llvm::ConstantRange &range) {
+  if (range.isFullSet()) {
+    state.ranges.erase(decl);
+  } else {
+    auto inserted = state.ranges.insert({decl, range});
+    if (!inserted.second)
+      inserted.first->second = range;
+  }
+
+  if (range.isEmptySet())
+    state.reachable = false;
+}
+
+// Narrow the ranges of the variables, given the value of the condition.
+void RangeAnalysis::refine(Expr *cond, bool value) {
+  if (auto *literal = llvm::dyn_cast<BoolLiteralExpr>(cond)) {
+    if (literal->getValue() != value)
+      state.reachable = false;
+    return;
+  }
+
+  if (auto *unary = llvm::dyn_cast<UnaryExpr>(cond)) {
+    if (unary->getUnaryKind() == UnaryExpr::UnaryExprKind::NegLogic)
+      refine(unary->getExpr(), !value);
+    return;
+  }
+
+  auto *binary = llvm::dyn_cast<BinaryLogicalExpr>(cond);
+  if (!binary)
+    return;
+
+  // Both operands of AND are true, and both operands of OR are false.
+  auto kind = binary->getBinaryKind();
+  if (kind == BinaryLogicalExpr::BinaryLogicalExprKind::And ||
+      kind == BinaryLogicalExpr::BinaryLogicalExprKind::Or) {
+    if (value == (kind == BinaryLogicalExpr::BinaryLogicalExprKind::And)) {
+      refine(binary->getLeft(), value);
+      refine(binary->getRight(), value);
+    }
+    return;
+  }
+
+  auto *left = binary->getLeft();
+  auto *right = binary->getRight();
+  if (!left->getType()->isInteger())
+    return;
+
+  auto pred = IntSemantics::getPredicate(kind, left->getType());
+  if (!value)
+    pred = llvm::CmpInst::getInversePredicate(pred);
+
+  // A variable compared to a value is narrowed to the values for which the
+  // comparison can hold.
+  auto lhs = peekRange(left);
+  auto rhs = peekRange(right);
+  if (auto *decl = getLoadedVar(left)) {
+    auto allowed = llvm::ConstantRange::makeAllowedICmpRegion(pred, rhs);
+    setRange(decl, lhs.intersectWith(allowed));
+  }
+  if (auto *decl = getLoadedVar(right)) {
+    auto allowed = llvm::ConstantRange::makeAllowedICmpRegion(
+        llvm::CmpInst::getSwappedPredicate(pred), lhs);
+    setRange(decl, rhs.intersectWith(allowed));
+  }
+}
+
+// Merge the state of another path into the current state. A variable keeps a
+// range only if it has one on both paths.
+void RangeAnalysis::join(const State &other) {
+  if (!other.reachable)
+    return;
+  if (!state.reachable) {
+    state = other;
+    return;
+  }
+
+  State joined;
+  for (auto &entry : state.ranges) {
+    auto found = other.ranges.find(entry.first);
+    if (found == other.ranges.end())
+      continue;
+
+    auto range = entry.second.unionWith(found->second);
+    if (!range.isFullSet())
+      joined.ranges.insert({entry.first, range});
+  }
+  state = std::move(joined);
+}
+
+// Widen the ranges of the current state which grew since the previous state.
+// The bounds which moved are set to the limits of the types, so that a loop
+// is analyzed only a few times.
+void RangeAnalysis::widen(const State &prev) {
+  if (!prev.reachable)
+    return;
+
+  State widened;
+  widened.reachable = state.reachable;
+  for (auto &entry : state.ranges) {
+    auto found = prev.ranges.find(entry.first);
+    if (found == prev.ranges.end())
+      continue;
+
+    auto &range = entry.second;
+    auto &prevRange = found->second;
+    auto width = range.getBitWidth();
+    llvm::APInt lower, upper;
+    if (entry.first->getType()->isSigned()) {
+      lower = range.getSignedMin().slt(prevRange.getSignedMin())
+                  ? llvm::APInt::getSignedMinValue(width)
+                  : range.getSignedMin();
+      upper = range.getSignedMax().sgt(prevRange.getSignedMax())
+                  ? llvm::APInt::getSignedMaxValue(width)
+                  : range.getSignedMax();
+    } else {
+      lower = range.getUnsignedMin().ult(prevRange.getUnsignedMin())
+                  ? llvm::APInt::getMinValue(width)
+                  : range.getUnsignedMin();
+      upper = range.getUnsignedMax().ugt(prevRange.getUnsignedMax())
+                  ? llvm::APInt::getMaxValue(width)
+                  : range.getUnsignedMax();
+    }
+
+    auto widenedRange = llvm::ConstantRange::getNonEmpty(lower, upper + 1);
+    if (!widenedRange.isFullSet())
+      widened.ranges.insert({entry.first, widenedRange});
+  }
+  state = std::move(widened);
+}
+
+RangeAnalysis::Range RangeAnalysis::visit(ArrayAccessExpr *expr) {
+  evaluate(expr->getArray());
+  auto index = getRange(expr->getElement());
+  if (!marking)
+    return llvm::None;
+
+  // Arrays accessed through pointers have no known size. Unreachable
+  // accesses need no checks.
+  auto *arrayTy = llvm::dyn_cast<ArrayType>(expr->getArray()->getType());
+  bool inBounds = false;
+  if (arrayTy && !state.reachable)
+    inBounds = true;
+  else if (arrayTy && expr->getElement()->getType()->isSigned())
+    inBounds = index.getSignedMin().isNonNegative() &&
+               index.getSignedMax().ult(arrayTy->getElNum());
+  else if (arrayTy)
+    inBounds = index.getUnsignedMax().ult(arrayTy->getElNum());
+  expr->setInBounds(inBounds);
+  return llvm::None;
+}
+
+RangeAnalysis::Range RangeAnalysis::visit(ArrayInitExpr *expr) {
+  for (auto *val : expr->getVals())
+    evaluate(val);
+  return llvm::None;
+}
+
+RangeAnalysis::Range RangeAnalysis::visit(AssignExpr *expr) {
+  auto *varExpr = llvm::dyn_cast<VarExpr>(expr->getDest());
+  if (!varExpr || !isTracked(varExpr->getDecl())) {
+    auto source = evaluate(expr->getSource());
+    evaluate(expr->getDest());
+    return source;
+  }
+
+  auto source = getRange(expr->getSource());
+  setRange(varExpr->getDecl(), source);
+  return source;
+}
+
+RangeAnalysis::Range RangeAnalysis::visit(BinaryArithExpr *expr) {
+  auto lhs = getRange(expr->getLeft());
+  auto rhs = getRange(expr->getRight());
+
+  return lhs.binaryOp(
+      IntSemantics::getOpcode(expr->getBinaryKind(), expr->getType()), rhs);
+}
+
+RangeAnalysis::Range RangeAnalysis::visit(BinaryLogicalExpr *expr) {
+  evaluate(expr->getLeft());
+  evaluate(expr->getRight());
+  return llvm::None;
+}
+
+RangeAnalysis::Range RangeAnalysis::visit(CallExpr *expr) {
+  for (auto *arg : expr->getArgs())
+    evaluate(arg);
+  return llvm::None;
+}
+
+RangeAnalysis::Range RangeAnalysis::visit(CastExpr *expr) {
+  return IntSemantics::convert(getRange(expr->getExpr()),
+                               expr->getExpr()->getType(), expr->getType());
+}
+
+RangeAnalysis::Range RangeAnalysis::visit(IntLiteralExpr *expr) {
+  auto *type = expr->getType();
+  return llvm::ConstantRange(
+      llvm::APInt(type->getWidth(), expr->getValue(), type->isSigned()));
+}
+
+RangeAnalysis::Range RangeAnalysis::visit(LoadExpr *expr) {
+  evaluate(expr->getExpr());
+  auto *decl = getLoadedVar(expr);
+  if (!decl)
+    return llvm::None;
+
+  auto found = state.ranges.find(decl);
+  if (found == state.ranges.end())
+    return llvm::None;
+  return found->second;
+}
+
+RangeAnalysis::Range RangeAnalysis::visit(PointerOpExpr *expr) {
+  evaluate(expr->getExpr());
+  return llvm::None;
+}
+
+RangeAnalysis::Range RangeAnalysis::visit(UnaryExpr *expr) {
+  if (expr->getUnaryKind() == UnaryExpr::UnaryExprKind::NegLogic) {
+    evaluate(expr->getExpr());
+    return llvm::None;
+  }
+
+  auto range = getRange(expr->getExpr());
+  return llvm::ConstantRange(llvm::APInt::getZero(range.getBitWidth()))
+      .sub(range);
+}
+
+void RangeAnalysis::visit(ExprStmt *stmt) { evaluate(stmt->getExpr()); }
+
+void RangeAnalysis::visit(IfStmt *stmt) {
+  evaluate(stmt->getCond());
+
+  auto elseState = state;
+  refine(stmt->getCond(), true);
+  analyzeAll(stmt->getThenBody());
+
+  std::swap(state, elseState);
+  refine(stmt->getCond(), false);
+  analyzeAll(stmt->getElseBody());
+  join(elseState);
+}
+
+void RangeAnalysis::visit(PrintStmt *stmt) {
+  evaluate(stmt->getPrintExpr());
+}
+
+void RangeAnalysis::visit(ReturnStmt *stmt) {
+  if (stmt->getRetExpr())
+    evaluate(stmt->getRetExpr());
+  state.reachable = false;
+}
+
+void RangeAnalysis::visit(ScanStmt *stmt) {
+  evaluate(stmt->getScanVar());
+  if (auto *varExpr = llvm::dyn_cast<VarExpr>(stmt->getScanVar()))
+    state.ranges.erase(varExpr->getDecl());
+}
+
+void RangeAnalysis::visit(WhileStmt *stmt) {
+  // Find the ranges at the start of the loop, which hold on every iteration,
+  // by analyzing the body until they are stable. The accesses in the body are
+  // marked only then.
+  bool wasMarking = marking;
+  marking = false;
+  auto head = state;
+  for (unsigned iteration = 1;; ++iteration) {
+    evaluate(stmt->getCond());
+    refine(stmt->getCond(), true);
+    analyzeAll(stmt->getBody());
+    join(head);
+    if (iteration > WideningDelay)
+      widen(head);
+    if (state == head)
+      break;
+    head = state;
+  }
+  marking = wasMarking;
+
+  if (marking) {
+    evaluate(stmt->getCond());
+    refine(stmt->getCond(), true);
+    analyzeAll(stmt->getBody());
+    state = head;
+  }
+
+  // The loop is left once the condition is false.
+  evaluate(stmt->getCond());
+  refine(stmt->getCond(), false);
+}
+
+void RangeAnalysis::visit(FunDecl *decl) {
+  // Nothing is known about the arguments.
+  state = State();
+  analyzeAll(decl->getBody());
+}
+
+void RangeAnalysis::visit(ModuleDecl *decl) {
+  // Initializers of globals are evaluated at compile time, and have no code.
+  for (auto *dec : decl->getBody())
+    if (llvm::isa<FunDecl>(dec))
+      evaluate(dec);
+}
+
+void RangeAnalysis::visit(VarDecl *decl) {
+  auto *init = decl->getInitializer();
+  if (!isTracked(decl)) {
+    if (init)
+      evaluate(init);
+    return;
+  }
+
+  // Uninitialized variables may hold any value.
+  setRange(decl, init ? getRange(init)
+                      : llvm::ConstantRange::getFull(
+                            decl->getType()->getWidth()));
+}
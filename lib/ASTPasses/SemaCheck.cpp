@@ -1,14 +1,117 @@
+#include "llvm/Support/ThreadPool.h"
+#include "llvm/Support/Threading.h"
+#include <algorithm>
+#include <limits>
+#include <memory>
+
+#include "ConstEvaluator.h"
 #include "SemaCheck.h"
 
 using namespace mxrlang;
 
-// Report an error and throw an exception if we exceed a certain number
-// of reported errors.
-void SemaCheck::error(llvm::SMLoc loc, DiagID diagID) {
-  diag.report(loc, diagID);
-  if (diag.getNumErrs() > MAX_SEMANTIC_ERRS)
-    throw SemaError();
-}
+namespace {
+// Collects the names of the functions called in a declaration which is not
+// checked yet.
+class CallCollector : public ASTVisitor<CallCollector> {
+  friend class ASTVisitor<CallCollector>;
+  using ASTVisitor<CallCollector>::visit;
+
+  llvm::SmallVectorImpl<IdentifierInfo *> &names;
+
+  // Whether only the array sizes of the declared variables are looked at.
+  bool arrayDimsOnly;
+
+  void collectAll(Nodes &nodes) {
+    for (auto *node : nodes)
+      evaluate(node);
+  }
+
+  void visit(ArrayAccessExpr *expr) {
+    evaluate(expr->getArray());
+    evaluate(expr->getElement());
+  }
+
+  void visit(ArrayInitExpr *expr) {
+    for (auto *val : expr->getVals())
+      evaluate(val);
+  }
+
+  void visit(AssignExpr *expr) {
+    evaluate(expr->getDest());
+    evaluate(expr->getSource());
+  }
+
+  void visit(BinaryArithExpr *expr) {
+    evaluate(expr->getLeft());
+    evaluate(expr->getRight());
+  }
+
+  void visit(BinaryLogicalExpr *expr) {
+    evaluate(expr->getLeft());
+    evaluate(expr->getRight());
+  }
+
+  void visit(CallExpr *expr) {
+    for (auto *arg : expr->getArgs())
+      evaluate(arg);
+    names.push_back(expr->getIdentifier());
+  }
+
+  void visit(CastExpr *expr) { evaluate(expr->getExpr()); }
+  void visit(LoadExpr *expr) { evaluate(expr->getExpr()); }
+  void visit(PointerOpExpr *expr) { evaluate(expr->getExpr()); }
+  void visit(UnaryExpr *expr) { evaluate(expr->getExpr()); }
+
+  void visit(ExprStmt *stmt) {
+    if (!arrayDimsOnly)
+      evaluate(stmt->getExpr());
+  }
+
+  void visit(IfStmt *stmt) {
+    if (!arrayDimsOnly)
+      evaluate(stmt->getCond());
+    collectAll(stmt->getThenBody());
+    collectAll(stmt->getElseBody());
+  }
+
+  void visit(PrintStmt *stmt) {
+    if (!arrayDimsOnly)
+      evaluate(stmt->getPrintExpr());
+  }
+
+  void visit(ReturnStmt *stmt) {
+    if (!arrayDimsOnly && stmt->getRetExpr())
+      evaluate(stmt->getRetExpr());
+  }
+
+  void visit(ScanStmt *stmt) {
+    if (!arrayDimsOnly)
+      evaluate(stmt->getScanVar());
+  }
+
+  void visit(WhileStmt *stmt) {
+    if (!arrayDimsOnly)
+      evaluate(stmt->getCond());
+    collectAll(stmt->getBody());
+  }
+
+  void visit(FunDecl *decl) { collectAll(decl->getBody()); }
+
+  void visit(VarDecl *decl) {
+    for (auto *dim : decl->getArrayDims())
+      evaluate(dim);
+    if (!arrayDimsOnly && decl->getInitializer())
+      evaluate(decl->getInitializer());
+  }
+
+public:
+  CallCollector(llvm::SmallVectorImpl<IdentifierInfo *> &names,
+                bool arrayDimsOnly)
+      : names(names), arrayDimsOnly(arrayDimsOnly) {}
+
+  void run(Decl *decl) { evaluate(decl); }
+};
+} // namespace
 
 // Check whether an expression is a valid assignment destination.
 // This is a recursive function, so we can access the expression through
@@ -42,7 +145,90 @@ bool SemaCheck::isValidAssignDest(Expr *expr, bool arrayAccessOrDeref) {
   return false;
 }
 
+// Check whether an integer literal, negated if negate is set, fits into the
+// integer type.
+static bool literalFits(uint64_t value, bool negate, Type *type) {
+  auto width = type->getWidth();
+  if (!type->isSigned())
+    return !negate && (width == 64 || value >> width == 0);
+
+  // The most negative value has no positive counterpart.
+  uint64_t max = (uint64_t(1) << (width - 1)) - 1;
+  return value <= max + (negate ? 1 : 0);
+}
+
+// Give an integer literal (possibly negated) the integer type which its
+// context expects, if the literal fits into it. Literals in initialization
+// lists are converted to the element type.
+void SemaCheck::convertLiteral(Expr *expr, Type *type) {
+  if (expr->getType() == type)
+    return;
+
+  if (auto *arrayInit = llvm::dyn_cast<ArrayInitExpr>(expr)) {
+    auto *arrayTy = llvm::dyn_cast<ArrayType>(type);
+    if (!arrayTy || arrayTy->getElNum() != arrayInit->getVals().size())
+      return;
+
+    bool converted = true;
+    for (auto *val : arrayInit->getVals()) {
+      convertLiteral(val, arrayTy->getSubtype());
+      converted &= val->getType() == arrayTy->getSubtype();
+    }
+
+    if (converted)
+      expr->setType(type);
+    return;
+  }
+
+  if (!type->isInteger())
+    return;
+
+  if (auto *literal = llvm::dyn_cast<IntLiteralExpr>(expr)) {
+    if (!literal->isFolded() && literalFits(literal->getValue(), false, type))
+      literal->setType(type);
+  } else if (auto *unary = llvm::dyn_cast<UnaryExpr>(expr)) {
+    auto *literal = llvm::dyn_cast<IntLiteralExpr>(unary->getExpr());
+    if (unary->getUnaryKind() == UnaryExpr::UnaryExprKind::NegArith &&
+        literal && !literal->isFolded() &&
+        literalFits(literal->getValue(), true, type)) {
+      literal->setType(type);
+      unary->setType(type);
+    }
+  }
+}
+
+// Report the large integer literals which don't fit into their types. Those
+// which their contexts converted to wider unsigned types fit, and so does the
+// magnitude of the most negative INT.
+void SemaCheck::checkLargeLiterals() {
+  for (auto &entry : largeLiterals) {
+    auto *literal = entry.first;
+    if (!literalFits(literal->getValue(), entry.second, literal->getType()))
+      error(literal->getLoc(), DiagID::err_int_literal_overflow,
+            literal->getType()->toString());
+  }
+  largeLiterals.clear();
+}
+
+// Mark the variable accessed by the expression as escaping, i.e. accessed
+// through a pointer.
+void SemaCheck::markEscaping(Expr *expr) {
+  while (auto *arrayAccess = llvm::dyn_cast<ArrayAccessExpr>(expr))
+    expr = arrayAccess->getArray();
+
+  auto *varExpr = llvm::dyn_cast<VarExpr>(expr);
+  if (!varExpr || !varExpr->getDecl())
+    return;
+
+  if (parent && varExpr->getDecl()->isGlobal())
+    escapingGlobals.push_back(varExpr->getDecl());
+  else
+    varExpr->getDecl()->setEscaping(true);
+}
+
 void SemaCheck::visit(ArrayAccessExpr *expr) {
+  resetType(expr);
+
   // We don't need to load an array before accessing it
   //
   // ArrayAccessExpr -> LoadExpr -> VarExpr
@@ -51,15 +237,12 @@ void SemaCheck::visit(ArrayAccessExpr *expr) {
   // ArrayAccessExpr -> VarExpr
   //
   // After accessing, we will load the value if needed.
-  if (auto *loadExpr = llvm::dyn_cast<LoadExpr>(expr->getArray())) {
+  if (auto *loadExpr = llvm::dyn_cast<LoadExpr>(expr->getArray()))
     expr->setArray(loadExpr->getExpr());
-    delete loadExpr;
-  }
 
-  // Element must be an INT.
+  // Element must be an integer.
   evaluate(expr->getElement());
-  if (!Type::checkTypesMatching(expr->getElement()->getType(),
-                                Type::getIntType()))
+  if (!expr->getElement()->getType()->isInteger())
     error(expr->getLoc(), DiagID::err_array_access_not_int);
 
   // We can only access expressions of array or pointer type.
@@ -72,11 +255,24 @@ void SemaCheck::visit(ArrayAccessExpr *expr) {
 }
 
 void SemaCheck::visit(ArrayInitExpr *expr) {
+  resetType(expr);
+
   for (auto *val : expr->getVals())
     evaluate(val);
 
-  // All vals must have the same type.
+  // All vals must have the same type. Literals take the type of the first
+  // value which is not a literal.
   auto *ty = expr->getVals().front()->getType();
+  for (auto *val : expr->getVals()) {
+    convertLiteral(val, ty);
+    if (val->getType() != ty) {
+      ty = val->getType();
+      break;
+    }
+  }
+  for (auto *val : expr->getVals())
+    convertLiteral(val, ty);
+
   if (std::any_of(expr->getVals().begin(), expr->getVals().end(),
                   [&](const Expr *val) {
                     return !Type::checkTypesMatching(val->getType(), ty, false);
@@ -85,18 +281,18 @@ void SemaCheck::visit(ArrayInitExpr *expr) {
     return;
   }
 
-  expr->setType(new ArrayType(ty, expr->getVals().size()));
+  expr->setType(ArrayType::get(ctx, ty, expr->getVals().size()));
 }
 
 void SemaCheck::visit(AssignExpr *expr) {
+  resetType(expr);
+
   evaluate(expr->getSource());
 
   // If the destination is LoadExpr, remove it from the AST, since we do not
   // load the values we are assigning to.
-  if (auto *loadExpr = llvm::dyn_cast<LoadExpr>(expr->getDest())) {
+  if (auto *loadExpr = llvm::dyn_cast<LoadExpr>(expr->getDest()))
     expr->setDest(loadExpr->getExpr());
-    delete loadExpr;
-  }
 
   // Evaluating assignment destination.
   evaluate(expr->getDest());
@@ -105,6 +301,7 @@ void SemaCheck::visit(AssignExpr *expr) {
     return;
   }
 
+  convertLiteral(expr->getSource(), expr->getDest()->getType());
   if (!Type::checkTypesMatching(expr->getDest()->getType(),
                                 expr->getSource()->getType())) {
     error(expr->getLoc(), DiagID::err_incompatible_types);
@@ -115,14 +312,18 @@ void SemaCheck::visit(AssignExpr *expr) {
 }
 
 void SemaCheck::visit(BinaryArithExpr *expr) {
+  resetType(expr);
+
   evaluate(expr->getLeft());
   evaluate(expr->getRight());
 
+  // A literal operand takes the type of the other operand.
+  convertLiteral(expr->getRight(), expr->getLeft()->getType());
+  convertLiteral(expr->getLeft(), expr->getRight()->getType());
+
   auto *leftTy = expr->getLeft()->getType();
   auto *rightTy = expr->getRight()->getType();
-  if (!Type::checkTypesMatching(leftTy, Type::getIntType()) ||
-      !Type::checkTypesMatching(rightTy, Type::getIntType()) ||
-      !Type::checkTypesMatching(leftTy, rightTy)) {
+  if (!leftTy->isInteger() || !Type::checkTypesMatching(leftTy, rightTy)) {
     error(expr->getLoc(), DiagID::err_arith_type);
     return;
   }
@@ -131,9 +332,15 @@ void SemaCheck::visit(BinaryArithExpr *expr) {
 }
 
 void SemaCheck::visit(BinaryLogicalExpr *expr) {
+  resetType(expr);
+
   evaluate(expr->getLeft());
   evaluate(expr->getRight());
 
+  // A literal operand takes the type of the other operand.
+  convertLiteral(expr->getRight(), expr->getLeft()->getType());
+  convertLiteral(expr->getLeft(), expr->getRight()->getType());
+
   auto *leftTy = expr->getLeft()->getType();
   auto *rightTy = expr->getRight()->getType();
   auto kind = expr->getBinaryKind();
@@ -156,9 +363,7 @@ void SemaCheck::visit(BinaryLogicalExpr *expr) {
 
     expr->setType(Type::getBoolType());
   } else {
-    if (!Type::checkTypesMatching(leftTy, Type::getIntType()) ||
-        !Type::checkTypesMatching(rightTy, Type::getIntType()) ||
-        !Type::checkTypesMatching(leftTy, rightTy)) {
+    if (!leftTy->isInteger() || !Type::checkTypesMatching(leftTy, rightTy)) {
       error(expr->getLoc(), DiagID::err_arith_type);
       return;
     }
@@ -168,8 +373,15 @@ void SemaCheck::visit(BinaryLogicalExpr *expr) {
 }
 
 void SemaCheck::visit(CallExpr *expr) {
+  resetType(expr);
+  expr->setDecl(nullptr);
+
+  // Process the arguments first, as the operands of the other operators.
+  for (auto *callArg : expr->getArgs())
+    evaluate(callArg);
+
   // Function should be declared at the module level.
-  auto *funDecl = env->find(expr->getName());
+  auto *funDecl = env.find(expr->getIdentifier());
   if (!funDecl) {
     error(expr->getLoc(), DiagID::err_fun_undefined);
     return;
@@ -177,6 +389,7 @@ void SemaCheck::visit(CallExpr *expr) {
 
   FunDecl *funDeclCast = llvm::dyn_cast<FunDecl>(funDecl);
   assert(funDeclCast && "This must be a FunDecl.");
+  expr->setDecl(funDeclCast);
 
   // Function call and declaration must have a matching number of
   // arguments.
@@ -190,8 +403,7 @@ void SemaCheck::visit(CallExpr *expr) {
     auto *callArg = expr->getArgs().at(argNum);
     auto *declArg = funDeclCast->getArgs().at(argNum);
 
-    // Process the argument.
-    evaluate(callArg);
+    convertLiteral(callArg, declArg->getType());
 
     if (!Type::checkTypesMatching(callArg->getType(), declArg->getType()))
       error(expr->getLoc(), DiagID::err_arg_type_mismatch);
@@ -200,12 +412,42 @@ void SemaCheck::visit(CallExpr *expr) {
   expr->setType(funDeclCast->getRetType());
 }
 
+void SemaCheck::visit(CastExpr *expr) {
+  resetType(expr);
+
+  evaluate(expr->getExpr());
+  if (!expr->getExpr()->getType()->isInteger() ||
+      !expr->getDestType()->isInteger()) {
+    error(expr->getLoc(), DiagID::err_cast_type);
+    return;
+  }
+
+  expr->setType(expr->getDestType());
+}
+
+void SemaCheck::visit(IntLiteralExpr *expr) {
+  // The literal may have been converted by the previous check.
+  if (expr->isFolded())
+    return;
+
+  expr->setType(Type::getIntType());
+  if (expr->getValue() > uint64_t(std::numeric_limits<int64_t>::max()))
+    largeLiterals.push_back({expr, false});
+}
+
 void SemaCheck::visit(LoadExpr *expr) {
   evaluate(expr->getExpr());
   expr->setType(expr->getExpr()->getType());
+
+  // Loading an array decays it to a pointer to its first element.
+  if (llvm::isa<VarExpr>(expr->getExpr()) &&
+      llvm::isa<ArrayType>(expr->getType()))
+    markEscaping(expr->getExpr());
 }
 
 void SemaCheck::visit(PointerOpExpr *expr) {
+  resetType(expr);
+
   // We don't need to load a variable before dereferencing it/taking its
   // address.
   //
@@ -215,10 +457,8 @@ void SemaCheck::visit(PointerOpExpr *expr) {
   // PointerOpExpr -> VarExpr
   //
   // After dereferencing, we will load the value if needed.
-  if (auto *loadExpr = llvm::dyn_cast<LoadExpr>(expr->getExpr())) {
+  if (auto *loadExpr = llvm::dyn_cast<LoadExpr>(expr->getExpr()))
     expr->setExpr(loadExpr->getExpr());
-    delete loadExpr;
-  }
 
   auto *e = expr->getExpr();
   evaluate(e);
@@ -229,9 +469,10 @@ void SemaCheck::visit(PointerOpExpr *expr) {
       error(expr->getLoc(), DiagID::err_addrof_target_not_mem);
       return;
     }
+    markEscaping(e);
 
     auto *exprTy = e->getType();
-    expr->setType(new PointerType(exprTy));
+    expr->setType(PointerType::get(ctx, exprTy));
   } else {
     // We can only dereference expressions of pointer type.
     if (e->getType()->getTypeKind() != Type::TypeKind::Pointer) {
@@ -244,12 +485,20 @@ void SemaCheck::visit(PointerOpExpr *expr) {
 }
 
 void SemaCheck::visit(UnaryExpr *expr) {
+  resetType(expr);
+
   evaluate(expr->getExpr());
 
   auto exprTy = expr->getExpr()->getType();
   auto kind = expr->getUnaryKind();
   if (kind == UnaryExpr::UnaryExprKind::NegArith) {
-    if (!Type::checkTypesMatching(exprTy, Type::getIntType())) {
+    // A negated literal is the magnitude of a negative value. It is the last
+    // literal seen, since the operand was checked right before.
+    if (!largeLiterals.empty() &&
+        largeLiterals.back().first == expr->getExpr())
+      largeLiterals.back().second = true;
+
+    if (!exprTy->isInteger()) {
       error(expr->getLoc(), DiagID::err_arith_type);
       return;
     }
@@ -264,10 +513,13 @@ void SemaCheck::visit(UnaryExpr *expr) {
 }
 
 void SemaCheck::visit(VarExpr *expr) {
+  resetType(expr);
+  expr->setDecl(nullptr);
+
   // Report an error if we cannot find this declaration.
-  auto *varDecl = env->find(expr->getName());
+  auto *varDecl = env.find(expr->getIdentifier());
   if (!varDecl) {
-    diag.report(expr->getLoc(), DiagID::err_var_undefined);
+    error(expr->getLoc(), DiagID::err_var_undefined);
     return;
   }
 
@@ -275,6 +527,15 @@ void SemaCheck::visit(VarExpr *expr) {
   // declaration.
   auto *varDeclCast = llvm::dyn_cast<VarDecl>(varDecl);
   assert(varDeclCast && "This must be a VarDecl");
+  expr->setDecl(varDeclCast);
+
+  // A function checked up front may use a global whose array sizes are not
+  // computed yet.
+  if (varDeclCast->isGlobal() && varDeclCast->hasArrayDims() &&
+      !getRoot().upFront.count(varDeclCast)) {
+    error(expr->getLoc(), DiagID::err_array_size_not_computed);
+    return;
+  }
   expr->setType(varDeclCast->getType());
 }
 
@@ -289,14 +550,20 @@ void SemaCheck::visit(IfStmt *stmt) {
   // Use RAII to manage the lifetime of scopes.
   {
     SemaCheckScopeMgr ScopeMgr(*this);
-    for (auto *thenStmt : stmt->getThenBody())
+    for (auto *thenStmt : stmt->getThenBody()) {
+      if (aborted)
+        return;
       evaluate(thenStmt);
+    }
   }
 
   {
     SemaCheckScopeMgr ScopeMgr(*this);
-    for (auto *elseStmt : stmt->getElseBody())
+    for (auto *elseStmt : stmt->getElseBody()) {
+      if (aborted)
+        return;
       evaluate(elseStmt);
+    }
   }
 }
 
@@ -311,6 +578,7 @@ void SemaCheck::visit(ReturnStmt *stmt) {
   } else
     evaluate(stmt->getRetExpr());
 
+  convertLiteral(stmt->getRetExpr(), currFun->getRetType());
   if (!Type::checkTypesMatching(currFun->getRetType(),
                                 stmt->getRetExpr()->getType()))
     error(stmt->getLoc(), DiagID::err_ret_type_mismatch);
@@ -321,10 +589,9 @@ void SemaCheck::visit(ScanStmt *stmt) {
 
   // Don't load an expression here, because the expression being scanned
   // is essentially being assigned to.
-  if (auto *loadExpr = llvm::dyn_cast<LoadExpr>(stmt->getScanVar())) {
+  if (auto *loadExpr = llvm::dyn_cast<LoadExpr>(stmt->getScanVar()))
     stmt->setScanVar(loadExpr->getExpr());
-    delete loadExpr;
-  }
+  markEscaping(stmt->getScanVar());
 }
 
 void SemaCheck::visit(WhileStmt *stmt) {
@@ -336,12 +603,21 @@ void SemaCheck::visit(WhileStmt *stmt) {
   // Use RAII to manage the lifetime of scopes.
   {
     SemaCheckScopeMgr ScopeMgr(*this);
-    for (auto *s : stmt->getBody())
+    for (auto *s : stmt->getBody()) {
+      if (aborted)
+        return;
       evaluate(s);
+    }
   }
 }
 
 void SemaCheck::visit(FunDecl *decl) {
+  // Skip the functions which were already checked up front.
+  auto found = getRoot().upFront.find(decl);
+  if (found != getRoot().upFront.end() &&
+      found->second != UpFrontState::Checking)
+    return;
+
   SemaCheckScopeMgr scopeMgr(*this);
 
   currFun = decl;
@@ -353,8 +629,11 @@ void SemaCheck::visit(FunDecl *decl) {
   for (auto arg : decl->getArgs())
     evaluate(arg);
 
-  for (auto st : decl->getBody())
+  for (auto st : decl->getBody()) {
+    if (aborted)
+      return;
     evaluate(st);
+  }
 
   // Return value must not be of array type.
   if (decl->getRetType()->getTypeKind() == Type::TypeKind::Array)
@@ -363,95 +642,320 @@ void SemaCheck::visit(FunDecl *decl) {
   // Every function must have a return statement.
   if (!seenReturn)
     error(decl->getLoc(), DiagID::err_no_return);
+
+  checkLargeLiterals();
+}
+
+// Number the top-level declarations of the module, and forward declare them
+// in the current scope.
+void SemaCheck::declareModule(ModuleDecl *decl) {
+  numDecls = 0;
+  for (auto dec : decl->getBody()) {
+    assignIndex(dec);
+
+    // Globals may be used before their declarations are checked.
+    if (auto *varDecl = llvm::dyn_cast<VarDecl>(dec))
+      varDecl->setEscaping(false);
+
+    // Report an error if this is a redefinition.
+    if (!env.insert(dec, dec->getIdentifier())) {
+      DiagID errId = llvm::isa<FunDecl>(dec) ? DiagID::err_fun_redefine
+                                             : DiagID::err_var_redefine;
+      error(dec->getLoc(), errId);
+    }
+    if (aborted)
+      return;
+  }
+
+  // The types of the globals must be known before their uses are checked,
+  // so their array sizes are computed now. The functions which the sizes
+  // call are checked first, and so are the functions called by the sizes of
+  // local arrays, since they may be checked on other threads.
+  upFront.clear();
+  for (auto *dec : decl->getBody()) {
+    llvm::SmallVector<IdentifierInfo *, 8> names;
+    if (auto *varDecl = llvm::dyn_cast<VarDecl>(dec)) {
+      if (!varDecl->hasArrayDims())
+        continue;
+      CallCollector(names, /* arrayDimsOnly= */ true).run(varDecl);
+      checkUpFront(names);
+
+      auto numErrs = diag.getNumErrs();
+      resolveArrayType(varDecl);
+      upFront[varDecl] = diag.getNumErrs() == numErrs ? UpFrontState::Checked
+                                                      : UpFrontState::Failed;
+    } else if (auto *funDecl = llvm::dyn_cast<FunDecl>(dec)) {
+      if (!funDecl->declaresComputedArrays())
+        continue;
+      CallCollector(names, /* arrayDimsOnly= */ true).run(funDecl);
+      checkUpFront(names);
+    }
+    if (aborted)
+      return;
+  }
+}
+
+// Check the functions with the given names up front, along with the
+// functions which they call.
+void SemaCheck::checkUpFront(llvm::ArrayRef<IdentifierInfo *> names) {
+  for (auto *name : names) {
+    auto *funDecl = llvm::dyn_cast_or_null<FunDecl>(env.find(name));
+    if (!funDecl || upFront.count(funDecl))
+      continue;
+
+    // The callees are checked first, so that the array sizes in the function
+    // can call them. Recursive calls find the function still being checked.
+    upFront[funDecl] = UpFrontState::Checking;
+    llvm::SmallVector<IdentifierInfo *, 8> callees;
+    CallCollector(callees, /* arrayDimsOnly= */ false).run(funDecl);
+    checkUpFront(callees);
+
+    auto numErrs = diag.getNumErrs();
+    evaluate(funDecl);
+    upFront[funDecl] = diag.getNumErrs() == numErrs ? UpFrontState::Checked
+                                                    : UpFrontState::Failed;
+    if (aborted)
+      return;
+  }
+}
+
+// Compute the array sizes of the variable, and set its type.
+void SemaCheck::resolveArrayType(VarDecl *decl) {
+  decl->setType(Type::getNoneType());
+
+  std::vector<uint64_t> elNums;
+  for (auto *dim : decl->getArrayDims()) {
+    auto numErrs = diag.getNumErrs();
+    evaluate(dim);
+    checkLargeLiterals();
+    if (diag.getNumErrs() != numErrs)
+      return;
+    if (!dim->getType()->isInteger()) {
+      error(dim->getLoc(), DiagID::err_array_size_not_int);
+      return;
+    }
+
+    ConstEvaluator evaluator(steps, [this](FunDecl *funDecl) {
+      return isCheckedUpFront(funDecl);
+    });
+    auto elNum = evaluator.evaluateConst(dim);
+    if (!elNum) {
+      error(dim->getLoc(), DiagID::err_array_size_not_const,
+            evaluator.getFailure());
+      return;
+    }
+    if (dim->getType()->isSigned() && elNum->isNegative()) {
+      error(dim->getLoc(), DiagID::err_array_size_negative);
+      return;
+    }
+    elNums.push_back(elNum->getZExtValue());
+  }
+
+  auto *type = decl->getArrayElType();
+  for (auto it = elNums.rbegin(); it != elNums.rend(); ++it)
+    type = ArrayType::get(ctx, type, *it);
+  decl->setType(type);
+}
+
+// Evaluate a checked initializer of a global into literals. Returns null
+// after reporting an error.
+Expr *SemaCheck::evaluateInit(Expr *init) {
+  if (auto *arrayInit = llvm::dyn_cast<ArrayInitExpr>(init)) {
+    Exprs vals;
+    for (auto *val : arrayInit->getVals()) {
+      auto *evaluated = evaluateInit(val);
+      if (!evaluated)
+        return nullptr;
+      vals.push_back(evaluated);
+    }
+
+    auto *evaluated =
+        ctx.create<ArrayInitExpr>(std::move(vals), init->getLoc());
+    evaluated->setType(init->getType());
+    return evaluated;
+  }
+
+  // Every function is checked by now.
+  ConstEvaluator evaluator(steps, [](FunDecl *) { return true; });
+  auto value = evaluator.evaluateConst(init);
+  if (!value) {
+    error(init->getLoc(), DiagID::err_global_init_not_const,
+          evaluator.getFailure());
+    return nullptr;
+  }
+
+  if (init->getType() == Type::getBoolType())
+    return ctx.create<BoolLiteralExpr>(value->getBoolValue(), init->getLoc());
+
+  auto *literal = ctx.create<IntLiteralExpr>(
+      init->getType()->isSigned() ? value->getSExtValue()
+                                  : value->getZExtValue(),
+      init->getLoc());
+  literal->setType(init->getType());
+  literal->setFolded();
+  return literal;
+}
+
+// Evaluate the initializers of the globals into literals, once the whole
+// module is checked.
+void SemaCheck::evaluateGlobals(ModuleDecl *decl) {
+  // Don't evaluate what failed the check.
+  if (aborted || diag.getNumErrs() > 0)
+    return;
+
+  for (auto *dec : decl->getBody()) {
+    auto *varDecl = llvm::dyn_cast<VarDecl>(dec);
+    if (!varDecl || !varDecl->getInitializer())
+      continue;
+
+    varDecl->setEvaluatedInit(evaluateInit(varDecl->getInitializer()));
+    if (aborted)
+      return;
+  }
+}
+
+// Tell the user that the check was aborted.
+void SemaCheck::reportAbort() {
+  // Render the reported errors before the abort notice, which has no
+  // location and would be sorted in front of them.
+  diag.flush();
+  diag.report(llvm::SMLoc(), DiagID::err_too_many_errors);
 }
 
 void SemaCheck::visit(ModuleDecl *decl) {
-  try {
+  {
     SemaCheckScopeMgr scopeMgr(*this);
     // Forward declare everything.
+    declareModule(decl);
+
     for (auto dec : decl->getBody()) {
-      // Report an error if this is a redefinition.
-      if (!env->insert(dec, dec->getName())) {
-        DiagID errId = llvm::isa<FunDecl>(dec) ? DiagID::err_fun_redefine
-                                               : DiagID::err_var_redefine;
-        error(dec->getLoc(), errId);
-      }
+      if (aborted)
+        break;
+      evaluate(dec);
     }
 
-    for (auto dec : decl->getBody())
-      evaluate(dec);
-  } catch (SemaError &e) {
-    llvm::errs() << "Exceeding maximum number of semantic errors. Aborting "
-                    "compilation...";
-    return;
+    evaluateGlobals(decl);
   }
+
+  if (aborted)
+    reportAbort();
 }
 
-// Lower the array initialization list into a list of assignments to
-// individual array elements.
-void SemaCheck::lowerArrayInit(Type *ty, ArrayInitExpr *init,
-                               std::vector<uint64_t> indices, Exprs &exprs,
-                               VarDecl *array) {
-  auto *arrayTy = llvm::dyn_cast<ArrayType>(ty);
-  if (llvm::isa<ArrayType>(arrayTy->getSubtype())) {
-    for (uint64_t ind = 0; ind < arrayTy->getElNum(); ind++) {
-      auto new_indices = indices;
-      new_indices.push_back(ind);
-      lowerArrayInit(arrayTy->getSubtype(),
-                     llvm::dyn_cast<ArrayInitExpr>(init->getVals().at(ind)),
-                     new_indices, exprs, array);
+void SemaCheck::runParallel(ModuleDecl *moduleDecl, unsigned numThreads) {
+  // Don't bother splitting small modules.
+  constexpr size_t MinRangeSize = 256;
+
+  // Make a few ranges per thread, since functions differ in size.
+  auto &body = moduleDecl->getBody();
+  numThreads = llvm::hardware_concurrency(numThreads).compute_thread_count();
+  size_t numRanges =
+      std::min<size_t>(numThreads * 4, body.size() / MinRangeSize);
+  if (numThreads <= 1 || numRanges <= 1)
+    return run(moduleDecl);
+
+  {
+    SemaCheckScopeMgr scopeMgr(*this);
+    declareModule(moduleDecl);
+
+    // Check the ranges concurrently. Each range creates the nodes in its own
+    // context and reports into its own diagnostics engine, and only reads
+    // the module scope. Each one may take all steps left in the budget.
+    struct Range {
+      size_t begin;
+      size_t end;
+      std::unique_ptr<Diag> diag;
+      std::unique_ptr<SemaCheck> check;
+    };
+    std::vector<Range> ranges(aborted ? 0 : numRanges);
+    llvm::ThreadPool pool(llvm::hardware_concurrency(numThreads));
+    for (size_t i = 0; i < ranges.size(); ++i) {
+      auto &range = ranges[i];
+      range.begin = i * body.size() / numRanges;
+      range.end = (i + 1) * body.size() / numRanges;
+      range.diag = std::make_unique<Diag>(diag.getSourceMgr());
+      range.check.reset(new SemaCheck(*this, *range.diag, ctx.createChild()));
+      pool.async([&range, &body] {
+        for (auto idx = range.begin; idx < range.end; ++idx) {
+          if (range.check->aborted)
+            break;
+          range.check->evaluate(body[idx]);
+        }
+      });
     }
-  } else {
-    for (uint64_t ind = 0; ind < arrayTy->getElNum(); ind++) {
-      auto new_indices = indices;
-      new_indices.push_back(ind);
-      Expr *access = new VarExpr(array->getName(), array->getLoc());
-      evaluate(access);
-      for (auto new_ind : new_indices) {
-        access = new ArrayAccessExpr(
-            access,
-            new IntLiteralExpr(std::to_string(new_ind), access->getLoc()),
-            access->getLoc());
-        evaluate(access);
+    pool.wait();
+
+    // Accept the ranges in source order, as long as the error limit is not
+    // exceeded in them, and the steps they took are left in the budget. The
+    // rest of the module is checked again from the first range which exceeds
+    // either, so that the check aborts, and the evaluations run out of steps,
+    // exactly where run() would.
+    size_t numAccepted = 0;
+    auto stepsBeforeRanges = steps.left;
+    while (numAccepted < ranges.size()) {
+      auto &range = ranges[numAccepted];
+      auto rangeSteps = stepsBeforeRanges - range.check->steps.left;
+      if (diag.getNumErrs() + range.diag->getNumErrs() > MAX_SEMANTIC_ERRS ||
+          rangeSteps >= steps.left)
+        break;
+
+      diag.merge(*range.diag);
+      steps.left -= rangeSteps;
+      for (auto *global : range.check->escapingGlobals)
+        global->setEscaping(true);
+      ++numAccepted;
+    }
+    for (size_t i = numAccepted; i < ranges.size(); ++i)
+      ranges[i].diag->discard();
+
+    if (numAccepted < ranges.size()) {
+      for (auto idx = ranges[numAccepted].begin; idx < body.size(); ++idx) {
+        if (aborted)
+          break;
+        evaluate(body[idx]);
       }
-
-      auto *assignment =
-          new AssignExpr(access, init->getVals().at(ind), access->getLoc());
-      evaluate(assignment);
-      exprs.push_back(assignment);
     }
+
+    evaluateGlobals(moduleDecl);
   }
+
+  if (aborted)
+    reportAbort();
 }
 
 void SemaCheck::visit(VarDecl *decl) {
+  // The initializer is evaluated again, if the check passes.
+  decl->setEvaluatedInit(nullptr);
+  if (!decl->isGlobal())
+    decl->setEscaping(false);
+
+  // Array sizes of globals are computed when the module is declared.
+  if (!decl->isGlobal() && decl->hasArrayDims())
+    resolveArrayType(decl);
+
   // First check the initializer, in case the variable is referencing itself.
-  if (decl->getInitializer())
+  if (decl->getInitializer()) {
     evaluate(decl->getInitializer());
+    convertLiteral(decl->getInitializer(), decl->getType());
+  }
+  checkLargeLiterals();
 
   // Report an error if this is a redefinition.
   // Only do this for locals, as globals will be forward declared at the
   // module level.
   if (!decl->isGlobal()) {
-    if (!env->insert(decl, decl->getName()))
+    assignIndex(decl);
+    if (!env.insert(decl, decl->getIdentifier()))
       error(decl->getLoc(), DiagID::err_var_redefine);
   }
 
-  // Initializer must have a compatible type.
-  if (decl->getInitializer() &&
-      !Type::checkTypesMatching(decl->getType(),
-                                decl->getInitializer()->getType()))
+  // Initializer must have a compatible type. An initialization list must
+  // also have as many elements as the array. The type is unknown if the
+  // array sizes could not be computed.
+  auto *init = decl->getInitializer();
+  if (init && decl->getType() != Type::getNoneType() &&
+      !Type::checkTypesMatching(decl->getType(), init->getType(),
+                                        !llvm::isa<ArrayInitExpr>(init))) {
     error(decl->getLoc(), DiagID::err_incompatible_types);
-
-  // If this is a local variable of array type, and it has an initializer,
-  // lower the initialization into a list of expressions, each representing
-  // an assignment of an initialization expression to an array member.
-  if (!decl->isGlobal() && llvm::isa<ArrayType>(decl->getType()) &&
-      decl->getInitializer()) {
-    Exprs exprs;
-    auto *initializer = llvm::dyn_cast<ArrayInitExpr>(decl->getInitializer());
-    lowerArrayInit(decl->getType(), initializer, {}, exprs, decl);
-    decl->setLoweredArrayInit(std::move(exprs));
-
-    decl->setInitializer(nullptr);
+    return;
   }
 }
@@ -0,0 +1,96 @@
+#include "llvm/Support/Format.h"
+#include <algorithm>
+#include <mutex>
+
+#include "ASTContext.h"
+
+using namespace mxrlang;
+
+namespace {
+// Object classes created in any context, in order of their first creation.
+struct ClassInfo {
+  llvm::StringRef name;
+  size_t size;
+};
+
+std::mutex classRegistryMutex;
+std::vector<ClassInfo> classRegistry;
+} // namespace
+
+// Register an object class for the statistics, and return its index.
+uint32_t ASTContext::registerClass(llvm::StringRef name, size_t size) {
+  std::lock_guard<std::mutex> lock(classRegistryMutex);
+  name.consume_front("mxrlang::");
+  classRegistry.push_back({name, size});
+  return static_cast<uint32_t>(classRegistry.size() - 1);
+}
+
+uint64_t ASTContext::getNumAllocs() const {
+  uint64_t num = numAllocs;
+  for (const auto &child : children)
+    num += child->getNumAllocs();
+  return num;
+}
+
+size_t ASTContext::getBytesAllocated() const {
+  size_t bytes = allocator.getBytesAllocated();
+  for (const auto &child : children)
+    bytes += child->getBytesAllocated();
+  return bytes;
+}
+
+// Print the memory usage statistics.
+void ASTContext::printStats(llvm::raw_ostream &out) const {
+  std::vector<ClassInfo> classes;
+  {
+    std::lock_guard<std::mutex> lock(classRegistryMutex);
+    classes = classRegistry;
+  }
+
+  // Sum up the statistics of this context and its children.
+  std::vector<uint64_t> numAllocsPerClass;
+  size_t numDestructors = 0;
+  size_t numSlabs = 0;
+  size_t totalMemory = 0;
+  auto collect = [&](const ASTContext &ctx) {
+    if (ctx.numAllocsPerClass.size() > numAllocsPerClass.size())
+      numAllocsPerClass.resize(ctx.numAllocsPerClass.size());
+    for (size_t i = 0; i < ctx.numAllocsPerClass.size(); ++i)
+      numAllocsPerClass[i] += ctx.numAllocsPerClass[i];
+    numDestructors += ctx.destructors.size();
+    numSlabs += ctx.allocator.GetNumSlabs();
+    totalMemory += ctx.allocator.getTotalMemory();
+  };
+  collect(*this);
+  for (const auto &child : children)
+    collect(*child);
+
+  out << "*** AST context stats:\n";
+  out << "  " << getNumAllocs() << " objects allocated\n";
+  out << "  " << identifiers->getNumIdentifiers() << " identifiers\n";
+  out << "  " << types->getNumTypes() << " pointer and array types\n";
+
+  // Print the classes with the largest memory footprint first.
+  std::vector<uint32_t> order;
+  for (uint32_t i = 0; i < numAllocsPerClass.size(); ++i)
+    if (numAllocsPerClass[i])
+      order.push_back(i);
+  std::stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) {
+    return numAllocsPerClass[a] * classes[a].size >
+           numAllocsPerClass[b] * classes[b].size;
+  });
+  for (auto i : order)
+    out << "    " << numAllocsPerClass[i] << " " << classes[i].name << ", "
+        << classes[i].size << " each ("
+        << numAllocsPerClass[i] * classes[i].size << " bytes)\n";
+
+  out << "  " << numDestructors << " objects with destructors\n";
+  out << "  " << getBytesAllocated() << " bytes allocated in " << numSlabs
+      << " slabs (" << totalMemory << " bytes reserved)\n";
+
+  auto numLines = std::max<size_t>(buffer.count('\n'), 1);
+  out << "  " << numLines << " source lines, "
+      << llvm::format("%.1f", static_cast<double>(getBytesAllocated()) /
+                                  numLines)
+      << " AST bytes per line\n";
+}
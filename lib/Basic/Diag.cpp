@@ -1,3 +1,6 @@
+#include "llvm/Support/JSON.h"
+#include <algorithm>
+
 #include "Diag.h"
 
 namespace mxrlang {
@@ -9,6 +12,10 @@ llvm::SourceMgr::DiagKind diagKind[] = {
 #define DIAG(ID, Level, Msg) llvm::SourceMgr::DK_##Level,
 #include "Diag.def"
 };
+const char *diagName[] = {
+#define DIAG(ID, Level, Msg) #ID,
+#include "Diag.def"
+};
 } // namespace mxrlang
 
 using namespace mxrlang;
@@ -22,3 +29,133 @@ const char *Diag::getDiagText(DiagID diagID) {
 llvm::SourceMgr::DiagKind Diag::getDiagKind(DiagID diagID) {
   return diagKind[static_cast<uint32_t>(diagID)];
 }
+
+// Returns the name of the error ID.
+const char *Diag::getDiagName(DiagID diagID) {
+  return diagName[static_cast<uint32_t>(diagID)];
+}
+
+// Record a diagnostic whose arguments are the last numArgs entries of the
+// argument pool. Returns false if it is a duplicate.
+bool Diag::record(llvm::SMLoc loc, DiagID diagID, uint32_t numArgs) {
+  auto firstArg = static_cast<uint32_t>(args.size() - numArgs);
+
+  auto &atLoc = diagsAtLoc[loc.getPointer()];
+  for (auto idx : atLoc) {
+    const auto &other = diags[idx];
+    if (other.id == diagID && other.numArgs == numArgs &&
+        std::equal(args.begin() + other.firstArg,
+                   args.begin() + other.firstArg + numArgs,
+                   args.begin() + firstArg)) {
+      args.resize(firstArg);
+      return false;
+    }
+  }
+
+  atLoc.push_back(static_cast<uint32_t>(diags.size()));
+  diags.push_back({loc, diagID, firstArg, numArgs});
+  return true;
+}
+
+// Substitute the {N} placeholders in the error text with the arguments.
+std::string Diag::formatMessage(const StoredDiag &stored) const {
+  llvm::StringRef text = getDiagText(stored.id);
+  std::string msg;
+  msg.reserve(text.size());
+
+  for (size_t i = 0, e = text.size(); i < e; ++i) {
+    if (text[i] == '{' && i + 2 < e && text[i + 2] == '}') {
+      uint32_t argIdx = text[i + 1] - '0';
+      if (argIdx < stored.numArgs) {
+        msg += args[stored.firstArg + argIdx];
+        i += 2;
+        continue;
+      }
+    }
+    msg += text[i];
+  }
+
+  return msg;
+}
+
+void Diag::renderText(llvm::raw_ostream &out, const StoredDiag &stored) {
+  // Diagnostics about the whole compilation have no location to show.
+  if (!stored.loc.isValid()) {
+    llvm::SMDiagnostic(/* filename= */ "", getDiagKind(stored.id),
+                       formatMessage(stored))
+        .print(nullptr, out);
+    return;
+  }
+
+  srcMgr.PrintMessage(out, stored.loc, getDiagKind(stored.id),
+                      formatMessage(stored));
+}
+
+void Diag::renderJSON(llvm::raw_ostream &out, const StoredDiag &stored) {
+  llvm::json::OStream json(out);
+  json.object([&] {
+    if (stored.loc.isValid()) {
+      auto bufferID = srcMgr.FindBufferContainingLoc(stored.loc);
+      auto lineAndCol = srcMgr.getLineAndColumn(stored.loc, bufferID);
+      json.attribute(
+          "file",
+          srcMgr.getMemoryBuffer(bufferID)->getBufferIdentifier());
+      json.attribute("line", lineAndCol.first);
+      json.attribute("column", lineAndCol.second);
+    }
+    json.attribute("severity",
+                   getDiagKind(stored.id) == llvm::SourceMgr::DK_Error
+                       ? "error"
+                       : "warning");
+    json.attribute("id", getDiagName(stored.id));
+    json.attribute("message", formatMessage(stored));
+  });
+  out << "\n";
+}
+
+// Move the pending diagnostics of another engine into this one.
+void Diag::merge(Diag &other) {
+  std::lock(mutex, other.mutex);
+  std::lock_guard<std::mutex> lock(mutex, std::adopt_lock);
+  std::lock_guard<std::mutex> otherLock(other.mutex, std::adopt_lock);
+
+  for (auto idx = other.firstPending; idx < other.diags.size(); ++idx) {
+    const auto &stored = other.diags[idx];
+    args.insert(args.end(), other.args.begin() + stored.firstArg,
+                other.args.begin() + stored.firstArg + stored.numArgs);
+    if (record(stored.loc, stored.id, stored.numArgs) &&
+        getDiagKind(stored.id) == llvm::SourceMgr::DK_Error)
+      ++numErrs;
+  }
+
+  other.firstPending = static_cast<uint32_t>(other.diags.size());
+}
+
+// Render all diagnostics reported since the last flush, sorted by their
+// location. There is one buffer per SourceMgr, so comparing pointers gives the
+// source order. Diagnostics at the same location keep the reporting order.
+// The whole batch is rendered into memory first, since the output stream is
+// usually unbuffered.
+void Diag::flush() {
+  std::lock_guard<std::mutex> lock(mutex);
+
+  std::vector<uint32_t> order(diags.size() - firstPending);
+  for (uint32_t i = 0; i < order.size(); ++i)
+    order[i] = firstPending + i;
+  std::stable_sort(order.begin(), order.end(), [this](uint32_t a, uint32_t b) {
+    return diags[a].loc.getPointer() < diags[b].loc.getPointer();
+  });
+
+  std::string rendered;
+  llvm::raw_string_ostream out(rendered);
+  for (auto idx : order) {
+    if (format == DiagFormat::JSON)
+      renderJSON(out, diags[idx]);
+    else
+      renderText(out, diags[idx]);
+  }
+
+  firstPending = static_cast<uint32_t>(diags.size());
+  os << out.str();
+  os.flush();
+}
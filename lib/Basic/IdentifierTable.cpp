@@ -0,0 +1,38 @@
+#include <algorithm>
+
+#include "IdentifierTable.h"
+
+using namespace mxrlang;
+
+// Get the identifier with the given spelling, creating it on first use.
+IdentifierInfo *IdentifierTable::get(llvm::StringRef name) {
+  // The hash is computed once, and picks both the shard and the bucket.
+  llvm::CachedHashStringRef key(name);
+  auto &shard = shards[key.hash() >> (32 - NumShardBits)];
+
+  std::lock_guard<std::mutex> lock(shard.mutex);
+  auto found = shard.identifiers.find(key);
+  if (found != shard.identifiers.end())
+    return found->second;
+
+  // The key has to point to the copy, since the buffer may go away.
+  char *spelling = shard.allocator.Allocate<char>(name.size());
+  std::copy(name.begin(), name.end(), spelling);
+  llvm::StringRef copy(spelling, name.size());
+
+  auto *info = new (shard.allocator.Allocate<IdentifierInfo>())
+      IdentifierInfo(copy);
+  shard.identifiers.try_emplace(llvm::CachedHashStringRef(copy, key.hash()),
+                                info);
+  return info;
+}
+
+// Number of distinct identifiers in the table.
+size_t IdentifierTable::getNumIdentifiers() {
+  size_t num = 0;
+  for (auto &shard : shards) {
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    num += shard.identifiers.size();
+  }
+  return num;
+}
@@ -1,44 +1,72 @@
+#include "ASTContext.h"
 #include "Type.h"
+#include "TypeContext.h"
 
 using namespace mxrlang;
 
 BasicType BasicType::boolType = BasicType(BasicType::BasicTypeKind::Bool);
 BasicType BasicType::intType = BasicType(BasicType::BasicTypeKind::Int);
+BasicType BasicType::int8Type = BasicType(BasicType::BasicTypeKind::Int8);
+BasicType BasicType::int16Type = BasicType(BasicType::BasicTypeKind::Int16);
+BasicType BasicType::int32Type = BasicType(BasicType::BasicTypeKind::Int32);
+BasicType BasicType::uintType = BasicType(BasicType::BasicTypeKind::UInt);
+BasicType BasicType::uint8Type = BasicType(BasicType::BasicTypeKind::UInt8);
+BasicType BasicType::uint16Type = BasicType(BasicType::BasicTypeKind::UInt16);
+BasicType BasicType::uint32Type = BasicType(BasicType::BasicTypeKind::UInt32);
 BasicType BasicType::noneType = BasicType(BasicType::BasicTypeKind::None);
 
-// A register of all program types (built-in and user defined).
-std::unordered_map<std::string, Type *> Type::typeTable = {
-    {"NONE", &BasicType::noneType},
-    {"BOOL", &BasicType::boolType},
-    {"INT", &BasicType::intType}};
+// Convert the type token.
+Type *Type::getTypeFromToken(const Token &token) {
+  switch (token.getKind()) {
+  case TokenKind::kw_BOOL:
+    return getBoolType();
+  case TokenKind::kw_INT:
+    return getIntType();
+  case TokenKind::kw_INT8:
+    return &BasicType::int8Type;
+  case TokenKind::kw_INT16:
+    return &BasicType::int16Type;
+  case TokenKind::kw_INT32:
+    return &BasicType::int32Type;
+  case TokenKind::kw_UINT:
+    return &BasicType::uintType;
+  case TokenKind::kw_UINT8:
+    return &BasicType::uint8Type;
+  case TokenKind::kw_UINT16:
+    return &BasicType::uint16Type;
+  case TokenKind::kw_UINT32:
+    return &BasicType::uint32Type;
+  default:
+    return nullptr;
+  }
+}
 
 // Check if the two provided types match.
 bool Type::checkTypesMatching(const Type *left, const Type *right,
                               bool arrayDecay) {
-  if (left->getTypeKind() == TypeKind::Basic) {
-    if (right->getTypeKind() != TypeKind::Basic)
-      return false;
-
-    // Basic types only live as static members of the BasicType class.
-    return left == right;
-  } else if (arrayDecay) {
-    // Consider array and pointer types equal.
-    return checkTypesMatching(left->getSubtype(), right->getSubtype());
-  } else if (left->getTypeKind() == TypeKind::Pointer) {
-    if (right->getTypeKind() == TypeKind::Pointer)
-      return checkTypesMatching(left->getSubtype(), right->getSubtype(), false);
+  // Types are unique, so equal types are the same object.
+  if (left == right)
+    return true;
 
+  // Basic types only live as static members of the BasicType class.
+  if (!arrayDecay || left->getTypeKind() == TypeKind::Basic)
     return false;
-  } else if (left->getTypeKind() == TypeKind::Array) {
-    auto *leftArray = llvm::dyn_cast<ArrayType>(left);
-    if (auto *rightArray = llvm::dyn_cast<ArrayType>(right)) {
-      if (leftArray->getElNum() != rightArray->getElNum())
-        return false;
 
-      return checkTypesMatching(left->getSubtype(), right->getSubtype(), false);
-    }
+  // Consider array and pointer types equal.
+  return checkTypesMatching(left->getSubtype(), right->getSubtype());
+}
 
-    return false;
-  } else
-    llvm_unreachable("Unrecognized type.");
+// Get the type of a pointer to the pointee type.
+PointerType *PointerType::get(ASTContext &ctx, Type *pointeeType) {
+  return ctx.getTypeContext().getPointerType(pointeeType);
+}
+
+// Get the type of an array of elNum elements of the element type.
+ArrayType *ArrayType::get(ASTContext &ctx, Type *arrayType, uint64_t elNum) {
+  return ctx.getTypeContext().getArrayType(arrayType, elNum);
+}
+
+// Decays the array type to pointer type.
+Type *ArrayType::decay(ASTContext &ctx) const {
+  return PointerType::get(ctx, arrayType);
 }
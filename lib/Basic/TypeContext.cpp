@@ -0,0 +1,39 @@
+#include "TypeContext.h"
+
+using namespace mxrlang;
+
+// Get the type of a pointer to the pointee type.
+PointerType *TypeContext::getPointerType(Type *pointeeType) {
+  llvm::FoldingSetNodeID id;
+  PointerType::Profile(id, pointeeType);
+
+  std::lock_guard<std::mutex> lock(mutex);
+  void *insertPos = nullptr;
+  if (auto *type = pointerTypes.FindNodeOrInsertPos(id, insertPos))
+    return type;
+
+  auto *type = new (allocator.Allocate<PointerType>()) PointerType(pointeeType);
+  pointerTypes.InsertNode(type, insertPos);
+  return type;
+}
+
+// Get the type of an array of elNum elements of the element type.
+ArrayType *TypeContext::getArrayType(Type *elType, uint64_t elNum) {
+  llvm::FoldingSetNodeID id;
+  ArrayType::Profile(id, elType, elNum);
+
+  std::lock_guard<std::mutex> lock(mutex);
+  void *insertPos = nullptr;
+  if (auto *type = arrayTypes.FindNodeOrInsertPos(id, insertPos))
+    return type;
+
+  auto *type = new (allocator.Allocate<ArrayType>()) ArrayType(elType, elNum);
+  arrayTypes.InsertNode(type, insertPos);
+  return type;
+}
+
+// Number of types created in this context.
+size_t TypeContext::getNumTypes() {
+  std::lock_guard<std::mutex> lock(mutex);
+  return pointerTypes.size() + arrayTypes.size();
+}
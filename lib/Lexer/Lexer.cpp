@@ -1,15 +1,102 @@
+#include "llvm/Support/Compiler.h"
+#include "llvm/Support/MathExtras.h"
+#include "llvm/Support/ThreadPool.h"
+#include "llvm/Support/Threading.h"
+#include <algorithm>
+#include <cstring>
+#include <memory>
+
 #include "Lexer.h"
 
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define MXRLANG_X86_SCAN 1
+#include <immintrin.h>
+#endif
+
 using namespace mxrlang;
 
-void KeywordFilter::addKeyword(llvm::StringRef kw, TokenKind kind) {
-  kwTable.insert(std::make_pair(kw, kind));
-}
+namespace {
 
-void KeywordFilter::addKeywords() {
+struct KeywordEntry {
+  const char *spelling;
+  uint32_t length;
+  TokenKind kind;
+};
+
+constexpr KeywordEntry keywordList[] = {
 #define KEYWORD(NAME, FLAGS)                                                   \
-  addKeyword(llvm::StringRef(#NAME), TokenKind::kw_##NAME);
+  {#NAME, sizeof(#NAME) - 1, TokenKind::kw_##NAME},
 #include "TokenKinds.def"
+};
+
+constexpr uint32_t NumKeywords = sizeof(keywordList) / sizeof(KeywordEntry);
+
+// Size of the keyword hash table. Must be a power of two.
+constexpr uint32_t KeywordTableSize = 128;
+
+// Keywords are told apart by their first and last characters and length.
+// The seed is picked at compile time, so that no two keywords collide.
+constexpr uint32_t hashKeyword(const char *name, uint32_t length,
+                               uint32_t seed) {
+  return (static_cast<unsigned char>(name[0]) * seed +
+          static_cast<unsigned char>(name[length - 1]) + length) &
+         (KeywordTableSize - 1);
+}
+
+constexpr uint32_t findKeywordSeed() {
+  for (uint32_t seed = 1; seed < 1024; ++seed) {
+    bool used[KeywordTableSize] = {};
+    bool collides = false;
+    for (uint32_t i = 0; i < NumKeywords && !collides; ++i) {
+      uint32_t hash =
+          hashKeyword(keywordList[i].spelling, keywordList[i].length, seed);
+      collides = used[hash];
+      used[hash] = true;
+    }
+    if (!collides)
+      return seed;
+  }
+  return 0;
+}
+
+constexpr uint32_t KeywordSeed = findKeywordSeed();
+static_assert(KeywordSeed != 0, "No perfect hash for the keywords; increase "
+                                "KeywordTableSize.");
+
+struct KeywordTable {
+  KeywordEntry entries[KeywordTableSize];
+  uint32_t minLength;
+  uint32_t maxLength;
+};
+
+constexpr KeywordTable buildKeywordTable() {
+  KeywordTable table = {};
+  table.minLength = UINT32_MAX;
+  for (uint32_t i = 0; i < NumKeywords; ++i) {
+    const KeywordEntry &kw = keywordList[i];
+    table.entries[hashKeyword(kw.spelling, kw.length, KeywordSeed)] = kw;
+    table.minLength = kw.length < table.minLength ? kw.length : table.minLength;
+    table.maxLength = kw.length > table.maxLength ? kw.length : table.maxLength;
+  }
+  return table;
+}
+
+constexpr KeywordTable keywordTable = buildKeywordTable();
+
+} // namespace
+
+TokenKind KeywordFilter::getKeyword(llvm::StringRef name,
+                                    TokenKind defaultTokKind) {
+  if (name.size() < keywordTable.minLength ||
+      name.size() > keywordTable.maxLength)
+    return defaultTokKind;
+
+  const KeywordEntry &kw =
+      keywordTable.entries[hashKeyword(name.data(), name.size(), KeywordSeed)];
+  if (kw.length == name.size() &&
+      std::memcmp(kw.spelling, name.data(), name.size()) == 0)
+    return kw.kind;
+  return defaultTokKind;
 }
 
 namespace charinfo {
@@ -26,6 +113,19 @@ inline bool isWhitespace(char ch) {
 
 inline bool isDigit(char ch) { return ch >= '0' && ch <= '9'; }
 
+inline bool isHexDigit(char ch) {
+  return isDigit(ch) || (ch >= 'a' && ch <= 'f') || (ch >= 'A' && ch <= 'F');
+}
+
+inline bool isBinDigit(char ch) { return ch == '0' || ch == '1'; }
+
+// Value of a (hexa)decimal or binary digit.
+inline uint64_t digitValue(char ch) {
+  if (isDigit(ch))
+    return ch - '0';
+  return (ch | 0x20) - 'a' + 10;
+}
+
 inline bool isIdentHead(char ch) {
   return ch == '_' || (ch >= 'A' && ch <= 'Z') || (ch >= 'a' && ch <= 'z');
 }
@@ -34,27 +134,215 @@ inline bool isIdentBody(char ch) { return isIdentHead(ch) || isDigit(ch); }
 
 } // namespace charinfo
 
+// Scanners which skip over a run of characters of the same class. Each of them
+// returns the pointer to the first character in [ptr, end) which does not
+// belong to the class, or end if there is no such character. The vectorized
+// versions classify 16 or 32 characters at a time, and the best one supported
+// by the host is selected at runtime.
+namespace charscan {
+
+using ScanFn = const char *(*)(const char *ptr, const char *end);
+
+struct Scanners {
+  ScanFn skipWhitespace;
+  ScanFn skipIdentBody;
+  ScanFn skipDigits;
+};
+
+template <bool (*Pred)(char)>
+const char *scanScalar(const char *ptr, const char *end) {
+  while (ptr != end && Pred(*ptr))
+    ptr++;
+  return ptr;
+}
+
+const Scanners scalarScanners = {scanScalar<charinfo::isWhitespace>,
+                                 scanScalar<charinfo::isIdentBody>,
+                                 scanScalar<charinfo::isDigit>};
+
+#ifdef MXRLANG_X86_SCAN
+
+// Characters in [lo, lo + len] are marked with 0xff.
+__attribute__((target("sse2"))) inline __m128i inRange128(__m128i v, char lo,
+                                                          char len) {
+  __m128i t = _mm_sub_epi8(v, _mm_set1_epi8(lo));
+  return _mm_cmpeq_epi8(_mm_min_epu8(t, _mm_set1_epi8(len)), t);
+}
+
+__attribute__((target("sse2"))) inline __m128i whitespace128(__m128i v) {
+  // '\t', '\n', '\v', '\f', '\r' and ' '.
+  return _mm_or_si128(inRange128(v, '\t', 4),
+                      _mm_cmpeq_epi8(v, _mm_set1_epi8(' ')));
+}
+
+__attribute__((target("sse2"))) inline __m128i digit128(__m128i v) {
+  return inRange128(v, '0', 9);
+}
+
+__attribute__((target("sse2"))) inline __m128i identBody128(__m128i v) {
+  // Setting the 0x20 bit maps upper case letters to lower case ones, and
+  // no other character into the [a, z] range.
+  __m128i letter = inRange128(_mm_or_si128(v, _mm_set1_epi8(0x20)), 'a', 25);
+  __m128i underscore = _mm_cmpeq_epi8(v, _mm_set1_epi8('_'));
+  return _mm_or_si128(_mm_or_si128(letter, underscore), digit128(v));
+}
+
+template <__m128i (*Classify)(__m128i), bool (*Pred)(char)>
+__attribute__((target("sse2"))) const char *scanSSE2(const char *ptr,
+                                                     const char *end) {
+  while (end - ptr >= 16) {
+    __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(ptr));
+    uint32_t mask = ~_mm_movemask_epi8(Classify(v)) & 0xffff;
+    if (mask)
+      return ptr + __builtin_ctz(mask);
+    ptr += 16;
+  }
+  return scanScalar<Pred>(ptr, end);
+}
+
+__attribute__((target("avx2"))) inline __m256i inRange256(__m256i v, char lo,
+                                                          char len) {
+  __m256i t = _mm256_sub_epi8(v, _mm256_set1_epi8(lo));
+  return _mm256_cmpeq_epi8(_mm256_min_epu8(t, _mm256_set1_epi8(len)), t);
+}
+
+__attribute__((target("avx2"))) inline __m256i whitespace256(__m256i v) {
+  return _mm256_or_si256(inRange256(v, '\t', 4),
+                         _mm256_cmpeq_epi8(v, _mm256_set1_epi8(' ')));
+}
+
+__attribute__((target("avx2"))) inline __m256i digit256(__m256i v) {
+  return inRange256(v, '0', 9);
+}
+
+__attribute__((target("avx2"))) inline __m256i identBody256(__m256i v) {
+  __m256i letter =
+      inRange256(_mm256_or_si256(v, _mm256_set1_epi8(0x20)), 'a', 25);
+  __m256i underscore = _mm256_cmpeq_epi8(v, _mm256_set1_epi8('_'));
+  return _mm256_or_si256(_mm256_or_si256(letter, underscore), digit256(v));
+}
+
+template <__m256i (*Classify)(__m256i), bool (*Pred)(char)>
+__attribute__((target("avx2"))) const char *scanAVX2(const char *ptr,
+                                                     const char *end) {
+  while (end - ptr >= 32) {
+    __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(ptr));
+    uint32_t mask = ~static_cast<uint32_t>(_mm256_movemask_epi8(Classify(v)));
+    if (mask)
+      return ptr + __builtin_ctz(mask);
+    ptr += 32;
+  }
+  return scanScalar<Pred>(ptr, end);
+}
+
+const Scanners sse2Scanners = {
+    scanSSE2<whitespace128, charinfo::isWhitespace>,
+    scanSSE2<identBody128, charinfo::isIdentBody>,
+    scanSSE2<digit128, charinfo::isDigit>};
+
+const Scanners avx2Scanners = {
+    scanAVX2<whitespace256, charinfo::isWhitespace>,
+    scanAVX2<identBody256, charinfo::isIdentBody>,
+    scanAVX2<digit256, charinfo::isDigit>};
+
+#endif // MXRLANG_X86_SCAN
+
+// Select the scanners of the implementation, or null if the host does not
+// support it. The automatic choice is the best one the host supports.
+const Scanners *selectScanners(ScanImpl impl) {
+#ifdef MXRLANG_X86_SCAN
+  __builtin_cpu_init();
+  bool hasAVX2 = __builtin_cpu_supports("avx2");
+  bool hasSSE2 = __builtin_cpu_supports("sse2");
+  if (impl == ScanImpl::AVX2 || (impl == ScanImpl::Auto && hasAVX2))
+    return hasAVX2 ? &avx2Scanners : nullptr;
+  if (impl == ScanImpl::SSE2 || (impl == ScanImpl::Auto && hasSSE2))
+    return hasSSE2 ? &sse2Scanners : nullptr;
+#else
+  if (impl == ScanImpl::SSE2 || impl == ScanImpl::AVX2)
+    return nullptr;
+#endif
+  return &scalarScanners;
+}
+
+// Scanners in use by all the lexers.
+const Scanners *scanners = selectScanners(ScanImpl::Auto);
+
+const Scanners &getScanners() { return *scanners; }
+
+} // namespace charscan
+
+bool Lexer::setScanImpl(ScanImpl impl) {
+  auto *selected = charscan::selectScanners(impl);
+  if (!selected)
+    return false;
+  charscan::scanners = selected;
+  return true;
+}
+
 void Lexer::identifier(Token &result) {
   const char *start = currPtr;
-  const char *end = currPtr + 1;
-  while (charinfo::isIdentBody(*end))
-    end++;
+  const char *end =
+      charscan::getScanners().skipIdentBody(currPtr + 1, currBuff.end());
   llvm::StringRef name(start, end - start);
-  formToken(result, end, keywords.getKeyword(name, TokenKind::identifier));
-  (void)result.getName();
+  formToken(result, end,
+            KeywordFilter::getKeyword(name, TokenKind::identifier));
+  if (result.is(TokenKind::identifier))
+    result.identInfo = identifiers.get(name);
 }
 
 void Lexer::number(Token &result) {
-  const char *end = currPtr + 1;
-  while (charinfo::isDigit(*end))
-    end++;
+  // Figure out the radix from the prefix (0x for hexadecimal, 0b for
+  // binary), and find the end of the literal.
+  uint64_t radix = 10;
+  const char *digits = currPtr;
+  const char *end = nullptr;
+  if (*currPtr == '0' && (currPtr[1] == 'x' || currPtr[1] == 'X')) {
+    radix = 16;
+    digits += 2;
+    end = charscan::scanScalar<charinfo::isHexDigit>(digits, currBuff.end());
+  } else if (*currPtr == '0' && (currPtr[1] == 'b' || currPtr[1] == 'B')) {
+    radix = 2;
+    digits += 2;
+    end = charscan::scanScalar<charinfo::isBinDigit>(digits, currBuff.end());
+  } else
+    end = charscan::getScanners().skipDigits(currPtr + 1, currBuff.end());
+
+  if (radix != 10 && (end == digits || charinfo::isIdentBody(*end))) {
+    diag.report(getLoc(), DiagID::err_int_literal_invalid_digit,
+                radix == 16 ? "hexadecimal" : "binary");
+    result.setKind(TokenKind::unknown);
+    return;
+  }
+
+  // Decode the value once here, so that later stages don't have to.
+  uint64_t value = 0;
+  bool overflow = false;
+  for (const char *ptr = digits; ptr != end; ++ptr) {
+    bool digitOverflow = false;
+    value = llvm::SaturatingMultiplyAdd(value, radix,
+                                        charinfo::digitValue(*ptr),
+                                        &digitOverflow);
+    overflow |= digitOverflow;
+  }
+
+  if (overflow) {
+    diag.report(getLoc(), DiagID::err_int_literal_too_large);
+    result.setKind(TokenKind::unknown);
+    return;
+  }
+
   formToken(result, end, TokenKind::integer_literal);
+  result.intValue = value;
 }
 
 void Lexer::next(Token &result) {
-  while (*currPtr && charinfo::isWhitespace(*currPtr))
-    currPtr++;
-  if (!*currPtr) {
+  // Tokens are mostly separated by a single space, so only bother the scanner
+  // if there is more whitespace to skip.
+  if (charinfo::isWhitespace(*currPtr) && charinfo::isWhitespace(*++currPtr))
+    currPtr =
+        charscan::getScanners().skipWhitespace(currPtr + 1, currBuff.end());
+  if (currPtr == currBuff.end() || !*currPtr) {
     result.setKind(TokenKind::eof);
     return;
   }
@@ -116,9 +404,11 @@ void Lexer::next(Token &result) {
         formToken(result, currPtr + 1, TokenKind::ampersand);
       break;
     case '|':
-      if (*(currPtr + 1) == '|')
+      if (*(currPtr + 1) == '|') {
         formToken(result, currPtr + 2, TokenKind::logicor);
-      break;
+        break;
+      }
+      LLVM_FALLTHROUGH;
     default:
       diag.report(getLoc(), DiagID::err_unknown_token);
       result.setKind(TokenKind::unknown);
@@ -135,7 +425,7 @@ void Lexer::formToken(Token &result, const char *tokEnd, TokenKind kind) {
   currPtr = tokEnd;
 }
 
-Tokens &&Lexer::lex() {
+TokenTable &&Lexer::lex() {
   Token tok;
   do {
     next(tok);
@@ -144,3 +434,76 @@ Tokens &&Lexer::lex() {
 
   return std::move(tokens);
 }
+
+TokenTable &&Lexer::lexParallel(unsigned numThreads) {
+  // Don't bother splitting small buffers.
+  constexpr size_t MinChunkSize = 1 << 20;
+
+  numThreads = llvm::hardware_concurrency(numThreads).compute_thread_count();
+  size_t numChunks =
+      std::min<size_t>(numThreads, currBuff.size() / MinChunkSize);
+  if (numChunks <= 1)
+    return lex();
+
+  // Split the buffer so that each chunk ends with whitespace and the next one
+  // starts with a token. Tokens can't contain whitespace, so no token is
+  // split, and the chunk lexers stop right at the chunk ends.
+  std::vector<llvm::StringRef> chunks;
+  const char *chunkBegin = currPtr;
+  for (size_t i = 1; i < numChunks; ++i) {
+    const char *split = currBuff.begin() + i * currBuff.size() / numChunks;
+    if (split <= chunkBegin)
+      continue;
+    while (split != currBuff.end() &&
+           !(charinfo::isWhitespace(split[-1]) &&
+             !charinfo::isWhitespace(*split)))
+      ++split;
+    if (split == currBuff.end())
+      break;
+    chunks.emplace_back(chunkBegin, split - chunkBegin);
+    chunkBegin = split;
+  }
+  chunks.emplace_back(chunkBegin, currBuff.end() - chunkBegin);
+
+  // Lex the chunks concurrently. Each chunk reports into its own diagnostics
+  // engine, so that only the errors which sequential lexing would see are
+  // kept.
+  std::vector<std::unique_ptr<Diag>> chunkDiags;
+  std::vector<TokenTable> chunkTokens(chunks.size());
+  llvm::ThreadPool pool(llvm::hardware_concurrency(numThreads));
+  for (size_t i = 0; i < chunks.size(); ++i) {
+    chunkDiags.push_back(std::make_unique<Diag>(srcMgr));
+    pool.async([&, i] {
+      Lexer chunkLexer(srcMgr, *chunkDiags[i], identifiers, chunks[i],
+                       currBuff.begin());
+      chunkTokens[i] = std::move(chunkLexer.lex());
+    });
+  }
+  pool.wait();
+
+  // Stitch the chunks together. Every chunk but the last one ends with a
+  // premature EOF, and lexing stops at the first unknown token. Errors in the
+  // chunks following it are dropped.
+  size_t numTokens = 0;
+  for (const auto &chunk : chunkTokens)
+    numTokens += chunk.size();
+  tokens.reserve(numTokens);
+
+  bool failed = false;
+  for (size_t i = 0; i < chunks.size(); ++i) {
+    if (failed) {
+      chunkDiags[i]->discard();
+      continue;
+    }
+
+    diag.merge(*chunkDiags[i]);
+    tokens.append(chunkTokens[i]);
+    if (tokens.getKind(tokens.size() - 1) == TokenKind::unknown)
+      failed = true;
+    else if (i + 1 != chunks.size())
+      tokens.pop_back();
+  }
+
+  currPtr = currBuff.end();
+  return std::move(tokens);
+}
@@ -0,0 +1,400 @@
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/StringExtras.h"
+#include "llvm/Support/xxhash.h"
+#include <algorithm>
+#include <cstring>
+
+#include "ASTVisitor.h"
+#include "IncrementalParser.h"
+
+using namespace mxrlang;
+
+namespace {
+// Moves all nodes of a declaration by a fixed number of bytes.
+class LocShifter : public ASTVisitor<LocShifter> {
+  friend class ASTVisitor<LocShifter>;
+  using ASTVisitor<LocShifter>::visit;
+
+  int64_t delta;
+
+  void shift(Node *node) {
+    node->setLoc(
+        SourceLoc(static_cast<uint32_t>(node->getLoc().getOffset() + delta)));
+  }
+
+  void shiftAll(Nodes &nodes) {
+    for (auto *node : nodes)
+      evaluate(node);
+  }
+
+  void visit(ArrayAccessExpr *expr) {
+    evaluate(expr->getArray());
+    evaluate(expr->getElement());
+    shift(expr);
+  }
+
+  void visit(ArrayInitExpr *expr) {
+    for (auto *val : expr->getVals())
+      evaluate(val);
+    shift(expr);
+  }
+
+  void visit(AssignExpr *expr) {
+    evaluate(expr->getDest());
+    evaluate(expr->getSource());
+    shift(expr);
+  }
+
+  void visit(BinaryArithExpr *expr) {
+    evaluate(expr->getLeft());
+    evaluate(expr->getRight());
+    shift(expr);
+  }
+
+  void visit(BinaryLogicalExpr *expr) {
+    evaluate(expr->getLeft());
+    evaluate(expr->getRight());
+    shift(expr);
+  }
+
+  void visit(BoolLiteralExpr *expr) { shift(expr); }
+
+  void visit(CallExpr *expr) {
+    for (auto *arg : expr->getArgs())
+      evaluate(arg);
+    shift(expr);
+  }
+
+  void visit(CastExpr *expr) {
+    evaluate(expr->getExpr());
+    shift(expr);
+  }
+
+  void visit(IntLiteralExpr *expr) { shift(expr); }
+
+  void visit(LoadExpr *expr) {
+    evaluate(expr->getExpr());
+    shift(expr);
+  }
+
+  void visit(PointerOpExpr *expr) {
+    evaluate(expr->getExpr());
+    shift(expr);
+  }
+
+  void visit(UnaryExpr *expr) {
+    evaluate(expr->getExpr());
+    shift(expr);
+  }
+
+  void visit(VarExpr *expr) { shift(expr); }
+
+  void visit(ExprStmt *stmt) {
+    evaluate(stmt->getExpr());
+    shift(stmt);
+  }
+
+  void visit(IfStmt *stmt) {
+    evaluate(stmt->getCond());
+    shiftAll(stmt->getThenBody());
+    shiftAll(stmt->getElseBody());
+    shift(stmt);
+  }
+
+  void visit(PrintStmt *stmt) {
+    evaluate(stmt->getPrintExpr());
+    shift(stmt);
+  }
+
+  void visit(ReturnStmt *stmt) {
+    if (stmt->getRetExpr())
+      evaluate(stmt->getRetExpr());
+    shift(stmt);
+  }
+
+  void visit(ScanStmt *stmt) {
+    evaluate(stmt->getScanVar());
+    shift(stmt);
+  }
+
+  void visit(WhileStmt *stmt) {
+    evaluate(stmt->getCond());
+    shiftAll(stmt->getBody());
+    shift(stmt);
+  }
+
+  void visit(FunDecl *decl) {
+    for (auto *arg : decl->getArgs())
+      evaluate(arg);
+    shiftAll(decl->getBody());
+    shift(decl);
+  }
+
+  void visit(VarDecl *decl) {
+    // The evaluated initializer is created again by the semantic check.
+    for (auto *dim : decl->getArrayDims())
+      evaluate(dim);
+    if (decl->getInitializer())
+      evaluate(decl->getInitializer());
+    shift(decl);
+  }
+
+public:
+  explicit LocShifter(int64_t delta) : delta(delta) {}
+
+  void run(Decl *decl) { evaluate(decl); }
+};
+} // namespace
+
+// Move the declaration (and all nodes inside of it) by delta bytes.
+void IncrementalParser::shiftDecl(Decl *decl, int64_t delta) {
+  if (delta)
+    LocShifter(delta).run(decl);
+}
+
+// Check whether every function in the token stream ends with its own NUF.
+// The parser lets the last function run up to the end of the stream after a
+// nested function, and such a function would swallow the declarations which
+// follow the stream.
+bool IncrementalParser::isTerminated(const TokenTable &tokens) {
+  int64_t open = 0;
+  for (uint32_t i = 0; i < tokens.size(); ++i) {
+    if (tokens.getKind(i) == TokenKind::kw_FUN)
+      ++open;
+    else if (tokens.getKind(i) == TokenKind::kw_NUF)
+      --open;
+  }
+  return open == 0;
+}
+
+// Parse the top-level declarations in the token stream, and record their
+// extents. Declarations in the candidates range of the current module whose
+// text did not change are reused instead of being parsed again.
+bool IncrementalParser::parseDecls(Parser &parser, const TokenTable &tokens,
+                                   Decls &decls,
+                                   std::vector<DeclExtent> &newExtents,
+                                   size_t firstCandidate,
+                                   size_t lastCandidate) {
+  llvm::StringRef buffer = buffers.back()->getBuffer();
+
+  auto getOffset = [&](const Token &tok) {
+    return parser.getLoc(tok).getOffset();
+  };
+
+  // Candidates for reuse, by their names. Each one is reused at most once.
+  llvm::DenseMap<IdentifierInfo *, llvm::SmallVector<size_t, 1>> candidates;
+  for (size_t i = firstCandidate; i < lastCandidate; ++i)
+    candidates[module->getBody()[i]->getIdentifier()].push_back(i);
+
+  // The last token of the stream is EOF.
+  auto numTokens = tokens.size() - 1;
+
+  while (!parser.isAtEnd()) {
+    auto firstTok = parser.current;
+    auto begin = getOffset(parser.peek());
+
+    // Look for a candidate with the same name and the same text. Its text
+    // must end with a token of this stream, so that both are lexed the same.
+    auto found = firstTok + 1 < numTokens &&
+                         tokens.getKind(firstTok + 1) == TokenKind::identifier
+                     ? candidates.find(tokens[firstTok + 1].getIdentifier())
+                     : candidates.end();
+    if (found != candidates.end()) {
+      auto &indices = found->second;
+      auto reused = std::find_if(indices.begin(), indices.end(), [&](size_t i) {
+        auto end = begin + (extents[i].end - extents[i].begin);
+        return end <= buffer.size() &&
+               llvm::xxHash64(buffer.slice(begin, end)) == extents[i].hash;
+      });
+
+      if (reused != indices.end()) {
+        auto end = begin + (extents[*reused].end - extents[*reused].begin);
+        auto lastTok = firstTok;
+        Token tok = tokens[lastTok];
+        while (lastTok + 1 < numTokens &&
+               getOffset(tok) + tok.getLength() < end)
+          tok = tokens[++lastTok];
+
+        if (getOffset(tok) + tok.getLength() == end) {
+          auto *decl = module->getBody()[*reused];
+          shiftDecl(decl,
+                    static_cast<int64_t>(begin) - extents[*reused].begin);
+          decls.push_back(decl);
+          newExtents.push_back({begin, end, extents[*reused].hash});
+          indices.erase(reused);
+          ++numReused;
+
+          parser.current = lastTok + 1;
+          continue;
+        }
+      }
+    }
+
+    auto *decl = llvm::dyn_cast_or_null<Decl>(parser.declaration(true));
+    if (!decl)
+      return false;
+
+    Token lastTok = parser.previous();
+    auto end = getOffset(lastTok) + lastTok.getLength();
+    decls.push_back(decl);
+    newExtents.push_back(
+        {begin, end, llvm::xxHash64(buffer.slice(begin, end))});
+    ++numParsed;
+  }
+
+  return !parser.lexFailed;
+}
+
+// Parse the whole revision into a new context.
+ModuleDecl *IncrementalParser::parseFull(llvm::SourceMgr &srcMgr,
+                                         Diag &diag) {
+  // Nothing points into the previous revisions anymore.
+  buffers.erase(buffers.begin(), buffers.end() - 1);
+  ctx = std::make_unique<ASTContext>(buffers.back()->getBuffer());
+  module = nullptr;
+  extents.clear();
+
+  auto numErrs = diag.getNumErrs();
+  Lexer lexer(srcMgr, diag, ctx->getIdentifierTable());
+  TokenTable tokens = std::move(lexer.lex());
+  if (diag.getNumErrs() > numErrs)
+    return nullptr;
+
+  Parser parser(tokens, diag, *ctx);
+  Token moduleToken = parser.peek();
+  Decls decls;
+  std::vector<DeclExtent> newExtents;
+  if (!parseDecls(parser, tokens, decls, newExtents))
+    return nullptr;
+
+  auto *moduleDecl =
+      ctx->create<ModuleDecl>(ctx->getIdentifierTable().get("main"),
+                              std::move(decls), parser.getLoc(moduleToken));
+  bytesAfterFullParse = ctx->getBytesAllocated();
+
+  // Declarations which the parser recovered from errors in can't be reused.
+  if (diag.getNumErrs() == numErrs && isTerminated(tokens)) {
+    module = moduleDecl;
+    extents = std::move(newExtents);
+  }
+  return moduleDecl;
+}
+
+// Parse only the part of the revision which changed since the previous one.
+// Returns null, without reporting anything, if the changed part does not parse
+// on its own.
+ModuleDecl *IncrementalParser::reparse(llvm::SourceMgr &srcMgr, Diag &diag) {
+  llvm::StringRef oldBuffer = buffers[buffers.size() - 2]->getBuffer();
+  llvm::StringRef newBuffer = buffers.back()->getBuffer();
+  ctx->setBuffer(newBuffer);
+
+  // The edit spans everything between the common prefix and the common
+  // suffix of the two revisions. Both are found a block at a time first.
+  const size_t blockSize = 256;
+  size_t minSize = std::min(oldBuffer.size(), newBuffer.size());
+  size_t prefix = 0;
+  while (prefix + blockSize <= minSize &&
+         !std::memcmp(oldBuffer.data() + prefix, newBuffer.data() + prefix,
+                      blockSize))
+    prefix += blockSize;
+  while (prefix < minSize && oldBuffer[prefix] == newBuffer[prefix])
+    ++prefix;
+  if (prefix == oldBuffer.size() && prefix == newBuffer.size())
+    return module;
+  size_t suffix = 0;
+  while (suffix + blockSize <= minSize - prefix &&
+         !std::memcmp(oldBuffer.end() - suffix - blockSize,
+                      newBuffer.end() - suffix - blockSize, blockSize))
+    suffix += blockSize;
+  while (suffix < minSize - prefix &&
+         oldBuffer[oldBuffer.size() - suffix - 1] ==
+             newBuffer[newBuffer.size() - suffix - 1])
+    ++suffix;
+  size_t oldEditEnd = oldBuffer.size() - suffix;
+  int64_t delta = static_cast<int64_t>(newBuffer.size()) -
+                  static_cast<int64_t>(oldBuffer.size());
+
+  // The first declaration touched by the edit. A declaration which ends
+  // right where the edit starts is touched as well, since the edit may extend
+  // its last token.
+  size_t first = std::partition_point(extents.begin(), extents.end(),
+                                      [&](const DeclExtent &extent) {
+                                        return extent.end < prefix;
+                                      }) -
+                 extents.begin();
+  // The first declaration after the edit. Lexing the edited part has to end
+  // at a token boundary, so the declaration must follow whitespace.
+  size_t last = std::partition_point(extents.begin() + first, extents.end(),
+                                     [&](const DeclExtent &extent) {
+                                       return extent.begin <= oldEditEnd;
+                                     }) -
+                extents.begin();
+  while (last < extents.size() &&
+         !llvm::isSpace(oldBuffer[extents[last].begin - 1]))
+    ++last;
+
+  uint32_t windowBegin = first ? extents[first - 1].end : 0;
+  uint32_t windowEnd =
+      (last < extents.size() ? extents[last].begin : oldBuffer.size()) + delta;
+
+  // Errors are reported by the full parse which we then fall back to, so
+  // the edited part reports into its own engine.
+  Diag windowDiag(srcMgr);
+  Lexer lexer(srcMgr, windowDiag, ctx->getIdentifierTable(),
+              newBuffer.slice(windowBegin, windowEnd));
+  TokenTable tokens = std::move(lexer.lex());
+  Parser parser(tokens, windowDiag, *ctx);
+  Decls windowDecls;
+  std::vector<DeclExtent> windowExtents;
+  if (windowDiag.getNumErrs() > 0 ||
+      !parseDecls(parser, tokens, windowDecls, windowExtents, first, last) ||
+      windowDiag.getNumErrs() > 0 || !isTerminated(tokens)) {
+    windowDiag.discard();
+    return nullptr;
+  }
+  diag.merge(windowDiag);
+
+  // Splice the new declarations in place of the touched ones, and move the
+  // declarations after the edit.
+  auto &body = module->getBody();
+  numReused += first + (body.size() - last);
+  Decls decls(body.begin(), body.begin() + first);
+  std::vector<DeclExtent> newExtents(extents.begin(), extents.begin() + first);
+  decls.insert(decls.end(), windowDecls.begin(), windowDecls.end());
+  newExtents.insert(newExtents.end(), windowExtents.begin(),
+                    windowExtents.end());
+  for (size_t i = last; i < body.size(); ++i) {
+    shiftDecl(body[i], delta);
+    decls.push_back(body[i]);
+    newExtents.push_back({static_cast<uint32_t>(extents[i].begin + delta),
+                          static_cast<uint32_t>(extents[i].end + delta),
+                          extents[i].hash});
+  }
+
+  auto loc = newExtents.empty() ? module->getLoc()
+                                : SourceLoc(newExtents.front().begin);
+  module =
+      ctx->create<ModuleDecl>(module->getIdentifier(), std::move(decls), loc);
+  extents = std::move(newExtents);
+  return module;
+}
+
+// Parse a new revision of the module. The buffer must be the main buffer of
+// srcMgr. Returns null on error.
+ModuleDecl *IncrementalParser::parse(std::unique_ptr<llvm::MemoryBuffer> buffer,
+                                     llvm::SourceMgr &srcMgr, Diag &diag) {
+  assert(buffer->getBufferStart() ==
+             srcMgr.getMemoryBuffer(srcMgr.getMainFileID())
+                 ->getBufferStart() &&
+         "Revision is not the main buffer.");
+  buffers.push_back(std::move(buffer));
+
+  // Start over once the replaced declarations take up as much memory as the
+  // live ones.
+  ModuleDecl *moduleDecl = nullptr;
+  if (module && ctx->getBytesAllocated() < 2 * bytesAfterFullParse)
+    moduleDecl = reparse(srcMgr, diag);
+  if (!moduleDecl)
+    moduleDecl = parseFull(srcMgr, diag);
+  return moduleDecl;
+}
@@ -1,3 +1,9 @@
+#include "llvm/Support/ThreadPool.h"
+#include "llvm/Support/Threading.h"
+#include <algorithm>
+#include <memory>
+#include <utility>
+
 #include "Parser.h"
 
 using namespace mxrlang;
@@ -16,41 +22,78 @@ bool Parser::match(TokenKind kind) {
 bool Parser::check(TokenKind kind) {
   if (isAtEnd())
     return false;
-  return peek().getKind() == kind;
+  return getKind(current) == kind;
 }
 
 // Advance the token stream.
-Token &Parser::advance() {
-  if (!isAtEnd())
+Token Parser::advance() {
+  if (!isAtEnd()) {
     current++;
+    if (lexer)
+      pull(current);
+  }
   return previous();
 }
 
 // Whether the current token signalizes the end of the token stream.
-bool Parser::isAtEnd() { return peek().getKind() == TokenKind::eof; }
+bool Parser::isAtEnd() {
+  if (lexer)
+    return getKind(current) == TokenKind::eof;
+  return current >= end;
+}
 
 // Return the next token, but don't advance the stream.
-Token &Parser::peek() { return *current; }
+Token Parser::peek() {
+  if (lexer)
+    return window[current % WindowSize];
+  return (*tokens)[current];
+}
 
 // Return the previous token.
-Token &Parser::previous() {
-  TokenIterator help = --current;
-  current++;
-
-  return *help;
+Token Parser::previous() {
+  assert(current > 0 && "No previous token.");
+  if (lexer)
+    return window[(current - 1) % WindowSize];
+  return (*tokens)[current - 1];
+}
+
+// Return the kind of the token with the given index.
+TokenKind Parser::getKind(uint32_t idx) {
+  if (lexer)
+    return window[idx % WindowSize].getKind();
+  return tokens->getKind(idx);
+}
+
+// In streaming mode, lex the token with the given index into the window.
+void Parser::pull(uint32_t idx) {
+  Token &tok = window[idx % WindowSize];
+  // The lexer only sets the kind of the EOF token, so start from the previous
+  // token, just like the token table does.
+  if (idx > 0)
+    tok = window[(idx - 1) % WindowSize];
+  lexer->next(tok);
+
+  // The lexer has already reported the unknown token. Stop parsing here, as
+  // the whole-file mode would never have started parsing in the first place.
+  if (tok.is(TokenKind::unknown)) {
+    lexFailed = true;
+    tok.setKind(TokenKind::eof);
+  }
 }
 
 // Check whether the next token matches the expected and advance the stream
-// if it does. Conversely, throw an error.
-Token &Parser::consume(std::initializer_list<TokenKind> kinds, DiagID diagID,
-                       std::string args...) {
+// if it does. Conversely, report an error and return false.
+bool Parser::consume(std::initializer_list<TokenKind> kinds, DiagID diagID,
+                     std::string args...) {
   for (auto kind = kinds.begin(); kind != kinds.end(); kind++) {
-    if (check(*kind))
-      return advance();
+    if (check(*kind)) {
+      advance();
+      return true;
+    }
   }
 
-  auto perror = error(peek(), diagID, std::move(args));
-  throw perror;
+  error(peek(), diagID, std::move(args));
+  return false;
 }
 
 // Discard the (possibly) erroneous tokens until we see one of the
@@ -83,12 +126,14 @@ void Parser::synchronize() {
   }
 }
 
-// Report an error and throw an exception.
-Parser::ParserError Parser::error(const Token &tok, DiagID id,
-                                  std::string args...) {
-  diag.report(tok.getLocation(), id, args);
-  auto perror = ParserError();
-  return perror;
+// Report an error. Returns null, so that the productions can report and bail
+// out in a single statement.
+std::nullptr_t Parser::error(const Token &tok, DiagID id,
+                             std::string args...) {
+  // Errors caused by the stream ending at an unknown token are just noise.
+  if (!lexFailed)
+    diag.report(tok.getLocation(), id, args);
+  return nullptr;
 }
 
 // Helper which creates a VarStmt while parsing variable declarations,
@@ -97,49 +142,86 @@ VarDecl *Parser::parseSingleVar(bool isFunArg, bool isGlobalScope) {
   assert(!isFunArg || !isGlobalScope);
 
   // Parse the variable name.
-  const Token &name =
-      consume({TokenKind::identifier}, DiagID::err_expect, "identifer"s);
+  if (!consume({TokenKind::identifier}, DiagID::err_expect, "identifer"s))
+    return nullptr;
+  Token name = previous();
 
-  consume({TokenKind::colon}, DiagID::err_expect, ":"s);
+  if (!consume({TokenKind::colon}, DiagID::err_expect, ":"s))
+    return nullptr;
 
-  // Parse the type.
-  auto *varType = parseType();
+  // Parse the type. Array sizes of variables (but not of function arguments)
+  // may be computed.
+  Exprs arrayDims;
+  auto *varType = parseType(isFunArg ? nullptr : &arrayDims);
+  if (!varType)
+    return nullptr;
 
   // Parse the initializer, if it exists.
   Expr *initializer = nullptr;
-  if (!isFunArg && match(TokenKind::colonequal))
+  if (!isFunArg && match(TokenKind::colonequal)) {
     initializer = expression();
+    if (!initializer)
+      return nullptr;
+  }
 
   // Decay the array type if this is a function argument.
   if (isFunArg && varType->getTypeKind() == Type::TypeKind::Array)
-    varType = llvm::dyn_cast<ArrayType>(varType)->decay();
-
-  return new VarDecl(name.getData(), initializer, varType,
-                     /* global= */ isGlobalScope, name.getLocation());
+    varType = llvm::dyn_cast<ArrayType>(varType)->decay(ctx);
+
+  if (arrayDims.empty())
+    return ctx.create<VarDecl>(name.getIdentifier(), initializer, varType,
+                               /* global= */ isGlobalScope, getLoc(name));
+
+  // The type is set once the semantic check computes the array sizes.
+  auto *varDecl =
+      ctx.create<VarDecl>(name.getIdentifier(), initializer,
+                          Type::getNoneType(), isGlobalScope, getLoc(name));
+  varDecl->setArrayDims(std::move(arrayDims), varType);
+  if (!isGlobalScope)
+    seenComputedArray = true;
+  return varDecl;
 }
 
-// Parse a type declaration.
-Type *Parser::parseType() {
-  const Token &typeTok = consume({TokenKind::kw_INT, TokenKind::kw_BOOL},
-                                 DiagID::err_expect, "type");
-  auto *type = Type::getTypeFromToken(typeTok);
+// Parse a type declaration. If arrayDims is given, array sizes may be any
+// expressions. If one of them is not an integer literal, all the sizes are
+// moved to arrayDims, and the element type is returned.
+Type *Parser::parseType(Exprs *arrayDims) {
+  if (!consume({TokenKind::kw_INT, TokenKind::kw_BOOL, TokenKind::kw_INT8,
+                TokenKind::kw_INT16, TokenKind::kw_INT32, TokenKind::kw_UINT,
+                TokenKind::kw_UINT8, TokenKind::kw_UINT16,
+                TokenKind::kw_UINT32},
+               DiagID::err_expect, "type"))
+    return nullptr;
+  auto *type = Type::getTypeFromToken(previous());
 
   while (match(TokenKind::star))
-    type = new PointerType(type);
+    type = PointerType::get(ctx, type);
 
   Exprs elNums;
+  bool computed = false;
   while (match(TokenKind::openbracket)) {
-    auto *elNumExpr = primary();
-    if (!llvm::isa<IntLiteralExpr>(elNumExpr))
-      throw error(previous(), DiagID::err_array_size_not_int, ""s);
+    auto *elNumExpr = expression(false);
+    if (!elNumExpr)
+      return nullptr;
+    if (!llvm::isa<IntLiteralExpr>(elNumExpr)) {
+      if (!arrayDims)
+        return error(previous(), DiagID::err_array_size_not_int, ""s);
+      computed = true;
+    }
     elNums.push_back(elNumExpr);
 
-    consume({TokenKind::closedbracket}, DiagID::err_expect, "]"s);
+    if (!consume({TokenKind::closedbracket}, DiagID::err_expect, "]"s))
+      return nullptr;
+  }
+
+  if (computed) {
+    *arrayDims = std::move(elNums);
+    return type;
   }
 
   for (auto it = elNums.rbegin(); it != elNums.rend(); ++it)
-    type =
-        new ArrayType(type, llvm::dyn_cast<IntLiteralExpr>(*it)->getRawValue());
+    type = ArrayType::get(ctx, type,
+                          llvm::dyn_cast<IntLiteralExpr>(*it)->getValue());
 
   return type;
 }
@@ -147,61 +229,81 @@ Type *Parser::parseType() {
 // FIXME: We currently allow parsing internal functions,
 // although they are not implemented.
 Node *Parser::declaration(bool isGlobalScope) {
-  try {
-    if (match(TokenKind::kw_VAR)) {
-      return varDeclaration(isGlobalScope);
-    } else if (match(TokenKind::kw_FUN))
-      return funDeclaration();
-    return statement();
-  } catch (ParserError &e) {
+  Node *node = nullptr;
+  if (match(TokenKind::kw_VAR))
+    node = varDeclaration(isGlobalScope);
+  else if (match(TokenKind::kw_FUN))
+    node = funDeclaration();
+  else
+    node = statement();
+
+  // A production returns null only after reporting an error. Recover by
+  // skipping to the next declaration or statement.
+  if (!node)
     synchronize();
-    return nullptr;
-  }
+  return node;
 }
 
 Decl *Parser::funDeclaration() {
-  Token &funToken = previous();
-  Token &funName =
-      consume({TokenKind::identifier}, DiagID::err_expect, "identifier"s);
+  Token funToken = previous();
+  if (!consume({TokenKind::identifier}, DiagID::err_expect, "identifier"s))
+    return nullptr;
+  Token funName = previous();
 
   // Parse the return type.
-  consume({TokenKind::colon}, DiagID::err_expect, ":"s);
+  if (!consume({TokenKind::colon}, DiagID::err_expect, ":"s))
+    return nullptr;
   auto *retType = parseType();
+  if (!retType)
+    return nullptr;
 
   // Parse function arguments.
   FunDeclArgs args;
-  consume({TokenKind::openpar}, DiagID::err_expect, ")"s);
+  if (!consume({TokenKind::openpar}, DiagID::err_expect, ")"s))
+    return nullptr;
 
   while (!match(TokenKind::closedpar) && !isAtEnd()) {
     // Store the argument as VarStmt.
-    args.push_back(parseSingleVar(true));
+    auto *arg = parseSingleVar(true);
+    if (!arg)
+      return nullptr;
+    args.push_back(arg);
 
     bool seenComma = match(TokenKind::comma);
     if (!seenComma && (peek().getKind() != TokenKind::closedpar))
-      throw error(peek(), DiagID::err_expect, ",");
+      return error(peek(), DiagID::err_expect, ",");
     if (seenComma && (peek().getKind() == TokenKind::closedpar))
-      throw error(peek(), DiagID::err_expect, "function argument");
+      return error(peek(), DiagID::err_expect, "function argument");
   }
 
   if (previous().isNot(TokenKind::closedpar))
-    throw error(previous(), DiagID::err_expect, ")");
+    return error(previous(), DiagID::err_expect, ")");
 
   // Parse the function body
   Nodes body;
+  bool enclosingSeenComputedArray = std::exchange(seenComputedArray, false);
   while (!match(TokenKind::kw_NUF) && !isAtEnd())
     body.emplace_back(declaration());
+  bool computedArrays =
+      std::exchange(seenComputedArray, enclosingSeenComputedArray);
 
   if (previous().isNot(TokenKind::kw_NUF))
-    throw error(previous(), DiagID::err_expect,
-                "NUF at the end of function definition");
+    return error(previous(), DiagID::err_expect,
+                 "NUF at the end of function definition");
 
-  return new FunDecl(funName.getData(), retType, std::move(args),
-                     std::move(body), funToken.getLocation());
+  auto *funDecl =
+      ctx.create<FunDecl>(funName.getIdentifier(), retType, std::move(args),
+                          std::move(body), getLoc(funToken));
+  funDecl->setComputedArrays(computedArrays);
+  return funDecl;
 }
 
 Decl *Parser::varDeclaration(bool isGlobalScope) {
   auto *varDecl = parseSingleVar(false, /* global= */ isGlobalScope);
-  consume({TokenKind::semicolon}, DiagID::err_expect, ";"s);
+  if (!varDecl)
+    return nullptr;
+  if (!consume({TokenKind::semicolon}, DiagID::err_expect, ";"s))
+    return nullptr;
 
   return varDecl;
 }
@@ -223,27 +325,33 @@ Stmt *Parser::statement() {
 
 Stmt *Parser::exprStmt() {
   Expr *expr = expression();
-  consume({TokenKind::semicolon}, DiagID::err_expect, ";"s);
+  if (!expr)
+    return nullptr;
+  if (!consume({TokenKind::semicolon}, DiagID::err_expect, ";"s))
+    return nullptr;
 
-  return new ExprStmt(expr, expr->getLoc());
+  return ctx.create<ExprStmt>(expr, expr->getLoc());
 }
 
 Stmt *Parser::ifStmt() {
-  auto loc = previous().getLocation();
+  auto loc = getLoc(previous());
   Nodes thenBody;
   Nodes elseBody;
   // Parse the IF condition.
   Expr *cond = expression();
+  if (!cond)
+    return nullptr;
 
-  consume({TokenKind::kw_THEN}, DiagID::err_expect, "THEN"s);
+  if (!consume({TokenKind::kw_THEN}, DiagID::err_expect, "THEN"s))
+    return nullptr;
 
   // Parse the statements in the THEN block.
   while (!(match(TokenKind::kw_ELSE) || match(TokenKind::kw_FI)) && !isAtEnd())
     thenBody.push_back(declaration());
 
   if (!previous().isOneOf(TokenKind::kw_ELSE, TokenKind::kw_FI))
-    throw error(previous(), DiagID::err_expect,
-                "FI at the end of IF statement");
+    return error(previous(), DiagID::err_expect,
+                 "FI at the end of IF statement");
 
   // Parse the statements in the ELSE block.
   if (previous().getKind() == TokenKind::kw_ELSE) {
@@ -252,323 +360,347 @@ Stmt *Parser::ifStmt() {
     }
 
     if (previous().isNot(TokenKind::kw_FI))
-      throw error(previous(), DiagID::err_expect,
-                  "FI at the end of IF statement");
+      return error(previous(), DiagID::err_expect,
+                   "FI at the end of IF statement");
   }
 
-  return new IfStmt(cond, std::move(thenBody), std::move(elseBody), loc);
+  return ctx.create<IfStmt>(cond, std::move(thenBody), std::move(elseBody),
+                            loc);
 }
 
 Stmt *Parser::whileStmt() {
-  auto loc = previous().getLocation();
+  auto loc = getLoc(previous());
   Nodes body;
   // Parse the WHILE condition.
   Expr *cond = expression();
+  if (!cond)
+    return nullptr;
 
-  consume({TokenKind::kw_DO}, DiagID::err_expect, "DO"s);
+  if (!consume({TokenKind::kw_DO}, DiagID::err_expect, "DO"s))
+    return nullptr;
 
   // Parse the body.
   while (!match(TokenKind::kw_ELIHW) && !isAtEnd())
     body.push_back(declaration());
 
   if (previous().isNot(TokenKind::kw_ELIHW))
-    throw error(previous(), DiagID::err_expect,
-                "ELIHW at the end of WHILE statement");
+    return error(previous(), DiagID::err_expect,
+                 "ELIHW at the end of WHILE statement");
 
-  return new WhileStmt(cond, std::move(body), loc);
+  return ctx.create<WhileStmt>(cond, std::move(body), loc);
 }
 
 Stmt *Parser::printStmt() {
-  auto loc = previous().getLocation();
+  auto loc = getLoc(previous());
   Expr *printExpr = expression();
+  if (!printExpr)
+    return nullptr;
 
-  consume({TokenKind::semicolon}, DiagID::err_expect, ";"s);
-  return new PrintStmt(printExpr, loc);
+  if (!consume({TokenKind::semicolon}, DiagID::err_expect, ";"s))
+    return nullptr;
+  return ctx.create<PrintStmt>(printExpr, loc);
 }
 
 Stmt *Parser::returnStmt() {
-  auto loc = previous().getLocation();
+  auto loc = getLoc(previous());
   Expr *retExpr = nullptr;
 
-  if (!check(TokenKind::semicolon))
+  if (!check(TokenKind::semicolon)) {
     retExpr = expression();
+    if (!retExpr)
+      return nullptr;
+  }
 
-  consume({TokenKind::semicolon}, DiagID::err_expect, ";"s);
-  return new ReturnStmt(retExpr, loc);
+  if (!consume({TokenKind::semicolon}, DiagID::err_expect, ";"s))
+    return nullptr;
+  return ctx.create<ReturnStmt>(retExpr, loc);
 }
 
 Stmt *Parser::scanStmt() {
-  auto loc = previous().getLocation();
+  auto loc = getLoc(previous());
   Expr *scanExpr = expression();
+  if (!scanExpr)
+    return nullptr;
 
   if (!llvm::isa<LoadExpr>(scanExpr))
-    throw error(peek(), DiagID::err_expect, "variable"s);
-
-  consume({TokenKind::semicolon}, DiagID::err_expect, ";"s);
-  return new ScanStmt(scanExpr, loc);
-}
-
-Expr *Parser::expression() { return assignment(); }
-
-Expr *Parser::assignment() {
-  auto *expr = logicalOr();
-
-  if (match(TokenKind::colonequal)) {
-    auto *source = logicalOr();
-    expr = new AssignExpr(expr, source, expr->getLoc());
-  }
-
-  return expr;
-}
-
-Expr *Parser::logicalOr() {
-  auto *expr = logicalAnd();
-
-  while (match(TokenKind::logicor)) {
-    auto opString = previous().getData();
-    auto *right = logicalAnd();
-    expr = new BinaryLogicalExpr(BinaryLogicalExpr::BinaryLogicalExprKind::Or,
-                                 expr, right, opString, expr->getLoc());
-  }
-
-  return expr;
-}
-
-Expr *Parser::logicalAnd() {
-  auto *expr = equality();
-
-  while (match(TokenKind::logicand)) {
-    auto opString = previous().getData();
-    auto *right = equality();
-    expr = new BinaryLogicalExpr(BinaryLogicalExpr::BinaryLogicalExprKind::And,
-                                 expr, right, opString, expr->getLoc());
-  }
-
-  return expr;
-}
+    return error(peek(), DiagID::err_expect, "variable"s);
 
-Expr *Parser::equality() {
-  auto *expr = comparison();
-
-  while (match(TokenKind::equal) || match(TokenKind::noteq)) {
-    auto opString = previous().getData();
-    BinaryLogicalExpr::BinaryLogicalExprKind kind;
-    switch (previous().getKind()) {
-    case TokenKind::equal:
-      kind = BinaryLogicalExpr::BinaryLogicalExprKind::Eq;
-      break;
-    case TokenKind::noteq:
-      kind = BinaryLogicalExpr::BinaryLogicalExprKind::NotEq;
-      break;
-    default:
-      llvm_unreachable("Wrong binary comparison operator.");
+  if (!consume({TokenKind::semicolon}, DiagID::err_expect, ";"s))
+    return nullptr;
+  return ctx.create<ScanStmt>(scanExpr, loc);
+}
+
+// Parse an expression by precedence climbing. Operands are parsed by
+// primary(), and are bound to the binary operators according to the
+// precedence table in TokenKinds.def. Operators waiting for their right
+// operand, open parentheses, conversions, calls and array accesses are kept
+// on an explicit stack, so neither long operator chains nor deeply nested
+// expressions recurse.
+//
+// Only one assignment is allowed per parenthesized group (and per argument of
+// a call), none in array indices, and none at the top level if
+// allowAssignment is false.
+Expr *Parser::expression(bool allowAssignment) {
+  // Either a binary operator waiting for its right operand, or a group of
+  // operators closed by a ')' or a ']' (or, for the outermost group, by any
+  // token which is not a binary operator). Each argument of a call and each
+  // index of an array access is a group of its own.
+  enum class PendingKind { Binary, Group, Cast, Call, Index };
+  struct PendingOp {
+    PendingKind kind;
+    // Binary operator, or the prefix operator applied to the group (unknown
+    // if there is none).
+    TokenKind op;
+    // Whether the group may still contain an assignment.
+    bool allowAssignment;
+    // Left operand of a binary operator, or the accessed array variable.
+    Expr *left;
+    // Type which the group is converted to, if it is a conversion.
+    Type *destType = nullptr;
+    // Location of the type of a conversion, or of the name of the called
+    // function or accessed array.
+    SourceLoc loc = SourceLoc();
+    // Name of the called function.
+    IdentifierInfo *name = nullptr;
+    // Arguments of a call, or indices of an array access, parsed so far.
+    Exprs operands = Exprs();
+  };
+  llvm::SmallVector<PendingOp, 8> stack;
+  stack.push_back(
+      {PendingKind::Group, TokenKind::unknown, allowAssignment, nullptr});
+
+  while (true) {
+    // Parse an operand, with an optional prefix operator.
+    TokenKind prefix = TokenKind::unknown;
+    if (match(TokenKind::bang) || match(TokenKind::minus) ||
+        match(TokenKind::ampersand) || match(TokenKind::star))
+      prefix = previous().getKind();
+
+    if (match(TokenKind::openpar)) {
+      stack.push_back({PendingKind::Group, prefix, true, nullptr});
+      continue;
     }
 
-    auto *right = comparison();
-    expr = new BinaryLogicalExpr(kind, expr, right, opString, expr->getLoc());
-  }
-
-  return expr;
-}
-
-Expr *Parser::comparison() {
-  auto *expr = addSub();
-
-  while (match(TokenKind::greater) || match(TokenKind::greatereq) ||
-         match(TokenKind::less) || match(TokenKind::lesseq)) {
-    auto opString = previous().getData();
-    BinaryLogicalExpr::BinaryLogicalExprKind kind;
-    switch (previous().getKind()) {
-    case TokenKind::greater:
-      kind = BinaryLogicalExpr::BinaryLogicalExprKind::Greater;
-      break;
-    case TokenKind::greatereq:
-      kind = BinaryLogicalExpr::BinaryLogicalExprKind::GreaterEq;
-      break;
-    case TokenKind::less:
-      kind = BinaryLogicalExpr::BinaryLogicalExprKind::Less;
-      break;
-    case TokenKind::lesseq:
-      kind = BinaryLogicalExpr::BinaryLogicalExprKind::LessEq;
-      break;
-    default:
-      llvm_unreachable("Wrong binary comparison operator.");
+    // A type followed by '(' is a conversion to that type. The converted
+    // expression is a group, which is converted once it is closed.
+    if (auto *destType = Type::getTypeFromToken(peek())) {
+      auto typeToken = advance();
+      if (!consume({TokenKind::openpar}, DiagID::err_expect, "("s))
+        return nullptr;
+      stack.push_back({PendingKind::Cast, prefix, true, nullptr, destType,
+                       getLoc(typeToken)});
+      continue;
     }
 
-    auto *right = addSub();
-    expr = new BinaryLogicalExpr(kind, expr, right, opString, expr->getLoc());
-  }
-
-  return expr;
-}
-
-Expr *Parser::addSub() {
-  auto *expr = mulDiv();
-
-  while (match(TokenKind::plus) || match(TokenKind::minus)) {
-    auto opString = previous().getData();
-    BinaryArithExpr::BinaryArithExprKind kind;
-    switch (previous().getKind()) {
-    case TokenKind::plus:
-      kind = BinaryArithExpr::BinaryArithExprKind::Add;
-      break;
-    case TokenKind::minus:
-      kind = BinaryArithExpr::BinaryArithExprKind::Sub;
-      break;
-    default:
-      llvm_unreachable("Wrong binary arithmetic operator.");
+    Expr *expr = nullptr;
+    if (match(TokenKind::identifier)) {
+      Token name = previous();
+      if (match(TokenKind::openpar)) {
+        // If we see '(', this is a function call, whose arguments are
+        // parsed as groups.
+        if (!match(TokenKind::closedpar)) {
+          stack.push_back({PendingKind::Call, prefix, true, nullptr, nullptr,
+                           getLoc(name), name.getIdentifier()});
+          continue;
+        }
+        expr = ctx.create<CallExpr>(name.getIdentifier(), FunCallArgs(),
+                                    getLoc(name));
+      } else if (match(TokenKind::openbracket)) {
+        // If we see '[' this is array indexing, whose indices are parsed as
+        // groups.
+        auto *var = ctx.create<VarExpr>(name.getIdentifier(), getLoc(name));
+        stack.push_back(
+            {PendingKind::Index, prefix, false, var, nullptr, getLoc(name)});
+        continue;
+      } else {
+        // Otherwise, it's a variable access.
+        //
+        // Always load the variable for now. Semantic check will remove
+        // redundant loads.
+        expr = ctx.create<LoadExpr>(
+            ctx.create<VarExpr>(name.getIdentifier(), getLoc(name)),
+            getLoc(name));
+      }
+    } else {
+      expr = primary();
     }
-
-    auto *right = mulDiv();
-    expr = new BinaryArithExpr(kind, expr, right, opString, expr->getLoc());
-  }
-
-  return expr;
-}
-
-Expr *Parser::mulDiv() {
-  auto *expr = unary();
-
-  while (match(TokenKind::star) || match(TokenKind::slash)) {
-    auto opString = previous().getData();
-    BinaryArithExpr::BinaryArithExprKind kind;
-    switch (previous().getKind()) {
-    case TokenKind::star:
-      kind = BinaryArithExpr::BinaryArithExprKind::Mul;
-      break;
-    case TokenKind::slash:
-      kind = BinaryArithExpr::BinaryArithExprKind::Div;
-      break;
-    default:
-      llvm_unreachable("Wrong binary arithmetic operator.");
+    if (!expr)
+      return nullptr;
+    if (prefix != TokenKind::unknown)
+      expr = createPrefix(prefix, expr);
+
+    // Bind the operand to the pending operators, until we see the next binary
+    // operator, or the next argument or index of the enclosing group.
+    bool nextOperand = false;
+    while (!nextOperand) {
+      TokenKind op = getKind(current);
+      Precedence prec = getBinaryPrecedence(op);
+
+      // Operators are left associative.
+      while (stack.back().kind == PendingKind::Binary &&
+             getBinaryPrecedence(stack.back().op) >= prec) {
+        auto pending = stack.pop_back_val();
+        expr = createBinary(pending.op, pending.left, expr);
+      }
+
+      if (op == TokenKind::colonequal) {
+        if (stack.back().allowAssignment)
+          stack.back().allowAssignment = false;
+        else
+          prec = Precedence::Unknown;
+      }
+
+      if (prec != Precedence::Unknown) {
+        advance();
+        stack.push_back({PendingKind::Binary, op, false, expr});
+        break;
+      }
+
+      // This is the end of the group.
+      if (stack.size() == 1)
+        return expr;
+
+      auto &group = stack.back();
+      switch (group.kind) {
+      case PendingKind::Call:
+        group.operands.push_back(expr);
+        if (match(TokenKind::comma)) {
+          if (peek().is(TokenKind::closedpar))
+            return error(previous(), DiagID::err_expect, "expression"s);
+          group.allowAssignment = true;
+          nextOperand = true;
+          continue;
+        }
+        if (peek().isNot(TokenKind::closedpar))
+          return error(previous(), DiagID::err_expect, ","s);
+        advance();
+        expr = ctx.create<CallExpr>(group.name, std::move(group.operands),
+                                    group.loc);
+        break;
+      case PendingKind::Index:
+        if (!consume({TokenKind::closedbracket}, DiagID::err_expect, "]"s))
+          return nullptr;
+        group.operands.push_back(expr);
+        // Create as many array accesses as we have []'s.
+        if (match(TokenKind::openbracket)) {
+          nextOperand = true;
+          continue;
+        }
+        expr = group.left;
+        for (auto *index : group.operands)
+          expr = ctx.create<ArrayAccessExpr>(expr, index, getLoc(previous()));
+        // Always perform the load after array access. Semantic check will
+        // remove the load if we are accessing for writing.
+        expr = ctx.create<LoadExpr>(expr, group.loc);
+        break;
+      default:
+        if (!consume({TokenKind::closedpar}, DiagID::err_expect, ")"s))
+          return nullptr;
+        if (group.kind == PendingKind::Cast)
+          expr = ctx.create<CastExpr>(group.destType, expr, group.loc);
+        break;
+      }
+
+      auto groupOp = group.op;
+      stack.pop_back();
+      if (groupOp != TokenKind::unknown)
+        expr = createPrefix(groupOp, expr);
     }
-
-    auto *right = unary();
-    expr = new BinaryArithExpr(kind, expr, right, opString, expr->getLoc());
   }
-
-  return expr;
 }
 
-Expr *Parser::unary() {
-  if (match(TokenKind::bang) || match(TokenKind::minus)) {
-    auto opString = previous().getData();
-    UnaryExpr::UnaryExprKind kind;
-    switch (previous().getKind()) {
-    case TokenKind::bang:
-      kind = UnaryExpr::UnaryExprKind::NegLogic;
-      break;
-    case TokenKind::minus:
-      kind = UnaryExpr::UnaryExprKind::NegArith;
-      break;
-    default:
-      llvm_unreachable("Wrong unary operator.");
-    }
-
-    auto *expr = primary();
-    return new UnaryExpr(kind, expr, opString, expr->getLoc());
+// Create the node of a binary operator.
+Expr *Parser::createBinary(TokenKind op, Expr *left, Expr *right) {
+  switch (op) {
+  case TokenKind::colonequal:
+    return ctx.create<AssignExpr>(left, right, left->getLoc());
+  case TokenKind::plus:
+    return ctx.create<BinaryArithExpr>(
+        BinaryArithExpr::BinaryArithExprKind::Add, left, right, left->getLoc());
+  case TokenKind::minus:
+    return ctx.create<BinaryArithExpr>(
+        BinaryArithExpr::BinaryArithExprKind::Sub, left, right, left->getLoc());
+  case TokenKind::star:
+    return ctx.create<BinaryArithExpr>(
+        BinaryArithExpr::BinaryArithExprKind::Mul, left, right, left->getLoc());
+  case TokenKind::slash:
+    return ctx.create<BinaryArithExpr>(
+        BinaryArithExpr::BinaryArithExprKind::Div, left, right, left->getLoc());
+  default:
+    break;
   }
 
-  if (match(TokenKind::ampersand) || match(TokenKind::star)) {
-    auto opString = previous().getData();
-    PointerOpExpr::PointerOpKind kind;
-    switch (previous().getKind()) {
-    case TokenKind::ampersand:
-      kind = PointerOpExpr::PointerOpKind::AddressOf;
-      break;
-    case TokenKind::star:
-      kind = PointerOpExpr::PointerOpKind::Dereference;
-      break;
-    default:
-      llvm_unreachable("Wrong pointer operation.");
-    }
-
-    Expr *expr = primary();
-    expr = new PointerOpExpr(kind, expr, opString, expr->getLoc());
-    if (kind == PointerOpExpr::PointerOpKind::Dereference)
-      // Always perform the load after dereferencing. Semantic check will remove
-      // the load if we are dereferencing for writing.
-      expr = new LoadExpr(expr, expr->getLoc());
-
-    return expr;
+  BinaryLogicalExpr::BinaryLogicalExprKind kind;
+  switch (op) {
+  case TokenKind::logicand:
+    kind = BinaryLogicalExpr::BinaryLogicalExprKind::And;
+    break;
+  case TokenKind::logicor:
+    kind = BinaryLogicalExpr::BinaryLogicalExprKind::Or;
+    break;
+  case TokenKind::equal:
+    kind = BinaryLogicalExpr::BinaryLogicalExprKind::Eq;
+    break;
+  case TokenKind::noteq:
+    kind = BinaryLogicalExpr::BinaryLogicalExprKind::NotEq;
+    break;
+  case TokenKind::greater:
+    kind = BinaryLogicalExpr::BinaryLogicalExprKind::Greater;
+    break;
+  case TokenKind::greatereq:
+    kind = BinaryLogicalExpr::BinaryLogicalExprKind::GreaterEq;
+    break;
+  case TokenKind::less:
+    kind = BinaryLogicalExpr::BinaryLogicalExprKind::Less;
+    break;
+  case TokenKind::lesseq:
+    kind = BinaryLogicalExpr::BinaryLogicalExprKind::LessEq;
+    break;
+  default:
+    llvm_unreachable("Wrong binary operator.");
   }
 
-  return primary();
+  return ctx.create<BinaryLogicalExpr>(kind, left, right, left->getLoc());
+}
+
+// Create the node of a prefix operator.
+Expr *Parser::createPrefix(TokenKind op, Expr *expr) {
+  switch (op) {
+  case TokenKind::bang:
+    return ctx.create<UnaryExpr>(UnaryExpr::UnaryExprKind::NegLogic, expr,
+                                 expr->getLoc());
+  case TokenKind::minus:
+    return ctx.create<UnaryExpr>(UnaryExpr::UnaryExprKind::NegArith, expr,
+                                 expr->getLoc());
+  case TokenKind::ampersand:
+    return ctx.create<PointerOpExpr>(PointerOpExpr::PointerOpKind::AddressOf,
+                                     expr, expr->getLoc());
+  case TokenKind::star: {
+    auto *deref = ctx.create<PointerOpExpr>(
+        PointerOpExpr::PointerOpKind::Dereference, expr, expr->getLoc());
+    // Always perform the load after dereferencing. Semantic check will remove
+    // the load if we are dereferencing for writing.
+    return ctx.create<LoadExpr>(deref, deref->getLoc());
+  }
+  default:
+    llvm_unreachable("Wrong prefix operator.");
+  }
 }
 
+// Parse an operand which is not a variable, a call, an array access, a
+// conversion or a parenthesized expression. Those are parsed by expression(),
+// which keeps the ones still open on its stack.
 Expr *Parser::primary() {
   if (match(TokenKind::kw_TRUE) || match(TokenKind::kw_FALSE)) {
     bool value = previous().getKind() == TokenKind::kw_TRUE ? true : false;
-    return new BoolLiteralExpr(value, previous().getLocation());
-  } else if (match(TokenKind::openpar)) {
-    auto *expr = expression();
-    consume({TokenKind::closedpar}, DiagID::err_expect, ")"s);
-    return expr;
+    return ctx.create<BoolLiteralExpr>(value, getLoc(previous()));
   } else if (peek().is(TokenKind::opencurly)) {
     return arrayInit();
   } else if (match(TokenKind::integer_literal))
-    return new IntLiteralExpr(previous().getData(), previous().getLocation());
-  else if (match(TokenKind::identifier))
-    return identifier();
-
-  throw error(peek(), DiagID::err_expect, "expression"s);
-}
+    return ctx.create<IntLiteralExpr>(previous().getIntValue(),
+                                      getLoc(previous()));
 
-Expr *Parser::identifier() {
-  Token &name = previous();
-  Expr *expr = new VarExpr(name.getData(), name.getLocation());
-
-  // If we see '(', this is a function call.
-  if (match(TokenKind::openpar))
-    return funCall(name);
-  else if (match(TokenKind::openbracket)) {
-    // If we see '[' this is array indexing.
-    expr = arrayAccess(expr);
-
-    // Always perform the load after array access. Semantic check will remove
-    // the load if we are accessing for writing.
-    return new LoadExpr(expr, name.getLocation());
-  } else {
-    // Otherwise, it's a variable access.
-    //
-    // Always load the variable for now. Semantic check will remove redundant
-    // loads.
-    return new LoadExpr(expr, name.getLocation());
-  }
-}
-
-Expr *Parser::funCall(const Token &name) {
-  FunCallArgs args;
-  while (!match(TokenKind::closedpar) && !isAtEnd()) {
-    // Parse the argument as an expression.
-    args.push_back(expression());
-
-    bool seenComma = match(TokenKind::comma);
-    if (!seenComma && peek().isNot(TokenKind::closedpar))
-      throw error(previous(), DiagID::err_expect, ",");
-    if (seenComma && peek().is(TokenKind::closedpar))
-      throw error(previous(), DiagID::err_expect, "expression");
-  }
-
-  if (previous().isNot(TokenKind::closedpar))
-    throw error(previous(), DiagID::err_expect, ")");
-
-  return new CallExpr(name.getData(), std::move(args), name.getLocation());
-}
-
-Expr *Parser::arrayAccess(Expr *var) {
-  // Create as many array accesses as we have []'s.
-  Exprs elements;
-  do {
-    auto *element = logicalOr();
-    consume({TokenKind::closedbracket}, DiagID::err_expect, "]"s);
-    elements.push_back(element);
-  } while (match(TokenKind::openbracket));
-
-  for (auto *element : elements)
-    var = new ArrayAccessExpr(var, element, previous().getLocation());
-
-  return var;
+  return error(peek(), DiagID::err_expect, "expression"s);
 }
 
 Expr *Parser::arrayInit() {
@@ -584,38 +716,132 @@ Expr *Parser::arrayInit() {
     Expr *val = nullptr;
     if (isAllList) {
       val = arrayInit();
+      if (!val)
+        return nullptr;
       if (val->getKind() != Expr::ExprKind::ArrayInit)
-        throw error(errTok, DiagID::err_array_init_not_uniform, "");
+        return error(errTok, DiagID::err_array_init_not_uniform, "");
     } else {
       val = expression();
+      if (!val)
+        return nullptr;
       if (val->getKind() == Expr::ExprKind::ArrayInit)
-        throw error(errTok, DiagID::err_array_init_not_uniform, "");
+        return error(errTok, DiagID::err_array_init_not_uniform, "");
     }
     vals.push_back(val);
 
     bool seenComma = match(TokenKind::comma);
     if (!seenComma && peek().isNot(TokenKind::closedcurly))
-      throw error(previous(), DiagID::err_expect, ",");
+      return error(previous(), DiagID::err_expect, ",");
     if (seenComma && peek().is(TokenKind::closedcurly))
-      throw error(previous(), DiagID::err_expect, "expression");
+      return error(previous(), DiagID::err_expect, "expression");
   }
 
-  return new ArrayInitExpr(vals, errTok.getLocation());
+  return ctx.create<ArrayInitExpr>(std::move(vals), getLoc(errTok));
 }
 
 // Parse the token stream and return the root of the AST.
-ModuleDecl *Parser::parse() {
-  Token &moduleToken = peek();
-  Decls decls;
-
+// Parse the top-level declarations up to the end of the stream. Returns false
+// if one of them fails to parse.
+bool Parser::parseDecls(Decls &decls) {
   while (!isAtEnd()) {
     auto *decl = llvm::dyn_cast_or_null<Decl>(declaration(true));
     if (!decl)
-      return nullptr;
+      return false;
     decls.push_back(decl);
   }
 
+  return !lexFailed;
+}
+
+ModuleDecl *Parser::parse() {
+  Token moduleToken = peek();
+  Decls decls;
+  if (!parseDecls(decls))
+    return nullptr;
+
   ModuleDecl *moduleStmt =
-      new ModuleDecl("main", std::move(decls), moduleToken.getLocation());
+      ctx.create<ModuleDecl>(ctx.getIdentifierTable().get("main"),
+                             std::move(decls), getLoc(moduleToken));
   return moduleStmt;
 }
+
+ModuleDecl *Parser::parseParallel(unsigned numThreads) {
+  assert(tokens && "Parallel parsing needs the whole token stream.");
+
+  // Don't bother splitting small modules.
+  constexpr uint32_t MinRangeSize = 1 << 14;
+
+  // Make a few ranges per thread, since functions differ in size.
+  numThreads = llvm::hardware_concurrency(numThreads).compute_thread_count();
+  uint32_t numRanges = std::min(numThreads * 4, end / MinRangeSize);
+  if (numThreads <= 1 || numRanges <= 1)
+    return parse();
+
+  // Split the stream into ranges of roughly the same size. Functions can be
+  // nested, so a top-level declaration is a FUN or a VAR outside of all
+  // functions. If the module has errors, the ranges might not end at
+  // declarations, and such ranges fail to parse.
+  std::vector<uint32_t> splits{current};
+  uint32_t rangeSize = (end - current) / numRanges;
+  int64_t depth = 0;
+  for (uint32_t idx = current; idx < end; ++idx) {
+    auto kind = tokens->getKind(idx);
+    if (depth == 0 && idx >= splits.back() + rangeSize &&
+        (kind == TokenKind::kw_FUN || kind == TokenKind::kw_VAR))
+      splits.push_back(idx);
+    if (kind == TokenKind::kw_FUN)
+      ++depth;
+    else if (kind == TokenKind::kw_NUF)
+      --depth;
+  }
+  splits.push_back(end);
+
+  // Parse the ranges concurrently. Each range creates the nodes in its own
+  // context and reports into its own diagnostics engine. A range is parsed
+  // only if it has no errors and its last declaration ends with the range.
+  struct Range {
+    std::unique_ptr<Diag> diag;
+    ASTContext *ctx;
+    Decls decls;
+    bool parsed = false;
+  };
+  std::vector<Range> ranges(splits.size() - 1);
+  llvm::ThreadPool pool(llvm::hardware_concurrency(numThreads));
+  for (size_t i = 0; i < ranges.size(); ++i) {
+    ranges[i].diag = std::make_unique<Diag>(diag.getSourceMgr());
+    ranges[i].ctx = &ctx.createChild();
+    pool.async([&, i] {
+      auto &range = ranges[i];
+      Parser rangeParser(*tokens, splits[i], splits[i + 1], *range.diag,
+                         *range.ctx);
+      range.parsed = rangeParser.parseDecls(range.decls) &&
+                     range.diag->getNumErrs() == 0 &&
+                     rangeParser.current == splits[i + 1];
+    });
+  }
+  pool.wait();
+
+  // Assemble the module body in source order.
+  Token moduleToken = peek();
+  Decls decls;
+  size_t numParsed = 0;
+  while (numParsed < ranges.size() && ranges[numParsed].parsed) {
+    diag.merge(*ranges[numParsed].diag);
+    decls.insert(decls.end(), ranges[numParsed].decls.begin(),
+                 ranges[numParsed].decls.end());
+    ++numParsed;
+  }
+  for (size_t i = numParsed; i < ranges.size(); ++i)
+    ranges[i].diag->discard();
+
+  // Parse the rest of the module from the first range which failed, so that
+  // the errors and the recovery from them are exactly those of parse().
+  if (numParsed < ranges.size()) {
+    current = splits[numParsed];
+    if (!parseDecls(decls))
+      return nullptr;
+  }
+
+  return ctx.create<ModuleDecl>(ctx.getIdentifierTable().get("main"),
+                                std::move(decls), getLoc(moduleToken));
+}
@@ -5,25 +5,35 @@
 #include "llvm/Pass.h"
 #include "llvm/Support/CommandLine.h"
 #include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Format.h"
 #include "llvm/Support/Host.h"
 #include "llvm/Support/InitLLVM.h"
 #include "llvm/Support/MemoryBuffer.h"
 #include "llvm/Support/TargetSelect.h"
+#include "llvm/Support/Timer.h"
 #include "llvm/Support/ToolOutputFile.h"
 #include "llvm/Support/WithColor.h"
 #include "llvm/Target/TargetMachine.h"
 #include "llvm/Transforms/Utils.h"
+#include <chrono>
+#include <thread>
 
 #include "llvm/Analysis/AliasAnalysis.h"
 #include "llvm/Analysis/TargetTransformInfo.h"
 #include "llvm/Passes/PassBuilder.h"
 #include "llvm/Passes/PassPlugin.h"
 
+#include "ASTCloner.h"
+#include "ASTContext.h"
 #include "ASTPrinter.h"
 #include "CodeGen.h"
+#include "ConstantFolder.h"
 #include "Diag.h"
+#include "EffectAnalysis.h"
+#include "IncrementalParser.h"
 #include "Lexer.h"
 #include "Parser.h"
+#include "RangeAnalysis.h"
 #include "SemaCheck.h"
 #include "Version.h"
 
@@ -42,6 +52,88 @@ static llvm::cl::opt<bool>
     printAST("print-ast", llvm::cl::desc("Print the AST of the modules"),
              llvm::cl::init(false));
 
+static llvm::cl::opt<bool>
+    printStats("print-stats",
+               llvm::cl::desc("Print memory usage statistics of the AST"),
+               llvm::cl::init(false));
+
+static llvm::cl::opt<bool> streamTokens(
+    "stream-tokens",
+    llvm::cl::desc("Lex tokens on demand while parsing, instead of lexing "
+                   "the whole file up front"),
+    llvm::cl::init(false));
+
+static llvm::cl::opt<unsigned>
+    lexThreads("lex-threads",
+               llvm::cl::desc("Number of threads used for lexing (0 uses "
+                              "all available cores)"),
+               llvm::cl::init(1));
+
+static llvm::cl::opt<ScanImpl> lexScanners(
+    "lex-scanners",
+    llvm::cl::desc("Scanners which the lexer skips over whitespace, "
+                   "identifiers and numbers with:"),
+    llvm::cl::values(clEnumValN(ScanImpl::Auto, "auto",
+                                "The best ones the host supports (default)"),
+                     clEnumValN(ScanImpl::Scalar, "scalar",
+                                "One character at a time"),
+                     clEnumValN(ScanImpl::SSE2, "sse2",
+                                "16 characters at a time, with SSE2"),
+                     clEnumValN(ScanImpl::AVX2, "avx2",
+                                "32 characters at a time, with AVX2")),
+    llvm::cl::init(ScanImpl::Auto));
+
+static llvm::cl::opt<bool>
+    timeLex("time-lex",
+            llvm::cl::desc("Only lex the input files, and print the time "
+                           "taken and the throughput of the lexer"),
+            llvm::cl::init(false));
+
+static llvm::cl::opt<unsigned> parseThreads(
+    "parse-threads",
+    llvm::cl::desc("Number of threads used for parsing (0 uses all available "
+                   "cores). Ignored with -stream-tokens"),
+    llvm::cl::init(1));
+
+static llvm::cl::opt<unsigned> semaThreads(
+    "sema-threads",
+    llvm::cl::desc("Number of threads used for the semantic check (0 uses "
+                   "all available cores)"),
+    llvm::cl::init(1));
+
+static llvm::cl::opt<bool>
+    watch("watch",
+          llvm::cl::desc("Recompile the input files whenever they change, "
+                         "parsing only the edited top-level declarations"),
+          llvm::cl::init(false));
+
+static llvm::cl::opt<bool> packBoolArrays(
+    "pack-bool-arrays",
+    llvm::cl::desc("Store BOOL arrays as bit vectors, unless they are "
+                   "accessed through pointers"),
+    llvm::cl::init(false));
+
+static llvm::cl::opt<bool> boundsCheck(
+    "fbounds-check",
+    llvm::cl::desc("Trap on array accesses out of bounds, unless the accesses "
+                   "are proven to be in bounds"),
+    llvm::cl::init(false));
+
+static llvm::cl::opt<uint64_t> constEvalSteps(
+    "fconst-eval-steps",
+    llvm::cl::desc("Maximum number of steps taken by the compile-time "
+                   "evaluation of the array sizes and global initializers of "
+                   "a module"),
+    llvm::cl::init(StepBudget::DefaultMax));
+
+static llvm::cl::opt<DiagFormat> diagFormat(
+    "diagnostics-format", llvm::cl::desc("Format of the reported diagnostics:"),
+    llvm::cl::values(clEnumValN(DiagFormat::Text, "text",
+                                "Human readable text (default)"),
+                     clEnumValN(DiagFormat::JSON, "json",
+                                "One JSON object per diagnostic")),
+    llvm::cl::init(DiagFormat::Text));
+
 static llvm::cl::opt<signed char> OptLevel(
     llvm::cl::desc("Setting the optimization level:"), llvm::cl::ZeroOrMore,
     llvm::cl::values(clEnumValN(3, "O", "Equivalent to -O3"),
@@ -189,6 +281,143 @@ bool emit(llvm::StringRef argv0, llvm::Module *M, llvm::TargetMachine *TM,
   return true;
 }
 
+// Check the parsed module and generate code for it. If foldCtx is set, the
+// module is kept unchanged after the semantic check, and the passes which
+// change it run on a copy in foldCtx.
+void compile(const char *argv0, llvm::TargetMachine *TM,
+             const std::string &fileName, Diag &diag, ASTContext &astCtx,
+             ModuleDecl *moduleDecl, ASTContext *foldCtx = nullptr) {
+  // Helper pass which prints the AST.
+  if (printAST && moduleDecl) {
+    ASTPrinter astPrinter;
+    astPrinter.run(moduleDecl);
+  }
+
+  if (diag.getNumErrs() > 0)
+    return;
+
+  // Create and run the semantic checker. It is timed along with the LLVM
+  // passes under -time-passes.
+  SemaCheck semaCheck(diag, astCtx, constEvalSteps);
+  {
+    llvm::NamedRegionTimer timer("sema", "Semantic check", "mxrlang",
+                                 "mxrlang front end",
+                                 llvm::TimePassesIsEnabled);
+    if (semaThreads == 1)
+      semaCheck.run(moduleDecl);
+    else
+      semaCheck.runParallel(moduleDecl, semaThreads);
+  }
+  diag.flush();
+
+  if (printStats)
+    astCtx.printStats(llvm::errs());
+
+  if (diag.getNumErrs() > 0)
+    return;
+
+  if (foldCtx)
+    moduleDecl = ASTCloner(*foldCtx).run(moduleDecl);
+
+  // Fold the constant expressions, and drop the code which never executes.
+  ConstantFolder constantFolder(diag, foldCtx ? *foldCtx : astCtx);
+  constantFolder.run(moduleDecl);
+  diag.flush();
+
+  if (diag.getNumErrs() > 0)
+    return;
+
+  // Helper pass which prints the AST.
+  if (printAST) {
+    ASTPrinter astPrinter;
+    astPrinter.run(moduleDecl);
+  }
+
+  if (diag.getNumErrs() > 0)
+    return;
+
+  // Find the array accesses which need no bounds checks.
+  if (boundsCheck) {
+    RangeAnalysis rangeAnalysis;
+    rangeAnalysis.run(moduleDecl);
+  }
+
+  // Infer the effects of the functions, which the generated functions are
+  // annotated with.
+  EffectAnalysis effectAnalysis(boundsCheck);
+  effectAnalysis.run(moduleDecl);
+
+  // Generate code for this module.
+  if (moduleDecl) {
+    CodeGen codeGen(TM, fileName, diag, packBoolArrays, boundsCheck);
+    codeGen.run(moduleDecl);
+    if (!emit(argv0, codeGen.getModule(), TM, fileName))
+      llvm::WithColor::error(llvm::errs(), argv0) << "Error"
+                                                     " writing output\n";
+  }
+}
+
+// Compile the input files, and then recompile each one whenever it changes,
+// until the compiler is interrupted. The modules are kept between the
+// recompilations, so that only the edited top-level declarations are lexed
+// and parsed again.
+void watchFiles(const char *argv0, llvm::TargetMachine *TM) {
+  struct WatchedFile {
+    std::string name;
+    llvm::sys::TimePoint<> modTime;
+    IncrementalParser parser;
+  };
+
+  std::vector<WatchedFile> files(inputFiles.size());
+  for (size_t i = 0; i < inputFiles.size(); ++i)
+    files[i].name = inputFiles[i];
+
+  while (true) {
+    for (auto &file : files) {
+      llvm::sys::fs::file_status status;
+      if (llvm::sys::fs::status(file.name, status) ||
+          status.getLastModificationTime() == file.modTime)
+        continue;
+      file.modTime = status.getLastModificationTime();
+
+      llvm::ErrorOr<std::unique_ptr<llvm::MemoryBuffer>> buffer =
+          llvm::MemoryBuffer::getFile(file.name);
+      if (auto buffErr = buffer.getError()) {
+        llvm::errs() << "Error reading " << file.name << ": "
+                     << buffErr.message() << "\n";
+        continue;
+      }
+
+      llvm::SourceMgr srcMgr;
+      Diag diag(srcMgr, diagFormat);
+
+      // The parser owns the buffer, as the kept AST points into it.
+      srcMgr.AddNewSourceBuffer(
+          llvm::MemoryBuffer::getMemBuffer((*buffer)->getMemBufferRef()),
+          llvm::SMLoc());
+      auto numParsed = file.parser.getNumParsed();
+      auto numReused = file.parser.getNumReused();
+      auto *moduleDecl = file.parser.parse(std::move(*buffer), srcMgr, diag);
+      diag.flush();
+
+      if (printStats)
+        llvm::errs() << "*** " << file.name << ": "
+                     << file.parser.getNumParsed() - numParsed
+                     << " top-level declarations parsed, "
+                     << file.parser.getNumReused() - numReused
+                     << " reused\n";
+
+      // The module is kept for the next revision, which checks it again, so
+      // it is folded in a copy which lives only as long as this revision.
+      ASTContext foldCtx(file.parser.getContext().getBuffer());
+      compile(argv0, TM, file.name, diag, file.parser.getContext(), moduleDecl,
+              &foldCtx);
+    }
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+  }
+}
+
 int main(int argc_, const char **argv_) {
   llvm::InitLLVM x(argc_, argv_);
 
@@ -200,10 +429,21 @@ int main(int argc_, const char **argv_) {
   llvm::cl::SetVersionPrinter(&printVersion);
   llvm::cl::ParseCommandLineOptions(argc_, argv_, Head);
 
+  if (!Lexer::setScanImpl(lexScanners)) {
+    llvm::WithColor::error(llvm::errs(), argv_[0])
+        << "The host does not support the selected lexer scanners\n";
+    exit(EXIT_FAILURE);
+  }
+
   llvm::TargetMachine *TM = createTargetMachine(argv_[0]);
   if (!TM)
     exit(EXIT_FAILURE);
 
+  if (watch) {
+    watchFiles(argv_[0], TM);
+    return 0;
+  }
+
   for (const auto &fileName : inputFiles) {
     // Get file buffer.
     llvm::ErrorOr<std::unique_ptr<llvm::MemoryBuffer>> file =
@@ -216,57 +456,50 @@ int main(int argc_, const char **argv_) {
 
     llvm::SourceMgr srcMgr;
     // Diagnostics manager, used for error reports.
-    Diag diag(srcMgr);
+    Diag diag(srcMgr, diagFormat);
 
     // Tell SrcMgr about this buffer, which is what the
     // parser will pick up.
     srcMgr.AddNewSourceBuffer(std::move(*file), llvm::SMLoc());
 
-    // Create and run the lexer.
-    Lexer lexer(srcMgr, diag);
-    auto tokens = std::move(lexer.lex());
-
-    if (diag.getNumErrs() > 0)
-      continue;
-
-    // Create and run the parser.
-    Parser parser(tokens, diag);
-    auto moduleDecl = parser.parse();
-
-    // Helper pass which prints the AST.
-    if (printAST) {
-      ASTPrinter astPrinter;
-      astPrinter.run(moduleDecl);
-    }
-
-    if (diag.getNumErrs() > 0)
-      continue;
-
-    // Create and run the semantic checker.
-    SemaCheck semaCheck(diag);
-    semaCheck.run(moduleDecl);
-
-    if (diag.getNumErrs() > 0)
-      continue;
-
-    // Helper pass which prints the AST.
-    if (printAST) {
-      ASTPrinter astPrinter;
-      astPrinter.run(moduleDecl);
+    // Context which owns the AST nodes, identifiers and types of this module.
+    // All of them are freed at once at the end of the iteration.
+    ASTContext astCtx(
+        srcMgr.getMemoryBuffer(srcMgr.getMainFileID())->getBuffer());
+
+    // Create and run the lexer. In streaming mode, the parser will drive the
+    // lexer itself.
+    Lexer lexer(srcMgr, diag, astCtx.getIdentifierTable());
+    TokenTable tokens;
+    if (!streamTokens || timeLex) {
+      auto start = std::chrono::steady_clock::now();
+      tokens = std::move(lexThreads == 1 ? lexer.lex()
+                                         : lexer.lexParallel(lexThreads));
+      std::chrono::duration<double> seconds =
+          std::chrono::steady_clock::now() - start;
+
+      diag.flush();
+      if (timeLex) {
+        double megabytes = lexer.getBuffer().size() / 1e6;
+        llvm::outs() << llvm::format(
+            "%s: %.2f MB, %u tokens, lexed in %.4f s (%.1f MB/s)\n",
+            fileName.c_str(), megabytes, tokens.size(), seconds.count(),
+            megabytes / seconds.count());
+        continue;
+      }
+      if (diag.getNumErrs() > 0)
+        continue;
     }
 
-    if (diag.getNumErrs() > 0)
-      continue;
-
-    // Generate code for this module.
-    if (moduleDecl) {
-      CodeGen codeGen(TM, fileName, diag);
-      codeGen.run(moduleDecl);
-      if (!emit(argv_[0], codeGen.getModule(), TM, fileName))
-        llvm::WithColor::error(llvm::errs(), argv_[0]) << "Error"
-                                                          " writing output\n";
-    } else
-      continue;
+    // Create and run the parser.
+    Parser parser = streamTokens ? Parser(lexer, diag, astCtx)
+                                 : Parser(tokens, diag, astCtx);
+    auto moduleDecl = streamTokens || parseThreads == 1
+                          ? parser.parse()
+                          : parser.parseParallel(parseThreads);
+    diag.flush();
+
+    compile(argv_[0], TM, fileName, diag, astCtx, moduleDecl);
   }
 
   return 0;